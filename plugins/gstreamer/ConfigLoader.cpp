@@ -1,5 +1,7 @@
 #include "ConfigLoader.h"
 
+#include <algorithm>
+
 extern "C" {
 #include "janus/utils.h"
 }
@@ -7,10 +9,174 @@ extern "C" {
 #include "PluginConfig.h"
 #include "RtspMountPoint.h"
 #include "LaunchMountPoint.h"
+#include "RtpMountPoint.h"
+#include "SrtMountPoint.h"
+#include "RtspPushMountPoint.h"
+#include "MosaicMountPoint.h"
 
 #include "CxxPtr/GlibPtr.h"
 
 
+enum {
+    MIN_MTU = 256,
+    MAX_MTU = 1500,
+    MAX_DVR_SIZE = 4096, // MiB
+    MAX_DVR_CATCH_UP_SPEED = 400, // %
+    MAX_SHM_SIZE = 1024, // MiB
+    MAX_SRT_LATENCY = 10000, // ms
+    MAX_SRT_BUFFER = 60000, // ms
+    MAX_HLS_SEGMENT_DURATION = 60, // s
+    MIN_HLS_PART_DURATION = 50, // ms
+    MIN_HLS_SEGMENTS = 3,
+    MAX_CPU = 1023,
+    MAX_FIFO_PRIORITY = 99,
+    MIN_NICE = -20,
+    MAX_NICE = 19,
+};
+
+// "1280x720@2000, 640x360@800" - width x height @ kbit/s
+static std::vector<MediaConfig::Rendition> ParseLadder(const char* ladder)
+{
+    std::vector<MediaConfig::Rendition> renditions;
+
+    gchar** items = g_strsplit(ladder, ",", -1);
+    for(gchar** item = items; *item; ++item) {
+        MediaConfig::Rendition rendition;
+        if(3 == sscanf(*item, " %ux%u@%u", &rendition.width, &rendition.height, &rendition.bitrate) &&
+           rendition.width && rendition.height && rendition.bitrate)
+        {
+            renditions.push_back(rendition);
+        } else
+            JANUS_LOG(LOG_ERR, "Invalid ladder rendition \"%s\"\n", *item);
+    }
+    g_strfreev(items);
+
+    std::sort(renditions.begin(), renditions.end(),
+        [] (const MediaConfig::Rendition& x, const MediaConfig::Rendition& y) {
+            return x.width * x.height > y.width * y.height;
+        });
+
+    return renditions;
+}
+
+// "auto", "tcp" or "udp"
+static void ParseRtspTransport(const char* value, RtspConfig::Transport* transport)
+{
+    if(0 == strcasecmp(value, "auto"))
+        *transport = RtspConfig::Transport::Auto;
+    else if(0 == strcasecmp(value, "tcp"))
+        *transport = RtspConfig::Transport::Tcp;
+    else if(0 == strcasecmp(value, "udp"))
+        *transport = RtspConfig::Transport::Udp;
+    else
+        JANUS_LOG(LOG_ERR, "Invalid rtsp transport \"%s\"\n", value);
+}
+
+// "0-3, 6" - cpu numbers and ranges
+static std::vector<unsigned> ParseCpus(const char* cpus)
+{
+    std::vector<unsigned> parsed;
+
+    gchar** items = g_strsplit(cpus, ",", -1);
+    for(gchar** item = items; *item; ++item) {
+        unsigned first, last;
+        const int count = sscanf(*item, " %u - %u", &first, &last);
+        if(1 == count)
+            last = first;
+
+        if(count >= 1 && first <= last && last <= MAX_CPU) {
+            for(unsigned cpu = first; cpu <= last; ++cpu)
+                parsed.push_back(cpu);
+        } else
+            JANUS_LOG(LOG_ERR, "Invalid cpu \"%s\"\n", *item);
+    }
+    g_strfreev(items);
+
+    std::sort(parsed.begin(), parsed.end());
+    parsed.erase(std::unique(parsed.begin(), parsed.end()), parsed.end());
+
+    return parsed;
+}
+
+// "default", "fifo:<1-99>" or "nice:<-20-19>"
+static void ParseScheduling(const char* value, MediaConfig::Threads* threads)
+{
+    int priority;
+    if(0 == strcasecmp(value, "default")) {
+        threads->scheduling = MediaConfig::Threads::Scheduling::Default;
+        threads->priority = 0;
+    } else if(1 == sscanf(value, "fifo:%d", &priority) &&
+              priority > 0 && priority <= MAX_FIFO_PRIORITY)
+    {
+        threads->scheduling = MediaConfig::Threads::Scheduling::Fifo;
+        threads->priority = priority;
+    } else if(1 == sscanf(value, "nice:%d", &priority) &&
+              priority >= MIN_NICE && priority <= MAX_NICE)
+    {
+        threads->scheduling = MediaConfig::Threads::Scheduling::Nice;
+        threads->priority = priority;
+    } else
+        JANUS_LOG(LOG_ERR, "Invalid scheduling \"%s\"\n", value);
+}
+
+// "cpus", "encoder_cpus" and "scheduling" of general category or mount point
+static void LoadThreads(
+    janus_config* config,
+    janus_config_category* category,
+    MediaConfig::Threads* threads)
+{
+    janus_config_item* cpusItem =
+        janus_config_get(config, category, janus_config_type_item, "cpus");
+    janus_config_item* encoderCpusItem =
+        janus_config_get(config, category, janus_config_type_item, "encoder_cpus");
+    janus_config_item* schedulingItem =
+        janus_config_get(config, category, janus_config_type_item, "scheduling");
+
+    if(cpusItem && cpusItem->value)
+        threads->cpus = ParseCpus(cpusItem->value);
+    if(encoderCpusItem && encoderCpusItem->value)
+        threads->encoderCpus = ParseCpus(encoderCpusItem->value);
+    if(schedulingItem && schedulingItem->value)
+        ParseScheduling(schedulingItem->value, threads);
+}
+
+// "1, 2, 5" - mount point ids
+static std::vector<int> ParseMosaicSources(const char* sources)
+{
+    std::vector<int> ids;
+
+    gchar** items = g_strsplit(sources, ",", -1);
+    for(gchar** item = items; *item; ++item) {
+        int id;
+        if(1 == sscanf(*item, " %d", &id) && id > 0)
+            ids.push_back(id);
+        else
+            JANUS_LOG(LOG_ERR, "Invalid mosaic source \"%s\"\n", *item);
+    }
+    g_strfreev(items);
+
+    return ids;
+}
+
+// "127.0.0.1:5004, 239.0.0.1:5004" - IPv4 address : video port
+static std::vector<MediaConfig::Forward::Destination> ParseForwardDestinations(const char* destinations)
+{
+    std::vector<MediaConfig::Forward::Destination> parsed;
+
+    gchar** items = g_strsplit(destinations, ",", -1);
+    for(gchar** item = items; *item; ++item) {
+        char host[64];
+        unsigned port;
+        if(2 == sscanf(*item, " %63[^:]:%u", host, &port) && port > 0 && port < G_MAXUINT16 - 2)
+            parsed.push_back(MediaConfig::Forward::Destination{host, static_cast<unsigned short>(port)});
+        else
+            JANUS_LOG(LOG_ERR, "Invalid forward destination \"%s\"\n", *item);
+    }
+    g_strfreev(items);
+
+    return parsed;
+}
+
 void LoadConfig(
     janus_callbacks* janus,
     janus_plugin* janusPlugin,
@@ -48,6 +214,25 @@ void LoadConfig(
             pluginConfig->maxDynamicMountPoints = maxDynamicMountPoints;
     }
 
+    janus_config_item* rtspServerPortItem =
+        janus_config_get(config, general, janus_config_type_item, "rtsp_server_port");
+
+    if(rtspServerPortItem && rtspServerPortItem->value) {
+        const int port = atoi(rtspServerPortItem->value);
+        if(port > 0 && port <= G_MAXUINT16)
+            pluginConfig->rtspServerPort = port;
+        else
+            JANUS_LOG(LOG_ERR, "Invalid rtsp server port \"%s\"\n", rtspServerPortItem->value);
+    }
+
+    janus_config_item* rtspTransportItem =
+        janus_config_get(config, general, janus_config_type_item, "rtsp_transport");
+
+    if(rtspTransportItem && rtspTransportItem->value)
+        ParseRtspTransport(rtspTransportItem->value, &pluginConfig->rtsp.transport);
+
+    LoadThreads(config, general, &pluginConfig->threads);
+
 
     janus_config_array* streamsList =
         janus_config_get(config, NULL, janus_config_type_array, "streams");
@@ -68,6 +253,52 @@ void LoadConfig(
             janus_config_get(config, stream, janus_config_type_item, "video");
         janus_config_item* audioItem =
             janus_config_get(config, stream, janus_config_type_item, "audio");
+        janus_config_item* ladderItem =
+            janus_config_get(config, stream, janus_config_type_item, "ladder");
+        janus_config_item* ladderCodecItem =
+            janus_config_get(config, stream, janus_config_type_item, "ladder_codec");
+        janus_config_item* audioTranscodeItem =
+            janus_config_get(config, stream, janus_config_type_item, "audio_transcode");
+        janus_config_item* opusBitrateItem =
+            janus_config_get(config, stream, janus_config_type_item, "opus_bitrate");
+        janus_config_item* opusDtxItem =
+            janus_config_get(config, stream, janus_config_type_item, "opus_dtx");
+        janus_config_item* opusFecItem =
+            janus_config_get(config, stream, janus_config_type_item, "opus_fec");
+        janus_config_item* opusFrameSizeItem =
+            janus_config_get(config, stream, janus_config_type_item, "opus_frame_size");
+        janus_config_item* mtuItem =
+            janus_config_get(config, stream, janus_config_type_item, "mtu");
+        janus_config_item* dvrItem =
+            janus_config_get(config, stream, janus_config_type_item, "dvr");
+        janus_config_item* dvrSizeItem =
+            janus_config_get(config, stream, janus_config_type_item, "dvr_size");
+        janus_config_item* dvrDurationItem =
+            janus_config_get(config, stream, janus_config_type_item, "dvr_duration");
+        janus_config_item* dvrPathItem =
+            janus_config_get(config, stream, janus_config_type_item, "dvr_path");
+        janus_config_item* dvrCatchUpSpeedItem =
+            janus_config_get(config, stream, janus_config_type_item, "dvr_catchup_speed");
+        janus_config_item* recordPathItem =
+            janus_config_get(config, stream, janus_config_type_item, "record_path");
+        janus_config_item* recordSegmentDurationItem =
+            janus_config_get(config, stream, janus_config_type_item, "record_segment_duration");
+        janus_config_item* recordMaxSegmentsItem =
+            janus_config_get(config, stream, janus_config_type_item, "record_max_segments");
+        janus_config_item* forwardItem =
+            janus_config_get(config, stream, janus_config_type_item, "forward");
+        janus_config_item* forwardTtlItem =
+            janus_config_get(config, stream, janus_config_type_item, "forward_ttl");
+        janus_config_item* republishItem =
+            janus_config_get(config, stream, janus_config_type_item, "republish");
+        janus_config_item* hlsPathItem =
+            janus_config_get(config, stream, janus_config_type_item, "hls_path");
+        janus_config_item* hlsSegmentDurationItem =
+            janus_config_get(config, stream, janus_config_type_item, "hls_segment_duration");
+        janus_config_item* hlsPartDurationItem =
+            janus_config_get(config, stream, janus_config_type_item, "hls_part_duration");
+        janus_config_item* hlsSegmentsItem =
+            janus_config_get(config, stream, janus_config_type_item, "hls_segments");
 
         if(!typeItem || !typeItem->value)
             continue;
@@ -92,6 +323,146 @@ void LoadConfig(
         else
             continue;
 
+        MediaConfig mediaConfig;
+        mediaConfig.threads = pluginConfig->threads;
+        LoadThreads(config, stream, &mediaConfig.threads);
+        if(ladderItem && ladderItem->value)
+            mediaConfig.ladder = ParseLadder(ladderItem->value);
+        if(ladderCodecItem && ladderCodecItem->value) {
+            if(0 == strcasecmp(ladderCodecItem->value, "vp8"))
+                mediaConfig.ladderCodec = MediaConfig::LadderCodec::VP8;
+            else if(0 == strcasecmp(ladderCodecItem->value, "h264"))
+                mediaConfig.ladderCodec = MediaConfig::LadderCodec::H264;
+            else
+                JANUS_LOG(LOG_ERR, "Unknown ladder codec \"%s\"\n", ladderCodecItem->value);
+        }
+        if(audioTranscodeItem && audioTranscodeItem->value) {
+            if(0 == strcasecmp(audioTranscodeItem->value, "auto"))
+                mediaConfig.audioTranscode = MediaConfig::AudioTranscode::Auto;
+            else if(0 == strcasecmp(audioTranscodeItem->value, "always"))
+                mediaConfig.audioTranscode = MediaConfig::AudioTranscode::Always;
+            else if(0 == strcasecmp(audioTranscodeItem->value, "never"))
+                mediaConfig.audioTranscode = MediaConfig::AudioTranscode::Never;
+            else
+                JANUS_LOG(LOG_ERR, "Unknown audio transcode mode \"%s\"\n", audioTranscodeItem->value);
+        }
+        if(opusBitrateItem && opusBitrateItem->value) {
+            const int bitrate = atoi(opusBitrateItem->value);
+            if(bitrate >= 6 && bitrate <= 510)
+                mediaConfig.opus.bitrate = bitrate;
+            else
+                JANUS_LOG(LOG_ERR, "Invalid opus bitrate \"%s\"\n", opusBitrateItem->value);
+        }
+        if(opusDtxItem && opusDtxItem->value)
+            mediaConfig.opus.dtx = janus_is_true(opusDtxItem->value);
+        if(opusFecItem && opusFecItem->value)
+            mediaConfig.opus.fec = janus_is_true(opusFecItem->value);
+        if(opusFrameSizeItem && opusFrameSizeItem->value) {
+            const int frameSize = atoi(opusFrameSizeItem->value);
+            if(frameSize == 10 || frameSize == 20 || frameSize == 40 || frameSize == 60)
+                mediaConfig.opus.frameSize = frameSize;
+            else
+                JANUS_LOG(LOG_ERR, "Invalid opus frame size \"%s\"\n", opusFrameSizeItem->value);
+        }
+        if(mtuItem && mtuItem->value) {
+            const int mtu = atoi(mtuItem->value);
+            if(0 == mtu || (mtu >= MIN_MTU && mtu <= MAX_MTU))
+                mediaConfig.mtu = mtu;
+            else
+                JANUS_LOG(LOG_ERR, "Invalid mtu \"%s\"\n", mtuItem->value);
+        }
+        if(dvrItem && dvrItem->value) {
+            if(0 == strcasecmp(dvrItem->value, "memory"))
+                mediaConfig.dvr.storage = MediaConfig::Dvr::Storage::Memory;
+            else if(0 == strcasecmp(dvrItem->value, "file"))
+                mediaConfig.dvr.storage = MediaConfig::Dvr::Storage::File;
+            else
+                JANUS_LOG(LOG_ERR, "Unknown dvr storage \"%s\"\n", dvrItem->value);
+        }
+        if(dvrSizeItem && dvrSizeItem->value) {
+            const int size = atoi(dvrSizeItem->value);
+            if(size > 0 && size <= MAX_DVR_SIZE)
+                mediaConfig.dvr.size = size;
+            else
+                JANUS_LOG(LOG_ERR, "Invalid dvr size \"%s\"\n", dvrSizeItem->value);
+        }
+        if(dvrDurationItem && dvrDurationItem->value) {
+            const int duration = atoi(dvrDurationItem->value);
+            if(duration > 0)
+                mediaConfig.dvr.duration = duration;
+            else
+                JANUS_LOG(LOG_ERR, "Invalid dvr duration \"%s\"\n", dvrDurationItem->value);
+        }
+        if(dvrPathItem && dvrPathItem->value)
+            mediaConfig.dvr.path = dvrPathItem->value;
+        if(dvrCatchUpSpeedItem && dvrCatchUpSpeedItem->value) {
+            const int speed = atoi(dvrCatchUpSpeedItem->value);
+            if(speed >= 100 && speed <= MAX_DVR_CATCH_UP_SPEED)
+                mediaConfig.dvr.catchUpSpeed = speed;
+            else
+                JANUS_LOG(LOG_ERR, "Invalid dvr catch up speed \"%s\"\n", dvrCatchUpSpeedItem->value);
+        }
+        if(MediaConfig::Dvr::Storage::File == mediaConfig.dvr.storage && mediaConfig.dvr.path.empty()) {
+            JANUS_LOG(LOG_ERR, "Missing dvr path\n");
+            mediaConfig.dvr.storage = MediaConfig::Dvr::Storage::None;
+        }
+        if(recordPathItem && recordPathItem->value)
+            mediaConfig.record.path = recordPathItem->value;
+        if(recordSegmentDurationItem && recordSegmentDurationItem->value) {
+            const int segmentDuration = atoi(recordSegmentDurationItem->value);
+            if(segmentDuration > 0)
+                mediaConfig.record.segmentDuration = segmentDuration;
+            else
+                JANUS_LOG(LOG_ERR, "Invalid record segment duration \"%s\"\n", recordSegmentDurationItem->value);
+        }
+        if(recordMaxSegmentsItem && recordMaxSegmentsItem->value) {
+            const int maxSegments = atoi(recordMaxSegmentsItem->value);
+            if(maxSegments >= 0)
+                mediaConfig.record.maxSegments = maxSegments;
+            else
+                JANUS_LOG(LOG_ERR, "Invalid record max segments \"%s\"\n", recordMaxSegmentsItem->value);
+        }
+        if(forwardItem && forwardItem->value)
+            mediaConfig.forward.destinations = ParseForwardDestinations(forwardItem->value);
+        if(forwardTtlItem && forwardTtlItem->value) {
+            const int ttl = atoi(forwardTtlItem->value);
+            if(ttl > 0 && ttl <= 255)
+                mediaConfig.forward.ttl = ttl;
+            else
+                JANUS_LOG(LOG_ERR, "Invalid forward ttl \"%s\"\n", forwardTtlItem->value);
+        }
+        if(republishItem && republishItem->value && republishItem->value[0]) {
+            mediaConfig.republish.path = republishItem->value;
+            if(mediaConfig.republish.path[0] != '/')
+                mediaConfig.republish.path.insert(0, "/");
+            mediaConfig.republish.port = pluginConfig->rtspServerPort;
+        }
+        if(hlsPathItem && hlsPathItem->value)
+            mediaConfig.hls.path = hlsPathItem->value;
+        if(hlsSegmentDurationItem && hlsSegmentDurationItem->value) {
+            const int duration = atoi(hlsSegmentDurationItem->value);
+            if(duration > 0 && duration <= MAX_HLS_SEGMENT_DURATION)
+                mediaConfig.hls.segmentDuration = duration;
+            else
+                JANUS_LOG(LOG_ERR, "Invalid hls segment duration \"%s\"\n", hlsSegmentDurationItem->value);
+        }
+        if(hlsPartDurationItem && hlsPartDurationItem->value) {
+            const int duration = atoi(hlsPartDurationItem->value);
+            if(duration >= MIN_HLS_PART_DURATION &&
+               static_cast<unsigned>(duration) < mediaConfig.hls.segmentDuration * 1000)
+            {
+                mediaConfig.hls.partDuration = duration;
+            } else
+                JANUS_LOG(LOG_ERR, "Invalid hls part duration \"%s\"\n", hlsPartDurationItem->value);
+        }
+        if(hlsSegmentsItem && hlsSegmentsItem->value) {
+            const int segments = atoi(hlsSegmentsItem->value);
+            if(segments >= MIN_HLS_SEGMENTS)
+                mediaConfig.hls.segments = segments;
+            else
+                JANUS_LOG(LOG_ERR, "Invalid hls segments count \"%s\"\n", hlsSegmentsItem->value);
+        }
+
         const std::string type = typeItem->value;
         if(type == "rtsp") {
             janus_config_item* urlItem =
@@ -104,12 +475,20 @@ void LoadConfig(
             if(url.empty())
                 continue;
 
+            RtspConfig rtspConfig = pluginConfig->rtsp;
+            janus_config_item* transportItem =
+                janus_config_get(config, stream, janus_config_type_item, "rtsp_transport");
+            if(transportItem && transportItem->value)
+                ParseRtspTransport(transportItem->value, &rtspConfig.transport);
+
             mountPoints->emplace(
                 mountPoints->size() + 1,
                 new RtspMountPoint(
                     janus, janusPlugin,
                     url,
+                    rtspConfig,
                     flags,
+                    mediaConfig,
                     description.empty() ? url : description)
                 );
         } else if(type == "launch") {
@@ -129,8 +508,197 @@ void LoadConfig(
                     janus, janusPlugin,
                     pipeline,
                     flags,
+                    mediaConfig,
                     description.empty() ? pipeline : description)
                 );
+        } else if(type == "rtp" || type == "shm") {
+            janus_config_item* sdpItem =
+                janus_config_get(config, stream, janus_config_type_item, "sdp");
+            janus_config_item* pathItem =
+                janus_config_get(config, stream, janus_config_type_item, "path");
+            janus_config_item* shmSizeItem =
+                janus_config_get(config, stream, janus_config_type_item, "shm_size");
+
+            if(!sdpItem || !sdpItem->value)
+                continue;
+
+            const std::string sdp = sdpItem->value;
+            if(sdp.empty())
+                continue;
+
+            ShmConfig shmConfig;
+            if(type == "shm") {
+                if(!pathItem || !pathItem->value || !pathItem->value[0]) {
+                    JANUS_LOG(LOG_ERR, "Shared memory mount point without path\n");
+                    continue;
+                }
+                shmConfig.path = pathItem->value;
+
+                if(shmSizeItem && shmSizeItem->value) {
+                    const int size = atoi(shmSizeItem->value);
+                    if(size > 0 && size <= MAX_SHM_SIZE)
+                        shmConfig.size = size;
+                    else
+                        JANUS_LOG(LOG_ERR, "Invalid shm size \"%s\"\n", shmSizeItem->value);
+                }
+            }
+
+            mountPoints->emplace(
+                mountPoints->size() + 1,
+                new RtpMountPoint(
+                    janus, janusPlugin,
+                    sdp,
+                    shmConfig,
+                    flags,
+                    mediaConfig,
+                    description.empty() ? type : description)
+                );
+        } else if(type == "rtsp_push") {
+            janus_config_item* pathItem =
+                janus_config_get(config, stream, janus_config_type_item, "path");
+            janus_config_item* publishUserItem =
+                janus_config_get(config, stream, janus_config_type_item, "publish_user");
+            janus_config_item* publishPasswordItem =
+                janus_config_get(config, stream, janus_config_type_item, "publish_password");
+
+            if(!pathItem || !pathItem->value)
+                continue;
+
+            RtspPushConfig pushConfig;
+            pushConfig.port = pluginConfig->rtspServerPort;
+            pushConfig.path = pathItem->value;
+            if(pushConfig.path.empty())
+                continue;
+            if(pushConfig.path[0] != '/')
+                pushConfig.path.insert(0, "/");
+
+            // otherwise anyone reaching rtsp_server_port could inject media to viewers
+            if(!publishUserItem || !publishUserItem->value || !publishUserItem->value[0]) {
+                JANUS_LOG(LOG_ERR, "Missing publish_user of \"%s\"\n", pushConfig.path.c_str());
+                continue;
+            }
+            pushConfig.user = publishUserItem->value;
+            if(publishPasswordItem && publishPasswordItem->value)
+                pushConfig.password = publishPasswordItem->value;
+
+            mountPoints->emplace(
+                mountPoints->size() + 1,
+                new RtspPushMountPoint(
+                    janus, janusPlugin,
+                    pushConfig,
+                    flags,
+                    mediaConfig,
+                    description.empty() ? pushConfig.path : description)
+                );
+        } else if(type == "srt") {
+            janus_config_item* urlItem =
+                janus_config_get(config, stream, janus_config_type_item, "url");
+            janus_config_item* srtModeItem =
+                janus_config_get(config, stream, janus_config_type_item, "srt_mode");
+            janus_config_item* srtLatencyItem =
+                janus_config_get(config, stream, janus_config_type_item, "srt_latency");
+            janus_config_item* srtBufferItem =
+                janus_config_get(config, stream, janus_config_type_item, "srt_buffer");
+
+            if(!urlItem || !urlItem->value)
+                continue;
+
+            SrtConfig srtConfig;
+            srtConfig.url = urlItem->value;
+            if(srtConfig.url.empty())
+                continue;
+
+            if(srtModeItem && srtModeItem->value) {
+                const std::string mode = srtModeItem->value;
+                if(mode == "listener")
+                    srtConfig.listener = true;
+                else if(mode != "caller")
+                    JANUS_LOG(LOG_ERR, "Invalid srt mode \"%s\"\n", srtModeItem->value);
+            }
+            if(srtLatencyItem && srtLatencyItem->value) {
+                const int latency = atoi(srtLatencyItem->value);
+                if(latency >= 0 && latency <= MAX_SRT_LATENCY)
+                    srtConfig.latency = latency;
+                else
+                    JANUS_LOG(LOG_ERR, "Invalid srt latency \"%s\"\n", srtLatencyItem->value);
+            }
+            if(srtBufferItem && srtBufferItem->value) {
+                const int buffer = atoi(srtBufferItem->value);
+                if(buffer > 0 && buffer <= MAX_SRT_BUFFER)
+                    srtConfig.buffer = buffer;
+                else
+                    JANUS_LOG(LOG_ERR, "Invalid srt buffer \"%s\"\n", srtBufferItem->value);
+            }
+
+            mountPoints->emplace(
+                mountPoints->size() + 1,
+                new SrtMountPoint(
+                    janus, janusPlugin,
+                    srtConfig,
+                    flags,
+                    mediaConfig,
+                    description.empty() ? srtConfig.url : description)
+                );
+        } else if(type == "mosaic") {
+            janus_config_item* sourcesItem =
+                janus_config_get(config, stream, janus_config_type_item, "sources");
+            janus_config_item* layoutItem =
+                janus_config_get(config, stream, janus_config_type_item, "layout");
+            janus_config_item* resolutionItem =
+                janus_config_get(config, stream, janus_config_type_item, "resolution");
+            janus_config_item* framerateItem =
+                janus_config_get(config, stream, janus_config_type_item, "framerate");
+            janus_config_item* bitrateItem =
+                janus_config_get(config, stream, janus_config_type_item, "bitrate");
+
+            if(!sourcesItem || !sourcesItem->value)
+                continue;
+
+            const std::vector<int> sources = ParseMosaicSources(sourcesItem->value);
+            if(sources.empty())
+                continue;
+
+            MosaicConfig mosaicConfig;
+            if(layoutItem && layoutItem->value &&
+               (2 != sscanf(layoutItem->value, "%ux%u", &mosaicConfig.columns, &mosaicConfig.rows) ||
+                !mosaicConfig.columns || !mosaicConfig.rows))
+            {
+                JANUS_LOG(LOG_ERR, "Invalid mosaic layout \"%s\"\n", layoutItem->value);
+                mosaicConfig.columns = mosaicConfig.rows = 0;
+            }
+            if(resolutionItem && resolutionItem->value) {
+                unsigned width, height;
+                if(2 == sscanf(resolutionItem->value, "%ux%u", &width, &height) && width && height) {
+                    mosaicConfig.width = width;
+                    mosaicConfig.height = height;
+                } else
+                    JANUS_LOG(LOG_ERR, "Invalid mosaic resolution \"%s\"\n", resolutionItem->value);
+            }
+            if(framerateItem && framerateItem->value) {
+                const int framerate = atoi(framerateItem->value);
+                if(framerate > 0)
+                    mosaicConfig.framerate = framerate;
+                else
+                    JANUS_LOG(LOG_ERR, "Invalid mosaic framerate \"%s\"\n", framerateItem->value);
+            }
+            if(bitrateItem && bitrateItem->value) {
+                const int bitrate = atoi(bitrateItem->value);
+                if(bitrate > 0)
+                    mosaicConfig.bitrate = bitrate;
+                else
+                    JANUS_LOG(LOG_ERR, "Invalid mosaic bitrate \"%s\"\n", bitrateItem->value);
+            }
+
+            mountPoints->emplace(
+                mountPoints->size() + 1,
+                new MosaicMountPoint(
+                    janus, janusPlugin,
+                    *mountPoints,
+                    sources,
+                    mosaicConfig,
+                    mediaConfig,
+                    description.empty() ? "mosaic" : description)
+                );
         } else
             continue;
     }
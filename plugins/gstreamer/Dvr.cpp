@@ -0,0 +1,224 @@
+#include "Dvr.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+extern "C" {
+#include "janus/debug.h"
+}
+
+
+namespace {
+
+enum {
+    RECORD_ALIGNMENT = 8,
+    MIN_INDEX_INTERVAL = 500000, // us
+};
+
+const guint32 WRAP_RECORD = G_MAXUINT32; // rest of ring is unused
+
+}
+
+struct Dvr::RecordHeader
+{
+    guint32 size; // packet size or WRAP_RECORD
+    guint32 stream;
+    gint64 time;
+};
+
+static gsize Align(gsize size)
+{
+    return (size + RECORD_ALIGNMENT - 1) & ~gsize(RECORD_ALIGNMENT - 1);
+}
+
+Dvr::Dvr(const MediaConfig::Dvr& config) :
+    _config(config),
+    _capacity(Align(gsize(config.size) * 1024 * 1024)),
+    _ring(nullptr), _fd(-1),
+    _head(0), _tail(0), _indexStream(-1)
+{
+    if(MediaConfig::Dvr::Storage::File == config.storage) {
+        _fd = open(config.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if(_fd < 0) {
+            JANUS_LOG(LOG_ERR,
+                "Failed to open dvr file \"%s\": %s\n",
+                config.path.c_str(), g_strerror(errno));
+            return;
+        }
+
+        if(0 != ftruncate(_fd, _capacity)) {
+            JANUS_LOG(LOG_ERR,
+                "Failed to resize dvr file \"%s\": %s\n",
+                config.path.c_str(), g_strerror(errno));
+            return;
+        }
+
+        void* ring = mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if(MAP_FAILED == ring) {
+            JANUS_LOG(LOG_ERR,
+                "Failed to map dvr file \"%s\": %s\n",
+                config.path.c_str(), g_strerror(errno));
+            return;
+        }
+
+        _ring = static_cast<char*>(ring);
+    } else {
+        _ring = static_cast<char*>(g_try_malloc(_capacity));
+        if(!_ring)
+            JANUS_LOG(LOG_ERR, "Failed to allocate %u MiB for dvr\n", config.size);
+    }
+}
+
+Dvr::~Dvr()
+{
+    if(_fd >= 0) {
+        if(_ring)
+            munmap(_ring, _capacity);
+        close(_fd);
+    } else
+        g_free(_ring);
+}
+
+bool Dvr::isValid() const
+{
+    return _ring != nullptr;
+}
+
+// record can't be split, so if it doesn't fit into the rest of ring, the rest is skipped
+gsize Dvr::recordSize(Position position) const
+{
+    const gsize offset = position % _capacity;
+    if(_capacity - offset < sizeof(RecordHeader))
+        return _capacity - offset;
+
+    const RecordHeader* header = reinterpret_cast<const RecordHeader*>(_ring + offset);
+    if(WRAP_RECORD == header->size)
+        return _capacity - offset;
+
+    return Align(sizeof(RecordHeader) + header->size);
+}
+
+// drops the oldest records to free space for new one
+void Dvr::reserve(gsize size)
+{
+    while(_head + size - _tail > _capacity)
+        _tail += recordSize(_tail);
+
+    while(!_index.empty() && _index.front().position < _tail)
+        _index.pop_front();
+}
+
+void Dvr::mediaPrepared(const std::vector<Stream>& streams)
+{
+    // video key frames are indexed if there is video at all
+    int indexStream = -1;
+    for(const Stream& stream: streams) {
+        if(stream.video || indexStream < 0)
+            indexStream = stream.index;
+        if(stream.video)
+            break;
+    }
+
+    std::lock_guard<std::mutex> lock(_guard);
+    _indexStream = indexStream;
+}
+
+void Dvr::onPacket(unsigned stream, bool keyFrame, const char* data, size_t size)
+{
+    if(!_ring)
+        return;
+
+    const gsize recordSize = Align(sizeof(RecordHeader) + size);
+    if(recordSize > _capacity / 2)
+        return;
+
+    const gint64 now = g_get_real_time();
+
+    std::lock_guard<std::mutex> lock(_guard);
+
+    const gsize offset = _head % _capacity;
+    if(_capacity - offset < recordSize) {
+        reserve(_capacity - offset);
+        if(_capacity - offset >= sizeof(RecordHeader))
+            reinterpret_cast<RecordHeader*>(_ring + offset)->size = WRAP_RECORD;
+        _head += _capacity - offset;
+    }
+
+    reserve(recordSize);
+
+    RecordHeader* header = reinterpret_cast<RecordHeader*>(_ring + _head % _capacity);
+    header->size = size;
+    header->stream = stream;
+    header->time = now;
+    memcpy(header + 1, data, size);
+
+    if(keyFrame && static_cast<int>(stream) == _indexStream &&
+       (_index.empty() || now - _index.back().time >= MIN_INDEX_INTERVAL))
+    {
+        _index.push_back(KeyFrame{_head, now});
+    }
+
+    _head += recordSize;
+
+    const gint64 oldest = now - gint64(_config.duration) * G_USEC_PER_SEC;
+    while(_index.size() > 1 && _index.front().time < oldest)
+        _index.pop_front();
+}
+
+bool Dvr::seek(gint64 time, Position* position, gint64* keyFrameTime) const
+{
+    std::lock_guard<std::mutex> lock(_guard);
+
+    if(_index.empty())
+        return false;
+
+    auto it =
+        std::upper_bound(_index.begin(), _index.end(), time,
+            [] (gint64 time, const KeyFrame& keyFrame) {
+                return time < keyFrame.time;
+            });
+    if(it != _index.begin())
+        --it;
+
+    *position = it->position;
+    *keyFrameTime = it->time;
+
+    return true;
+}
+
+Dvr::ReadResult Dvr::read(Position* position, gint64 notLaterThan, Record* record) const
+{
+    std::lock_guard<std::mutex> lock(_guard);
+
+    if(*position < _tail)
+        return ReadResult::Lost;
+
+    for(;;) {
+        if(*position >= _head)
+            return ReadResult::End;
+
+        const gsize offset = *position % _capacity;
+        const RecordHeader* header = reinterpret_cast<const RecordHeader*>(_ring + offset);
+        if(_capacity - offset < sizeof(RecordHeader) || WRAP_RECORD == header->size) {
+            *position += _capacity - offset;
+            continue;
+        }
+
+        if(header->time > notLaterThan)
+            return ReadResult::NotYet;
+
+        const char* packet = reinterpret_cast<const char*>(header + 1);
+        record->stream = header->stream;
+        record->time = header->time;
+        record->packet.assign(packet, packet + header->size);
+
+        *position += Align(sizeof(RecordHeader) + header->size);
+
+        return ReadResult::Ok;
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <glib.h>
+
+#include "MediaConfig.h"
+#include "MountPointTap.h"
+
+
+// bounded ring of relayed RTP packets (in memory or in memory mapped file),
+// indexed by key frames and wall clock time.
+// Written from streaming threads, read from plugin thread.
+class Dvr : public MountPointTap
+{
+public:
+    typedef guint64 Position; // total bytes written before record
+
+    struct Record
+    {
+        unsigned stream;
+        gint64 time; // wall clock, us
+        std::vector<char> packet;
+    };
+
+    enum class ReadResult {
+        Ok,
+        NotYet, // next record was written later than requested
+        End, // everything written is read already
+        Lost, // record at position is overwritten already
+    };
+
+    Dvr(const MediaConfig::Dvr&);
+    ~Dvr();
+
+    bool isValid() const;
+
+    // finds the last key frame written not later than time (or the oldest one)
+    bool seek(gint64 time, Position*, gint64* keyFrameTime) const;
+    ReadResult read(Position*, gint64 notLaterThan, Record*) const;
+
+    void mediaPrepared(const std::vector<Stream>&) override;
+    void onPacket(unsigned stream, bool keyFrame, const char* data, size_t size) override;
+
+private:
+    struct RecordHeader;
+    struct KeyFrame
+    {
+        Position position;
+        gint64 time;
+    };
+
+    gsize recordSize(Position) const;
+    void reserve(gsize size);
+
+private:
+    const MediaConfig::Dvr _config;
+    const gsize _capacity;
+    char* _ring;
+    int _fd;
+
+    mutable std::mutex _guard;
+    Position _head;
+    Position _tail;
+    std::deque<KeyFrame> _index;
+    int _indexStream;
+};
@@ -0,0 +1,363 @@
+#include "H26xRepacketizer.h"
+
+#include <cstring>
+#include <algorithm>
+
+
+namespace {
+
+enum {
+    H264_NAL_SEI = 6,
+    H264_NAL_AUD = 9,
+    H264_NAL_STAP_A = 24,
+    H264_NAL_FU_A = 28,
+};
+
+enum {
+    H265_NAL_VPS = 32,
+    H265_NAL_PREFIX_SEI = 39,
+    H265_NAL_AP = 48,
+    H265_NAL_FU = 49,
+};
+
+enum {
+    FU_START = 0x80,
+    FU_END = 0x40,
+};
+
+}
+
+H26xRepacketizer::H26xRepacketizer(H26xCodec codec, size_t mtu) :
+    _codec(codec),
+    _nalHeaderSize(H26xCodec::H265 == codec ? 2 : 1),
+    _fuHeaderSize(H26xCodec::H265 == codec ? 3 : 2),
+    _mtu(mtu)
+{
+    _packet.reserve(mtu);
+    _pending.reserve(mtu);
+}
+
+// parameter sets, SEI, AUD - always followed by slices of the same access unit
+bool H26xRepacketizer::isNonVcl(const uint8_t* nal) const
+{
+    if(H26xCodec::H265 == _codec) {
+        const unsigned type = (nal[0] >> 1) & 0x3f;
+        return type >= H265_NAL_VPS && type <= H265_NAL_PREFIX_SEI;
+    } else {
+        const unsigned type = nal[0] & 0x1f;
+        return type >= H264_NAL_SEI && type <= H264_NAL_AUD;
+    }
+}
+
+// every lost packet keeps its own number, so it can be relayed if it comes late
+void H26xRepacketizer::reserveGap(uint16_t seq, uint16_t lost)
+{
+    for(uint16_t i = lost > REORDER_WINDOW ? lost - REORDER_WINDOW : 0; i < lost; ++i) {
+        const uint16_t lostSeq = seq - lost + i;
+        _gaps[lostSeq % REORDER_WINDOW] = Gap{lostSeq, uint16_t(_nextSeq + i), true};
+    }
+
+    _nextSeq += lost;
+}
+
+void H26xRepacketizer::pushLate(const Source& source, const Output& output)
+{
+    const uint16_t seq = (source.data[2] << 8) | source.data[3];
+
+    Gap& gap = _gaps[seq % REORDER_WINDOW];
+    if(!gap.reserved || gap.seq != seq)
+        return; // duplicated or too old packet
+
+    gap.reserved = false;
+
+    // only one number is reserved, so late packet can't be split
+    if(source.size > _mtu)
+        return;
+
+    passThrough(source, gap.outputSeq, output);
+}
+
+void H26xRepacketizer::passThrough(const Source& source, uint16_t outputSeq, const Output& output)
+{
+    const uint16_t seq = (source.data[2] << 8) | source.data[3];
+    if(seq == outputSeq) {
+        output(reinterpret_cast<const char*>(source.data), source.size);
+        return;
+    }
+
+    _packet.assign(source.data, source.data + source.size);
+    _packet[2] = outputSeq >> 8;
+    _packet[3] = outputSeq & 0xff;
+
+    output(reinterpret_cast<const char*>(_packet.data()), _packet.size());
+}
+
+void H26xRepacketizer::beginPacket(const uint8_t* rtpHeader, size_t headerSize)
+{
+    _packet.assign(rtpHeader, rtpHeader + headerSize);
+    _packet[0] &= ~0x20; // no padding
+}
+
+void H26xRepacketizer::outputPacket(bool marker, const Output& output)
+{
+    if(marker)
+        _packet[1] |= 0x80;
+    else
+        _packet[1] &= 0x7f;
+
+    _packet[2] = _nextSeq >> 8;
+    _packet[3] = _nextSeq & 0xff;
+    ++_nextSeq;
+
+    output(reinterpret_cast<const char*>(_packet.data()), _packet.size());
+}
+
+void H26xRepacketizer::push(const char* packet, size_t size, const Output& output)
+{
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(packet);
+    if(size < RTP_HEADER_SIZE || (data[0] >> 6) != 2)
+        return;
+
+    size_t headerSize = RTP_HEADER_SIZE + 4 * (data[0] & 0x0f);
+    if(data[0] & 0x10) {
+        if(size < headerSize + 4)
+            return;
+        headerSize += 4 + 4 * ((data[headerSize + 2] << 8) | data[headerSize + 3]);
+    }
+
+    size_t payloadEnd = size;
+    if(data[0] & 0x20) {
+        const uint8_t padding = data[size - 1];
+        if(padding > size)
+            return;
+        payloadEnd -= padding;
+    }
+
+    if(headerSize + _nalHeaderSize > payloadEnd)
+        return;
+
+    const Source source{data, size, headerSize};
+    const uint16_t seq = (data[2] << 8) | data[3];
+    const bool marker = (data[1] & 0x80) != 0;
+
+    if(!_initialized) {
+        _initialized = true;
+        _nextSeq = seq;
+    } else {
+        int16_t delta = seq - _lastSeq;
+        if(delta <= 0 && delta > -REORDER_WINDOW) {
+            pushLate(source, output);
+            return;
+        }
+
+        // source restarted numbering, output one just goes on
+        if(delta <= 0 || delta > MAX_DROPOUT)
+            delta = 1;
+
+        if(_pendingCount && (delta > 1 || 0 != memcmp(_pendingHeader.data() + 4, data + 4, 4)))
+            flush(output);
+
+        reserveGap(seq, delta - 1);
+    }
+    _lastSeq = seq;
+    _gaps[seq % REORDER_WINDOW].reserved = false;
+
+    // header extensions leave no room for fragments
+    if(headerSize + _fuHeaderSize >= _mtu) {
+        flush(output);
+        passThrough(source, _nextSeq++, output);
+        return;
+    }
+
+    const uint8_t* payload = data + headerSize;
+    const size_t payloadSize = payloadEnd - headerSize;
+
+    const bool h265 = H26xCodec::H265 == _codec;
+    const unsigned type = h265 ? (payload[0] >> 1) & 0x3f : payload[0] & 0x1f;
+    const unsigned aggregationType = h265 ? unsigned(H265_NAL_AP) : unsigned(H264_NAL_STAP_A);
+    const unsigned fragmentationType = h265 ? unsigned(H265_NAL_FU) : unsigned(H264_NAL_FU_A);
+
+    if(type < aggregationType) {
+        pushNal(source, payload, payloadSize, marker, true, output);
+    } else if(size <= _mtu || (type != aggregationType && type != fragmentationType)) {
+        // already fits, or packetization is not supported
+        flush(output);
+        passThrough(source, _nextSeq++, output);
+    } else if(type == aggregationType) {
+        size_t offset = _nalHeaderSize;
+        while(offset + 2 < payloadSize) {
+            const size_t nalSize = (payload[offset] << 8) | payload[offset + 1];
+            offset += 2;
+            if(!nalSize || offset + nalSize > payloadSize)
+                break;
+
+            pushNal(
+                source,
+                payload + offset, nalSize,
+                marker && offset + nalSize == payloadSize,
+                false,
+                output);
+            offset += nalSize;
+        }
+    } else {
+        flush(output);
+        pushFragment(source, payload, payloadSize, marker, output);
+    }
+}
+
+void H26xRepacketizer::pushNal(
+    const Source& source,
+    const uint8_t* nal, size_t size,
+    bool marker,
+    bool wholePayload,
+    const Output& output)
+{
+    if(_pendingCount) {
+        if(_pendingHeader.size() + _nalHeaderSize + _pending.size() + 2 + size <= _mtu) {
+            aggregate(source, nal, size, marker);
+            if(marker || !isNonVcl(nal))
+                flush(output);
+            return;
+        }
+
+        flush(output);
+    }
+
+    const size_t maxPayloadSize = _mtu - source.headerSize;
+
+    if(!marker && isNonVcl(nal) && _nalHeaderSize + 2 + size < maxPayloadSize) {
+        aggregate(source, nal, size, marker);
+        return;
+    }
+
+    if(wholePayload && source.size <= _mtu) {
+        passThrough(source, _nextSeq++, output);
+        return;
+    }
+
+    if(size <= maxPayloadSize) {
+        beginPacket(source.data, source.headerSize);
+        _packet.insert(_packet.end(), nal, nal + size);
+        outputPacket(marker, output);
+        return;
+    }
+
+    uint8_t fuHeader[3];
+    if(H26xCodec::H265 == _codec) {
+        fuHeader[0] = (nal[0] & 0x81) | (H265_NAL_FU << 1);
+        fuHeader[1] = nal[1];
+        fuHeader[2] = (nal[0] >> 1) & 0x3f;
+    } else {
+        fuHeader[0] = (nal[0] & 0xe0) | H264_NAL_FU_A;
+        fuHeader[1] = nal[0] & 0x1f;
+    }
+
+    fragment(
+        source,
+        fuHeader,
+        nal + _nalHeaderSize, size - _nalHeaderSize,
+        true, true, marker,
+        output);
+}
+
+void H26xRepacketizer::pushFragment(
+    const Source& source,
+    const uint8_t* payload, size_t size,
+    bool marker,
+    const Output& output)
+{
+    if(size < _fuHeaderSize)
+        return;
+
+    const uint8_t flags = payload[_fuHeaderSize - 1];
+    fragment(
+        source,
+        payload,
+        payload + _fuHeaderSize, size - _fuHeaderSize,
+        (flags & FU_START) != 0, (flags & FU_END) != 0, marker,
+        output);
+}
+
+void H26xRepacketizer::fragment(
+    const Source& source,
+    const uint8_t* fuHeader,
+    const uint8_t* data, size_t size,
+    bool start, bool end, bool marker,
+    const Output& output)
+{
+    const size_t maxFragmentSize = _mtu - source.headerSize - _fuHeaderSize;
+    const uint8_t typeMask = H26xCodec::H265 == _codec ? 0x3f : 0x1f;
+
+    while(size) {
+        const size_t fragmentSize = std::min(size, maxFragmentSize);
+        const bool last = fragmentSize == size;
+
+        uint8_t flags = fuHeader[_fuHeaderSize - 1] & typeMask;
+        if(start)
+            flags |= FU_START;
+        if(last && end)
+            flags |= FU_END;
+
+        beginPacket(source.data, source.headerSize);
+        _packet.insert(_packet.end(), fuHeader, fuHeader + _fuHeaderSize - 1);
+        _packet.push_back(flags);
+        _packet.insert(_packet.end(), data, data + fragmentSize);
+        outputPacket(last && marker, output);
+
+        start = false;
+        data += fragmentSize;
+        size -= fragmentSize;
+    }
+}
+
+void H26xRepacketizer::aggregate(
+    const Source& source,
+    const uint8_t* nal, size_t size,
+    bool marker)
+{
+    if(!_pendingCount)
+        _pendingHeader.assign(source.data, source.data + source.headerSize);
+
+    _pending.push_back(size >> 8);
+    _pending.push_back(size & 0xff);
+    _pending.insert(_pending.end(), nal, nal + size);
+
+    ++_pendingCount;
+    _pendingMarker = marker;
+}
+
+void H26xRepacketizer::flush(const Output& output)
+{
+    if(!_pendingCount)
+        return;
+
+    beginPacket(_pendingHeader.data(), _pendingHeader.size());
+
+    if(1 == _pendingCount) {
+        _packet.insert(_packet.end(), _pending.begin() + 2, _pending.end());
+    } else if(H26xCodec::H265 == _codec) {
+        const uint8_t* firstNal = _pending.data() + 2;
+        _packet.push_back((firstNal[0] & 0x01) | (H265_NAL_AP << 1));
+        _packet.push_back(firstNal[1]);
+        _packet.insert(_packet.end(), _pending.begin(), _pending.end());
+    } else {
+        // F bit is set if any NAL has it, NRI is the highest one
+        uint8_t forbidden = 0, nri = 0;
+        for(size_t offset = 0; offset + 2 < _pending.size(); ) {
+            const size_t nalSize = (_pending[offset] << 8) | _pending[offset + 1];
+            const uint8_t nalHeader = _pending[offset + 2];
+            forbidden |= nalHeader & 0x80;
+            nri = std::max<uint8_t>(nri, nalHeader & 0x60);
+            offset += 2 + nalSize;
+        }
+
+        _packet.push_back(forbidden | nri | H264_NAL_STAP_A);
+        _packet.insert(_packet.end(), _pending.begin(), _pending.end());
+    }
+
+    outputPacket(_pendingMarker, output);
+
+    _pending.clear();
+    _pendingCount = 0;
+    _pendingMarker = false;
+}
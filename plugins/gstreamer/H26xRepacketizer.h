@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "H26xRtp.h"
+
+
+// splits too big NAL units and fragments into FU-A (FU for H.265) packets,
+// aggregates parameter sets and other small non VCL NAL units with following ones
+// into STAP-A (AP for H.265) packets, and renumbers resulting packets.
+// Packets which already fit are relayed as is (only sequence number is shifted if required),
+// so header extensions, CSRCs and padding of source are kept.
+// Packets repacketized in a new way keep header extensions and CSRCs of their source packet.
+class H26xRepacketizer
+{
+public:
+    typedef std::function<void (const char* packet, size_t size)> Output;
+
+    // mtu - max size of resulting RTP packet
+    H26xRepacketizer(H26xCodec, size_t mtu);
+
+    void push(const char* packet, size_t size, const Output&);
+
+private:
+    enum {
+        RTP_HEADER_SIZE = 12,
+        // late packets are relayed with numbers reserved for them on gap
+        REORDER_WINDOW = 128,
+        // bigger jump of sequence numbers means source restart
+        MAX_DROPOUT = 3000,
+    };
+
+    struct Source
+    {
+        const uint8_t* data; // whole packet
+        size_t size;
+        size_t headerSize; // with CSRCs and header extension
+    };
+
+    struct Gap
+    {
+        uint16_t seq;
+        uint16_t outputSeq;
+        bool reserved;
+    };
+
+    bool isNonVcl(const uint8_t* nal) const;
+
+    void reserveGap(uint16_t seq, uint16_t lost);
+    void pushLate(const Source&, const Output&);
+
+    void passThrough(const Source&, uint16_t outputSeq, const Output&);
+    void beginPacket(const uint8_t* rtpHeader, size_t headerSize);
+    void outputPacket(bool marker, const Output&);
+
+    void pushNal(
+        const Source&,
+        const uint8_t* nal, size_t size,
+        bool marker,
+        bool wholePayload,
+        const Output&);
+    void pushFragment(
+        const Source&,
+        const uint8_t* payload, size_t size,
+        bool marker,
+        const Output&);
+    void fragment(
+        const Source&,
+        const uint8_t* fuHeader,
+        const uint8_t* data, size_t size,
+        bool start, bool end, bool marker,
+        const Output&);
+    void aggregate(const Source&, const uint8_t* nal, size_t size, bool marker);
+    void flush(const Output&);
+
+private:
+    const H26xCodec _codec;
+    const size_t _nalHeaderSize;
+    const size_t _fuHeaderSize;
+    const size_t _mtu;
+
+    bool _initialized = false;
+    uint16_t _lastSeq = 0;
+    uint16_t _nextSeq = 0;
+
+    Gap _gaps[REORDER_WINDOW] = {};
+
+    std::vector<uint8_t> _packet;
+
+    // NAL units waiting for aggregation, each one prefixed with 16 bit size
+    std::vector<uint8_t> _pending;
+    std::vector<uint8_t> _pendingHeader;
+    unsigned _pendingCount = 0;
+    bool _pendingMarker = false;
+};
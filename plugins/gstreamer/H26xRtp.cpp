@@ -0,0 +1,154 @@
+#include "H26xRtp.h"
+
+#include <strings.h>
+
+
+namespace {
+
+enum {
+    H264_NAL_SLICE = 1,
+    H264_NAL_IDR = 5,
+    H264_NAL_SPS = 7,
+    H264_NAL_PPS = 8,
+    H264_NAL_STAP_A = 24,
+    H264_NAL_FU_A = 28,
+};
+
+enum {
+    H265_NAL_MAX_SLICE = 21,
+    H265_NAL_MIN_IRAP = 16,
+    H265_NAL_MAX_SUBLAYER_NON_REF = 14,
+    H265_NAL_VPS = 32,
+    H265_NAL_SPS = 33,
+    H265_NAL_PPS = 34,
+    H265_NAL_AP = 48,
+    H265_NAL_FU = 49,
+};
+
+}
+
+H26xCodec H26xCodecFromEncodingName(const char* encodingName)
+{
+    if(!encodingName)
+        return H26xCodec::None;
+    else if(0 == strcasecmp(encodingName, "H264"))
+        return H26xCodec::H264;
+    else if(0 == strcasecmp(encodingName, "H265"))
+        return H26xCodec::H265;
+    else
+        return H26xCodec::None;
+}
+
+static void H264Nal(unsigned type, unsigned nri, H26xPacketInfo* info)
+{
+    switch(type) {
+        case H264_NAL_IDR:
+            info->keyFrame = true;
+            // fall through
+        case H264_NAL_SLICE:
+            info->sliceStart = true;
+            if(nri)
+                info->reference = true;
+            break;
+        case H264_NAL_SPS:
+        case H264_NAL_PPS:
+            info->parameterSets = true;
+            break;
+    }
+}
+
+static void H265Nal(unsigned type, H26xPacketInfo* info)
+{
+    if(type <= H265_NAL_MAX_SLICE) {
+        info->sliceStart = true;
+        if(type >= H265_NAL_MIN_IRAP)
+            info->keyFrame = true;
+        if(type > H265_NAL_MAX_SUBLAYER_NON_REF || (type & 1))
+            info->reference = true;
+    } else if(type >= H265_NAL_VPS && type <= H265_NAL_PPS)
+        info->parameterSets = true;
+}
+
+static bool ParseH264Payload(const uint8_t* payload, size_t size, H26xPacketInfo* info)
+{
+    if(size < 1)
+        return false;
+
+    const unsigned type = payload[0] & 0x1f;
+    const unsigned nri = (payload[0] >> 5) & 0x03;
+
+    if(type < H264_NAL_STAP_A) {
+        H264Nal(type, nri, info);
+    } else if(type == H264_NAL_STAP_A) {
+        size_t offset = 1;
+        while(offset + 2 < size) {
+            const size_t nalSize = (payload[offset] << 8) | payload[offset + 1];
+            offset += 2;
+            if(!nalSize || offset + nalSize > size)
+                return false;
+
+            H264Nal(payload[offset] & 0x1f, (payload[offset] >> 5) & 0x03, info);
+            offset += nalSize;
+        }
+    } else if(type == H264_NAL_FU_A) {
+        if(size < 2)
+            return false;
+
+        const bool start = (payload[1] & 0x80) != 0;
+        if(start)
+            H264Nal(payload[1] & 0x1f, nri, info);
+    }
+
+    return true;
+}
+
+static bool ParseH265Payload(const uint8_t* payload, size_t size, H26xPacketInfo* info)
+{
+    if(size < 2)
+        return false;
+
+    const unsigned type = (payload[0] >> 1) & 0x3f;
+
+    if(type < H265_NAL_AP) {
+        H265Nal(type, info);
+    } else if(type == H265_NAL_AP) {
+        size_t offset = 2;
+        while(offset + 2 < size) {
+            const size_t nalSize = (payload[offset] << 8) | payload[offset + 1];
+            offset += 2;
+            if(!nalSize || offset + nalSize > size)
+                return false;
+
+            H265Nal((payload[offset] >> 1) & 0x3f, info);
+            offset += nalSize;
+        }
+    } else if(type == H265_NAL_FU) {
+        if(size < 3)
+            return false;
+
+        const bool start = (payload[2] & 0x80) != 0;
+        if(start)
+            H265Nal(payload[2] & 0x3f, info);
+    }
+
+    return true;
+}
+
+bool ParseH26xPayload(
+    H26xCodec codec,
+    const uint8_t* payload, size_t size,
+    H26xPacketInfo* info)
+{
+    *info = H26xPacketInfo();
+
+    switch(codec) {
+        case H26xCodec::H264:
+            return ParseH264Payload(payload, size, info);
+        case H26xCodec::H265:
+            return ParseH265Payload(payload, size, info);
+        case H26xCodec::None:
+            break;
+    }
+
+    return false;
+}
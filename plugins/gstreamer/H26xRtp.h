@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+enum class H26xCodec {
+    None,
+    H264,
+    H265,
+};
+
+H26xCodec H26xCodecFromEncodingName(const char* encodingName);
+
+struct H26xPacketInfo
+{
+    bool sliceStart = false;    // packet starts at least one coded slice
+    bool keyFrame = false;      // IDR (IRAP for H.265) slice
+    bool reference = false;     // slice can be referenced by other pictures
+    bool parameterSets = false; // SPS/PPS (and VPS for H.265)
+};
+
+// payload is RTP payload (RFC 6184 for H.264, RFC 7798 for H.265)
+bool ParseH26xPayload(
+    H26xCodec,
+    const uint8_t* payload, size_t size,
+    H26xPacketInfo*);
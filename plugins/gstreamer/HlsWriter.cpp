@@ -0,0 +1,431 @@
+#include "HlsWriter.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cmath>
+
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+
+extern "C" {
+#include "janus/debug.h"
+}
+
+#include "CxxPtr/GlibPtr.h"
+
+
+namespace {
+
+enum {
+    QUEUE_SIZE = 2, // s, packets are dropped if muxing doesn't keep up
+    JITTER_BUFFER_LATENCY = 100, // ms
+    PARTS_SEGMENTS = 3, // last segments listed with parts
+};
+
+const char* PlaylistName = "index.m3u8";
+
+}
+
+static const char* DepayloaderDescription(const GstCaps* caps)
+{
+    const gchar* encodingName =
+        gst_structure_get_string(gst_caps_get_structure(caps, 0), "encoding-name");
+    if(!encodingName)
+        return nullptr;
+
+    if(0 == g_ascii_strcasecmp(encodingName, "H264"))
+        return "rtph264depay ! h264parse";
+    if(0 == g_ascii_strcasecmp(encodingName, "H265"))
+        return "rtph265depay ! h265parse";
+    if(0 == g_ascii_strcasecmp(encodingName, "OPUS"))
+        return "rtpopusdepay ! opusparse";
+    if(0 == g_ascii_strcasecmp(encodingName, "MPEG4-GENERIC"))
+        return "rtpmp4gdepay ! aacparse";
+    if(0 == g_ascii_strcasecmp(encodingName, "MP4A-LATM"))
+        return "rtpmp4adepay ! aacparse";
+
+    return nullptr;
+}
+
+static std::string InitName(unsigned generation)
+{
+    return "init" + std::to_string(generation) + ".mp4";
+}
+
+static std::string SegmentName(unsigned sequence)
+{
+    return "seg" + std::to_string(sequence) + ".m4s";
+}
+
+static std::string PartName(unsigned sequence, unsigned part)
+{
+    return "seg" + std::to_string(sequence) + "." + std::to_string(part) + ".m4s";
+}
+
+
+HlsWriter::HlsWriter(const MediaConfig::Hls& config) :
+    _config(config),
+    _generation(0), _discontinuitySequence(0),
+    _segment{0, 0, 0.0, {}}, _maxPartDuration(0.0)
+{
+    if(0 != g_mkdir_with_parents(config.path.c_str(), 0755)) {
+        JANUS_LOG(LOG_ERR,
+            "Failed to create HLS directory \"%s\": %s\n",
+            config.path.c_str(), g_strerror(errno));
+    }
+}
+
+HlsWriter::~HlsWriter()
+{
+    stopPipeline();
+}
+
+void HlsWriter::mediaPrepared(const std::vector<Stream>& streams)
+{
+    stopPipeline();
+    startPipeline(streams);
+}
+
+void HlsWriter::startPipeline(const std::vector<Stream>& streams)
+{
+    const Stream* video = nullptr;
+    const Stream* audio = nullptr;
+    for(const Stream& stream: streams) {
+        const Stream*& selected = stream.video ? video : audio;
+        if(selected || !stream.caps || gst_caps_is_empty(stream.caps))
+            continue;
+
+        if(!DepayloaderDescription(stream.caps)) {
+            GCharPtr capsStrPtr(gst_caps_to_string(stream.caps));
+            JANUS_LOG(LOG_WARN, "Stream can't be muxed into HLS: %s\n", capsStrPtr.get());
+            continue;
+        }
+
+        selected = &stream;
+    }
+
+    if(!video && !audio)
+        return;
+
+    // fragments are started from key frames, so segment duration is a minimum
+    GCharPtr descriptionPtr(
+        g_strdup_printf(
+            "isofmp4mux name=mux fragment-duration=%" G_GUINT64_FORMAT " chunk-duration=%" G_GUINT64_FORMAT " ! "
+            "appsink name=sink sync=false async=false",
+            static_cast<guint64>(_config.segmentDuration) * GST_SECOND,
+            static_cast<guint64>(_config.partDuration) * GST_MSECOND));
+    std::string description = descriptionPtr.get();
+    for(const Stream* stream: { video, audio }) {
+        if(!stream)
+            continue;
+
+        GCharPtr branchPtr(
+            g_strdup_printf(
+                " appsrc name=%s is-live=true format=time do-timestamp=true ! "
+                "queue leaky=downstream max-size-buffers=0 max-size-bytes=0 max-size-time=%" G_GUINT64_FORMAT " ! "
+                "rtpjitterbuffer latency=%u ! %s ! mux.",
+                stream == video ? "video" : "audio",
+                static_cast<guint64>(QUEUE_SIZE) * GST_SECOND,
+                JITTER_BUFFER_LATENCY,
+                DepayloaderDescription(stream->caps)));
+        description += branchPtr.get();
+    }
+
+    GError* parseError = nullptr;
+    _pipelinePtr.reset(gst_parse_launch(description.c_str(), &parseError));
+    GErrorPtr parseErrorPtr(parseError);
+    if(parseError) {
+        JANUS_LOG(LOG_ERR,
+            "HlsWriter::startPipeline. gst_parse_launch failed: %s\n",
+            parseError->message);
+        _pipelinePtr.reset();
+        return;
+    }
+
+    GstBin* pipeline = GST_BIN(_pipelinePtr.get());
+
+    GstElementPtr sinkPtr(gst_bin_get_by_name(pipeline, "sink"));
+    auto onAppSinkSampleCallback =
+        [] (GstAppSink* appsink, gpointer userData) -> GstFlowReturn
+    {
+        HlsWriter* self = static_cast<HlsWriter*>(userData);
+        GstSamplePtr samplePtr(gst_app_sink_pull_sample(appsink));
+        self->onChunk(samplePtr.get());
+        return GST_FLOW_OK;
+    };
+    GstAppSinkCallbacks callbacks = {nullptr, nullptr, onAppSinkSampleCallback};
+    gst_app_sink_set_buffer_list_support(GST_APP_SINK(sinkPtr.get()), TRUE);
+    gst_app_sink_set_callbacks(GST_APP_SINK(sinkPtr.get()), &callbacks, this, nullptr);
+
+    auto onBusMessageCallback =
+        (gboolean (*) (GstBus*, GstMessage*, gpointer))
+        [] (GstBus* /*bus*/, GstMessage* message, gpointer /*userData*/) -> gboolean
+    {
+        if(GST_MESSAGE_ERROR == GST_MESSAGE_TYPE(message)) {
+            gchar* debug;
+            GError* error;
+
+            gst_message_parse_error(message, &error, &debug);
+
+            JANUS_LOG(LOG_ERR, "HlsWriter. %s\n", error->message);
+
+            g_free(debug);
+            g_error_free(error);
+        }
+
+        return TRUE;
+    };
+    _busPtr.reset(gst_pipeline_get_bus(GST_PIPELINE(pipeline)));
+    gst_bus_add_watch(_busPtr.get(), onBusMessageCallback, nullptr);
+
+    // new pipeline produces new init section
+    ++_generation;
+
+    {
+        std::lock_guard<std::mutex> lock(_guard);
+        for(const Stream* stream: { video, audio }) {
+            if(!stream)
+                continue;
+
+            Source& source = stream == video ? _video : _audio;
+            source.stream = stream->index;
+            source.appSrc = gst_bin_get_by_name(pipeline, stream == video ? "video" : "audio");
+            g_object_set(source.appSrc, "caps", stream->caps, nullptr);
+        }
+    }
+
+    gst_element_set_state(_pipelinePtr.get(), GST_STATE_PLAYING);
+}
+
+void HlsWriter::stopPipeline()
+{
+    {
+        std::lock_guard<std::mutex> lock(_guard);
+        for(Source* source: { &_video, &_audio }) {
+            if(source->appSrc)
+                gst_object_unref(source->appSrc);
+            *source = Source();
+        }
+    }
+
+    if(!_pipelinePtr)
+        return;
+
+    // waits streaming threads, so chunks are not processed anymore
+    gst_element_set_state(_pipelinePtr.get(), GST_STATE_NULL);
+    gst_bus_remove_watch(_busPtr.get());
+    _busPtr.reset();
+    _pipelinePtr.reset();
+
+    // already published parts stay playable
+    if(!_segment.parts.empty())
+        finishSegment();
+}
+
+void HlsWriter::onPacket(unsigned stream, bool /*keyFrame*/, const char* data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(_guard);
+
+    const Source* source =
+        static_cast<int>(stream) == _video.stream ? &_video :
+        static_cast<int>(stream) == _audio.stream ? &_audio :
+        nullptr;
+    if(!source || !source->appSrc)
+        return;
+
+    GstBuffer* buffer = gst_buffer_new_allocate(nullptr, size, nullptr);
+    gst_buffer_fill(buffer, 0, data, size);
+    gst_app_src_push_buffer(GST_APP_SRC(source->appSrc), buffer);
+}
+
+// every sample is either init section or one chunk (moof + mdat) of fragment,
+// chunk is published as part, and fragment as segment
+void HlsWriter::onChunk(GstSample* sample)
+{
+    GstBufferList* list = gst_sample_get_buffer_list(sample);
+    GstBuffer* singleBuffer = gst_sample_get_buffer(sample);
+    const guint buffersCount = list ? gst_buffer_list_length(list) : (singleBuffer ? 1 : 0);
+
+    std::vector<char> header;
+    std::vector<char> chunk;
+    bool independent = false;
+    GstClockTime start = GST_CLOCK_TIME_NONE;
+    GstClockTime end = GST_CLOCK_TIME_NONE;
+    for(guint i = 0; i < buffersCount; ++i) {
+        GstBuffer* buffer = list ? gst_buffer_list_get(list, i) : singleBuffer;
+
+        // moof of every chunk is marked as HEADER too, only init section is also DISCONT
+        const bool init =
+            GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_HEADER) &&
+            GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+        std::vector<char>& data = init ? header : chunk;
+        if(&data == &chunk && chunk.empty())
+            independent = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+        const size_t offset = data.size();
+        data.resize(offset + gst_buffer_get_size(buffer));
+        gst_buffer_extract(buffer, 0, data.data() + offset, data.size() - offset);
+
+        if(&data == &chunk && GST_BUFFER_PTS_IS_VALID(buffer)) {
+            const GstClockTime pts = GST_BUFFER_PTS(buffer);
+            if(!GST_CLOCK_TIME_IS_VALID(start) || pts < start)
+                start = pts;
+            if(GST_BUFFER_DURATION_IS_VALID(buffer) &&
+               (!GST_CLOCK_TIME_IS_VALID(end) || pts + GST_BUFFER_DURATION(buffer) > end))
+            {
+                end = pts + GST_BUFFER_DURATION(buffer);
+            }
+        }
+    }
+
+    if(!header.empty())
+        writeFile(InitName(_generation), header);
+
+    if(chunk.empty())
+        return;
+
+    // new fragment starts from key frame
+    if(independent && !_segment.parts.empty())
+        finishSegment();
+    if(_segment.parts.empty()) {
+        if(!independent)
+            return;
+
+        _segment.generation = _generation;
+    }
+
+    const double duration =
+        GST_CLOCK_TIME_IS_VALID(start) && GST_CLOCK_TIME_IS_VALID(end) ?
+            static_cast<double>(end - start) / GST_SECOND :
+            _config.partDuration / 1000.0;
+
+    const std::string partName = PartName(_segment.sequence, _segment.parts.size());
+    if(!writeFile(partName, chunk))
+        return;
+
+    _segment.parts.push_back(Part{partName, duration, independent});
+    _segment.duration += duration;
+    _segmentData.insert(_segmentData.end(), chunk.begin(), chunk.end());
+    _maxPartDuration = std::max(_maxPartDuration, duration);
+
+    writePlaylist();
+}
+
+void HlsWriter::finishSegment()
+{
+    if(writeFile(SegmentName(_segment.sequence), _segmentData))
+        _segments.push_back(_segment);
+    else
+        removeSegment(_segment);
+
+    while(_segments.size() > _config.segments) {
+        const Segment removed = _segments.front();
+        _segments.pop_front();
+        removeSegment(removed);
+
+        const unsigned nextGeneration =
+            _segments.empty() ? _generation : _segments.front().generation;
+        if(nextGeneration != removed.generation) {
+            ++_discontinuitySequence;
+
+            GCharPtr initPathPtr(
+                g_build_filename(_config.path.c_str(), InitName(removed.generation).c_str(), nullptr));
+            unlink(initPathPtr.get());
+        }
+    }
+
+    _segment.sequence += 1;
+    _segment.duration = 0.0;
+    _segment.parts.clear();
+    _segmentData.clear();
+}
+
+void HlsWriter::removeSegment(const Segment& segment)
+{
+    for(const Part& part: segment.parts) {
+        GCharPtr pathPtr(g_build_filename(_config.path.c_str(), part.uri.c_str(), nullptr));
+        unlink(pathPtr.get());
+    }
+
+    GCharPtr pathPtr(g_build_filename(_config.path.c_str(), SegmentName(segment.sequence).c_str(), nullptr));
+    unlink(pathPtr.get());
+}
+
+void HlsWriter::writePlaylist()
+{
+    double targetDuration = _config.segmentDuration;
+    for(const Segment& segment: _segments)
+        targetDuration = std::max(targetDuration, segment.duration);
+    const double partTarget = std::max(_config.partDuration / 1000.0, _maxPartDuration);
+
+    std::string playlist;
+    GCharPtr headerPtr(
+        g_strdup_printf(
+            "#EXTM3U\n"
+            "#EXT-X-VERSION:9\n"
+            "#EXT-X-TARGETDURATION:%u\n"
+            "#EXT-X-PART-INF:PART-TARGET=%.3f\n"
+            "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=%.3f\n"
+            "#EXT-X-MEDIA-SEQUENCE:%u\n"
+            "#EXT-X-DISCONTINUITY-SEQUENCE:%u\n",
+            static_cast<unsigned>(std::ceil(targetDuration)),
+            partTarget,
+            partTarget * 3,
+            _segments.empty() ? _segment.sequence : _segments.front().sequence,
+            _discontinuitySequence));
+    playlist += headerPtr.get();
+
+    const size_t partsFrom = _segments.size() > PARTS_SEGMENTS - 1 ? _segments.size() - (PARTS_SEGMENTS - 1) : 0;
+    for(size_t i = 0; i <= _segments.size(); ++i) {
+        const bool completed = i < _segments.size();
+        const Segment& segment = completed ? _segments[i] : _segment;
+        if(!completed && segment.parts.empty())
+            break;
+
+        const unsigned previousGeneration = i > 0 ? _segments[i - 1].generation : segment.generation;
+        if(i == 0 || segment.generation != previousGeneration) {
+            if(i > 0)
+                playlist += "#EXT-X-DISCONTINUITY\n";
+            playlist += "#EXT-X-MAP:URI=\"" + InitName(segment.generation) + "\"\n";
+        }
+
+        if(i >= partsFrom) {
+            for(const Part& part: segment.parts) {
+                GCharPtr partPtr(
+                    g_strdup_printf(
+                        "#EXT-X-PART:DURATION=%.5f,URI=\"%s\"%s\n",
+                        part.duration, part.uri.c_str(),
+                        part.independent ? ",INDEPENDENT=YES" : ""));
+                playlist += partPtr.get();
+            }
+        }
+
+        if(completed) {
+            GCharPtr segmentPtr(
+                g_strdup_printf(
+                    "#EXTINF:%.5f,\n%s\n",
+                    segment.duration, SegmentName(segment.sequence).c_str()));
+            playlist += segmentPtr.get();
+        }
+    }
+
+    writeFile(PlaylistName, std::vector<char>(playlist.begin(), playlist.end()));
+}
+
+// readers see either previous or new file, never partially written one
+bool HlsWriter::writeFile(const std::string& name, const std::vector<char>& data)
+{
+    GCharPtr pathPtr(g_build_filename(_config.path.c_str(), name.c_str(), nullptr));
+
+    GError* error = nullptr;
+    g_file_set_contents(pathPtr.get(), data.data(), data.size(), &error);
+    GErrorPtr errorPtr(error);
+    if(error) {
+        JANUS_LOG(LOG_ERR, "Failed to write \"%s\": %s\n", pathPtr.get(), error->message);
+        return false;
+    }
+
+    return true;
+}
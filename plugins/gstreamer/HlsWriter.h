@@ -0,0 +1,78 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <gst/gst.h>
+
+#include "CxxPtr/GstPtr.h"
+
+#include "MediaConfig.h"
+#include "MountPointTap.h"
+
+
+// muxes relayed H.264/H.265 video and AAC/Opus audio, without transcoding, into fragmented MP4
+// partial segments (LL-HLS) with rolling playlist in local directory. Every file is replaced atomically.
+// onPacket only queues packet into own pipeline, and queue is leaky,
+// so muxing and writing never delay relaying to WebRTC viewers.
+class HlsWriter : public MountPointTap
+{
+public:
+    HlsWriter(const MediaConfig::Hls&);
+    ~HlsWriter();
+
+    void mediaPrepared(const std::vector<Stream>&) override;
+    void onPacket(unsigned stream, bool keyFrame, const char* data, size_t size) override;
+
+private:
+    struct Source
+    {
+        int stream = -1;
+        GstElement* appSrc = nullptr;
+    };
+
+    struct Part
+    {
+        std::string uri;
+        double duration; // s
+        bool independent;
+    };
+
+    struct Segment
+    {
+        unsigned sequence;
+        unsigned generation; // of pipeline, with own init section
+        double duration; // s
+        std::vector<Part> parts;
+    };
+
+    void startPipeline(const std::vector<Stream>&);
+    void stopPipeline();
+
+    // called from pipeline streaming thread
+    void onChunk(GstSample*);
+    void finishSegment();
+    void removeSegment(const Segment&);
+    void writePlaylist();
+    bool writeFile(const std::string& name, const std::vector<char>& data);
+
+private:
+    const MediaConfig::Hls _config;
+
+    GstElementPtr _pipelinePtr;
+    GstBusPtr _busPtr;
+
+    std::mutex _guard;
+    Source _video;
+    Source _audio;
+
+    // accessed only from pipeline streaming thread while pipeline is running
+    unsigned _generation;
+    unsigned _discontinuitySequence;
+    std::deque<Segment> _segments; // completed
+    Segment _segment; // in progress
+    std::vector<char> _segmentData;
+    double _maxPartDuration;
+};
@@ -14,6 +14,8 @@ extern "C" {
 #include "CxxPtr/GlibPtr.h"
 #include "CxxPtr/GstPtr.h"
 
+#include "Probes.h"
+
 #define ALL_PADS_PREROLLED_MESSAGE "PADS_PREROLLED"
 
 
@@ -30,6 +32,8 @@ struct LaunchMedia::Private
 
     struct Stream {
         GstElementPtr payloaderPtr;
+        GstPadPtr sinkPadPtr;
+        unsigned index;
     };
     std::vector<Stream> streams;
 
@@ -41,6 +45,7 @@ struct LaunchMedia::Private
     void setState(GstState);
 
     void prepare();
+    void waitPreroll();
     void pause();
     void play();
     void null();
@@ -67,7 +72,11 @@ void LaunchMedia::Private::setState(GstState state)
         return;
     }
 
-    switch(gst_element_set_state(pipeline, state)) {
+    PROBE2(state_change_begin, pipeline, state);
+    const GstStateChangeReturn result = gst_element_set_state(pipeline, state);
+    PROBE3(state_change_end, pipeline, state, result);
+
+    switch(result) {
         case GST_STATE_CHANGE_FAILURE:
             JANUS_LOG(LOG_ERR, "LaunchMedia::Private::setState. gst_element_set_state failed\n");
             break;
@@ -90,6 +99,7 @@ void LaunchMedia::Private::prepare()
         JANUS_LOG(LOG_ERR,
             "LaunchMedia::Private::prepare. gst_parse_launch failed: %s\n",
             parseError->message);
+        pipelinePtr.reset();
         return;
     }
 
@@ -106,28 +116,10 @@ void LaunchMedia::Private::prepare()
     GSourcePtr busSourcePtr(gst_bus_create_watch(bus));
     busWatchId =
         gst_bus_add_watch(bus, onBusMessageCallback, this);
-
-    auto padPrerolled =
-        (GstPadProbeReturn (*) (GstPad*, GstPadProbeInfo*, gpointer))
-        [] (GstPad* pad, GstPadProbeInfo* /*info*/, gpointer userData) -> GstPadProbeReturn {
-            Private* self = static_cast<Private*>(userData);
-
-            GstCapsPtr capsPtr(gst_pad_get_current_caps(pad));
-            GstCaps* caps = capsPtr.get();
-            if(!caps) // FIXME! why?
-                return GST_PAD_PROBE_OK;
-
-            std::lock_guard<std::mutex> lock(self->waitingCapsPadsGuard);
-            const bool removed = self->waitingCapsPads.erase(pad) != 0;
-
-            if(removed && self->waitingCapsPads.empty())
-                self->postMessage(ALL_PADS_PREROLLED_MESSAGE);
-
-            return GST_PAD_PROBE_REMOVE;
-        };
+    owner->placeThreads(bus);
 
     auto addStreamSink =
-        [this, pipeline, padPrerolled] (GstElementPtr& payloaderPtr, StreamType streamType) {
+        [this, pipeline] (GstElementPtr& payloaderPtr, StreamType streamType) {
             if(!payloaderPtr)
                 return;
 
@@ -135,6 +127,7 @@ void LaunchMedia::Private::prepare()
             GstPadPtr payloaderPadPtr(gst_element_get_static_pad(payloader, "src"));
             GstPad* payloaderPad = payloaderPadPtr.get();
 
+            const unsigned index = owner->streamsCount();
             GstElement* streamSink = owner->addStream(streamType);
             if(streamSink) {
                 gst_bin_add(GST_BIN(pipeline), streamSink);
@@ -145,11 +138,7 @@ void LaunchMedia::Private::prepare()
                 if(sinkPad) {
                     gst_pad_link(payloaderPad, sinkPad);
                     gst_object_ref(payloader);
-                    streams.push_back(Stream{GstElementPtr(payloader)});
-
-                    waitingCapsPads.insert(sinkPad);
-                    gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_DATA_DOWNSTREAM,
-                        padPrerolled, this, NULL);
+                    streams.push_back(Stream{GstElementPtr(payloader), std::move(sinkPadPtr), index});
                 }
             }
         };
@@ -163,7 +152,38 @@ void LaunchMedia::Private::prepare()
         addStreamSink(videoPayloaderPtr, StreamType::Video);
 
     if(audioPayloaderPtr)
-        addStreamSink(videoPayloaderPtr, StreamType::Audio);
+        addStreamSink(audioPayloaderPtr, StreamType::Audio);
+}
+
+void LaunchMedia::Private::waitPreroll()
+{
+    auto padPrerolled =
+        (GstPadProbeReturn (*) (GstPad*, GstPadProbeInfo*, gpointer))
+        [] (GstPad* pad, GstPadProbeInfo* /*info*/, gpointer userData) -> GstPadProbeReturn {
+            Private* self = static_cast<Private*>(userData);
+
+            GstCapsPtr capsPtr(gst_pad_get_current_caps(pad));
+            GstCaps* caps = capsPtr.get();
+            if(!caps) // FIXME! why?
+                return GST_PAD_PROBE_OK;
+
+            std::lock_guard<std::mutex> lock(self->waitingCapsPadsGuard);
+            const bool removed = self->waitingCapsPads.erase(pad) != 0;
+
+            if(removed && self->waitingCapsPads.empty())
+                self->postMessage(ALL_PADS_PREROLLED_MESSAGE);
+
+            return GST_PAD_PROBE_REMOVE;
+        };
+
+    std::lock_guard<std::mutex> lock(waitingCapsPadsGuard);
+    waitingCapsPads.clear();
+    for(Stream& stream: streams) {
+        GstPad* sinkPad = stream.sinkPadPtr.get();
+        waitingCapsPads.insert(sinkPad);
+        gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_DATA_DOWNSTREAM,
+            padPrerolled, this, NULL);
+    }
 }
 
 void LaunchMedia::Private::pause()
@@ -197,6 +217,10 @@ void LaunchMedia::Private::prerolled()
         GCharPtr capsStrPtr(gst_caps_to_string(caps));
         JANUS_LOG(LOG_VERB, "Stream caps: %s\n", capsStrPtr.get());
 
+        // transcoded streams already have their own caps
+        if(!owner->streamCaps(stream.index))
+            owner->setStreamCaps(stream.index, caps);
+
         GstSDPMedia* outMedia;
         gst_sdp_media_new(&outMedia);
         GstSDPMediaPtr outMediaPtr(outMedia);
@@ -239,6 +263,9 @@ gboolean LaunchMedia::Private::onBusMessage(GstBus* bus, GstMessage* msg)
 
             break;
         }
+        case GST_MESSAGE_STREAM_STATUS:
+            owner->streamStatus(msg);
+            break;
         default:
             break;
     }
@@ -247,7 +274,8 @@ gboolean LaunchMedia::Private::onBusMessage(GstBus* bus, GstMessage* msg)
 }
 
 
-LaunchMedia::LaunchMedia(const std::string& pipeline) :
+LaunchMedia::LaunchMedia(const std::string& pipeline, const MediaConfig& config) :
+    Media(config),
     _p(new Private{.owner = this, .pipelineDesc = pipeline})
 {
 }
@@ -263,9 +291,17 @@ const GstSDPMessage* LaunchMedia::sdp() const
     return _p->sdpPtr.get();
 }
 
+GstElement* LaunchMedia::pipeline() const
+{
+    return _p->pipelinePtr.get();
+}
+
 void LaunchMedia::doRun()
 {
-    _p->prepare();
+    // recycled pipeline is already built
+    if(!_p->pipelinePtr)
+        _p->prepare();
+    _p->waitPreroll();
     _p->pause();
     _p->play();
 }
@@ -274,3 +310,10 @@ void LaunchMedia::shutdown()
 {
     _p->null();
 }
+
+bool LaunchMedia::recycle()
+{
+    _p->sdpPtr.reset();
+
+    return _p->pipelinePtr != nullptr;
+}
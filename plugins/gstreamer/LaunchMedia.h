@@ -10,16 +10,19 @@ class LaunchMedia : public Media
     LaunchMedia& operator = (const LaunchMedia&) = delete;
 
 public:
-    LaunchMedia(const std::string& pipeline);
+    LaunchMedia(const std::string& pipeline, const MediaConfig&);
     ~LaunchMedia();
 
     const GstSDPMessage* sdp() const override;
 
     void shutdown() override;
+    bool recycle() override;
 
 protected:
     void doRun() override;
 
+    GstElement* pipeline() const;
+
 private:
     struct Private;
     std::unique_ptr<Private> _p;
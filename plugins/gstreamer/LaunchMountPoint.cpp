@@ -7,13 +7,14 @@ LaunchMountPoint::LaunchMountPoint(
     janus_callbacks* janus, janus_plugin* plugin,
     const std::string& pipeline,
     Flags flags,
+    const MediaConfig& mediaConfig,
     const std::string& description) :
-    MountPoint(janus, plugin, flags, description),
+    MountPoint(janus, plugin, flags, mediaConfig, description),
     _pipeline(pipeline)
 {
 }
 
 std::unique_ptr<Media> LaunchMountPoint::createMedia()
 {
-    return std::unique_ptr<Media>(new LaunchMedia(_pipeline));
+    return std::unique_ptr<Media>(new LaunchMedia(_pipeline, mediaConfig()));
 }
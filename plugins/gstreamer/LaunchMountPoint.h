@@ -10,6 +10,7 @@ public:
         janus_callbacks*, janus_plugin*,
         const std::string& pipeline,
         Flags,
+        const MediaConfig&,
         const std::string& description);
 
 protected:
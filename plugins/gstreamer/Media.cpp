@@ -3,26 +3,69 @@
 #include <deque>
 #include <algorithm>
 
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
 #include <gst/gst.h>
 #include <gst/app/gstappsink.h>
 
+extern "C" {
+#include "janus/debug.h"
+}
+
+#include "CxxPtr/GlibPtr.h"
 #include "CxxPtr/GstPtr.h"
 
+#include "WebRtcFormat.h"
+#include "Probes.h"
+
+
+enum {
+    LADDER_H264_PAYLOAD_TYPE = 120,
+    LADDER_VP8_PAYLOAD_TYPE = 121,
+    LADDER_KEY_INT_MAX = 60,
+    TRANSCODE_VIDEO_BITRATE = 2000, // kbit/s
+    TRANSCODE_OPUS_PAYLOAD_TYPE = 111,
+    TRANSCODE_OPUS_PACKET_LOSS = 10, // %, expected by encoder if FEC is enabled
+    FIRST_DYNAMIC_PAYLOAD_TYPE = 96,
+    DEFAULT_PAYLOADER_MTU = 1400,
+    MAX_TRANSCODING_LOOKUP_DEPTH = 32, // elements
+};
+
 
 struct Media::Private
 {
+    MediaConfig config;
+
     PreparedCallback preparedCallback;
     OnBufferCallback onBufferCallback;
     EosCallback eosCallback;
+    ThreadsCallback threadsCallback;
+
+    unsigned threads = 0;
 
     struct Stream {
         Media::Stream stream;
         GstAppSink* sink;
+        GstCapsPtr capsPtr;
     };
     std::deque<Stream> streams;
 
     inline int sinkIndex(GstAppSink* sink);
 
+    void setStreamCaps(unsigned stream, const GstCaps*);
+
+    GstElement* addAppSink(StreamType, unsigned layer);
+    GstElement* addVideoBranches(const GstCaps* sourceCaps, bool transcode);
+    GstElement* addAudioTranscoder(const GstCaps* sourceCaps);
+
+    void placeThread(GstElement* owner);
+
     GstFlowReturn onAppSinkPreroll(GstAppSink*);
     GstFlowReturn onAppSinkSample(GstAppSink*);
     void onAppSinkEos(GstAppSink*);
@@ -44,6 +87,19 @@ int Media::Private::sinkIndex(GstAppSink* sink)
         return it - streams.begin();
 }
 
+void Media::Private::setStreamCaps(unsigned stream, const GstCaps* caps)
+{
+    if(stream >= streams.size() || !caps || gst_caps_is_empty(caps))
+        return;
+
+    const GstStructure* structure = gst_caps_get_structure(caps, 0);
+
+    if(const gchar* encodingName = gst_structure_get_string(structure, "encoding-name"))
+        streams[stream].stream.encodingName = encodingName;
+
+    streams[stream].capsPtr.reset(gst_caps_copy(caps));
+}
+
 GstFlowReturn Media::Private::onAppSinkPreroll(GstAppSink* appsink)
 {
     GstSamplePtr(gst_app_sink_pull_preroll(appsink));
@@ -56,6 +112,8 @@ GstFlowReturn Media::Private::onAppSinkSample(GstAppSink* appsink)
     if(!onBufferCallback)
         return GST_FLOW_OK;
 
+    PROBE1(sample_begin, appsink);
+
     GstSamplePtr samplePtr(gst_app_sink_pull_sample(appsink));
     GstSample* sample = samplePtr.get();
     GstBuffer* buffer = gst_sample_get_buffer(sample);
@@ -68,6 +126,8 @@ GstFlowReturn Media::Private::onAppSinkSample(GstAppSink* appsink)
 
     onBufferCallback(sinkIndex(appsink), mapInfo.data, mapInfo.size);
 
+    PROBE2(sample_end, appsink, mapInfo.size);
+
     gst_buffer_unmap(buffer, &mapInfo);
 
     return GST_FLOW_OK;
@@ -77,10 +137,372 @@ void Media::Private::onAppSinkEos(GstAppSink* /*appsink*/)
 {
 }
 
+GstElement* Media::Private::addAppSink(StreamType streamType, unsigned layer)
+{
+    GstElementPtr appSinkPtr(gst_element_factory_make("appsink", nullptr));
+    GstAppSink* appSink = GST_APP_SINK(appSinkPtr.get());
+
+    gst_app_sink_set_drop(appSink, TRUE);
+
+    auto onAppSinkEosCallback =
+        [] (GstAppSink* appsink, gpointer userData)
+    {
+        Private* self = static_cast<Private*>(userData);
+    };
+    auto onAppSinkPrerollCallback =
+        [] (GstAppSink* appsink, gpointer userData) -> GstFlowReturn
+    {
+        Private* self = static_cast<Private*>(userData);
+        return self->onAppSinkPreroll(appsink);
+    };
+    auto onAppSinkSampleCallback =
+        [] (GstAppSink* appsink, gpointer userData) -> GstFlowReturn
+    {
+        Private* self = static_cast<Private*>(userData);
+        return self->onAppSinkSample(appsink);
+    };
+
+    GstAppSinkCallbacks callbacks =
+        {onAppSinkEosCallback, onAppSinkPrerollCallback, onAppSinkSampleCallback};
+    gst_app_sink_set_callbacks(
+        appSink,
+        &callbacks,
+        this,
+        nullptr);
+
+    streams.emplace_back(Stream{{streamType, std::string(), layer}, appSink});
+
+    return appSinkPtr.release();
+}
+
+static gchar* VideoEncoderDescription(
+    bool vp8,
+    unsigned bitrate,
+    gint payloadType,
+    unsigned mtu)
+{
+    if(!mtu)
+        mtu = DEFAULT_PAYLOADER_MTU;
+
+    return
+        vp8 ?
+            g_strdup_printf(
+                "vp8enc deadline=1 end-usage=cbr target-bitrate=%u keyframe-max-dist=%u ! "
+                "rtpvp8pay pt=%d mtu=%u",
+                bitrate * 1000, LADDER_KEY_INT_MAX, payloadType, mtu) :
+            g_strdup_printf(
+                "x264enc tune=zerolatency speed-preset=ultrafast bitrate=%u key-int-max=%u ! "
+                "video/x-h264, profile=constrained-baseline ! "
+                "rtph264pay config-interval=-1 pt=%d mtu=%u",
+                bitrate, LADDER_KEY_INT_MAX, payloadType, mtu);
+}
+
+static GstCaps* EncodedVideoCaps(const gchar* encodingName, gint payloadType)
+{
+    GstCaps* caps =
+        gst_caps_new_simple(
+            "application/x-rtp",
+            "media", G_TYPE_STRING, "video",
+            "clock-rate", G_TYPE_INT, 90000,
+            "encoding-name", G_TYPE_STRING, encodingName,
+            "payload", G_TYPE_INT, payloadType,
+            nullptr);
+
+    if(0 == g_strcmp0(encodingName, "H264")) {
+        gst_caps_set_simple(
+            caps,
+            "packetization-mode", G_TYPE_STRING, "1",
+            "profile-level-id", G_TYPE_STRING, "42e01f",
+            nullptr);
+    }
+
+    return caps;
+}
+
+// source RTP is relayed as is (layer 0), or transcoded to H.264 if browsers can't decode it.
+// for renditions source is decoded once, then every rendition is scaled
+// from the previous (bigger) one and encoded
+GstElement* Media::Private::addVideoBranches(const GstCaps* sourceCaps, bool transcode)
+{
+    const bool vp8 = MediaConfig::LadderCodec::VP8 == config.ladderCodec;
+    const gchar* encodingName = vp8 ? "VP8" : "H264";
+
+    const gchar* sourceEncodingName = nullptr;
+    gint sourcePayloadType = -1;
+    if(sourceCaps && !gst_caps_is_empty(sourceCaps)) {
+        const GstStructure* structure = gst_caps_get_structure(sourceCaps, 0);
+        sourceEncodingName = gst_structure_get_string(structure, "encoding-name");
+        gst_structure_get_int(structure, "payload", &sourcePayloadType);
+    }
+
+    const gint transcodedPayloadType =
+        sourcePayloadType >= 0 ? sourcePayloadType : LADDER_H264_PAYLOAD_TYPE;
+
+    gint payloadType = vp8 ? LADDER_VP8_PAYLOAD_TYPE : LADDER_H264_PAYLOAD_TYPE;
+    if(transcode && !vp8)
+        payloadType = transcodedPayloadType;
+    else if(!transcode && sourcePayloadType >= 0 && 0 == g_strcmp0(sourceEncodingName, encodingName))
+        payloadType = sourcePayloadType;
+
+    std::string description =
+        "tee name=input ! "
+        "queue leaky=downstream max-size-buffers=0 max-size-bytes=0 max-size-time=1000000000 ! "
+        "decodebin ! videoconvert ! tee name=scaled0";
+    if(transcode) {
+        GCharPtr encoderPtr(
+            VideoEncoderDescription(
+                false, TRANSCODE_VIDEO_BITRATE, transcodedPayloadType, config.mtu));
+        GCharPtr branchPtr(
+            g_strdup_printf(
+                " scaled0. ! queue leaky=downstream max-size-buffers=1 ! %s name=layer0",
+                encoderPtr.get()));
+
+        description += branchPtr.get();
+    }
+    for(unsigned i = 0; i < config.ladder.size(); ++i) {
+        const MediaConfig::Rendition& rendition = config.ladder[i];
+
+        GCharPtr encoderPtr(
+            VideoEncoderDescription(vp8, rendition.bitrate, payloadType, config.mtu));
+
+        GCharPtr branchPtr(
+            g_strdup_printf(
+                " scaled%u. ! queue leaky=downstream max-size-buffers=1 ! "
+                "videoscale add-borders=true ! "
+                "video/x-raw, width=%u, height=%u, pixel-aspect-ratio=1/1 ! tee name=scaled%u"
+                " scaled%u. ! queue leaky=downstream max-size-buffers=1 ! %s name=layer%u",
+                i, rendition.width, rendition.height, i + 1,
+                i + 1, encoderPtr.get(), i + 1));
+
+        description += branchPtr.get();
+    }
+
+    GError* parseError = nullptr;
+    GstElementPtr binPtr(gst_parse_bin_from_description(description.c_str(), FALSE, &parseError));
+    GErrorPtr parseErrorPtr(parseError);
+    if(parseError) {
+        JANUS_LOG(LOG_ERR,
+            "Media::Private::addVideoBranches. gst_parse_bin_from_description failed: %s\n",
+            parseError->message);
+        GstElement* sink = addAppSink(StreamType::Video, 0);
+        setStreamCaps(streams.size() - 1, sourceCaps);
+        return sink;
+    }
+
+    GstBin* bin = GST_BIN(binPtr.get());
+
+    GstElementPtr inputPtr(gst_bin_get_by_name(bin, "input"));
+    GstElement* input = inputPtr.get();
+
+    GstElement* sourceSink = addAppSink(StreamType::Video, 0);
+    gst_bin_add(bin, sourceSink);
+    if(transcode) {
+        GstElementPtr payloaderPtr(gst_bin_get_by_name(bin, "layer0"));
+        gst_element_link(payloaderPtr.get(), sourceSink);
+
+        GstCapsPtr capsPtr(EncodedVideoCaps("H264", transcodedPayloadType));
+        setStreamCaps(streams.size() - 1, capsPtr.get());
+    } else {
+        gst_element_link(input, sourceSink);
+        setStreamCaps(streams.size() - 1, sourceCaps);
+    }
+
+    for(unsigned i = 0; i < config.ladder.size(); ++i) {
+        const unsigned layer = i + 1;
+
+        GCharPtr nameStrPtr(g_strdup_printf("layer%u", layer));
+        GstElementPtr payloaderPtr(gst_bin_get_by_name(bin, nameStrPtr.get()));
+
+        GstElement* layerSink = addAppSink(StreamType::Video, layer);
+        gst_bin_add(bin, layerSink);
+        gst_element_link(payloaderPtr.get(), layerSink);
+
+        GstCapsPtr capsPtr(EncodedVideoCaps(encodingName, payloadType));
+        setStreamCaps(streams.size() - 1, capsPtr.get());
+    }
+
+    GstPadPtr inputPadPtr(gst_element_get_static_pad(input, "sink"));
+    gst_element_add_pad(GST_ELEMENT(bin), gst_ghost_pad_new("sink", inputPadPtr.get()));
+
+    return binPtr.release();
+}
+
+GstElement* Media::Private::addAudioTranscoder(const GstCaps* sourceCaps)
+{
+    gint payloadType = TRANSCODE_OPUS_PAYLOAD_TYPE;
+    if(sourceCaps && !gst_caps_is_empty(sourceCaps)) {
+        gint sourcePayloadType;
+        if(gst_structure_get_int(gst_caps_get_structure(sourceCaps, 0), "payload", &sourcePayloadType) &&
+           sourcePayloadType >= FIRST_DYNAMIC_PAYLOAD_TYPE)
+        {
+            payloadType = sourcePayloadType;
+        }
+    }
+
+    const MediaConfig::Opus& opus = config.opus;
+
+    GCharPtr descriptionPtr(
+        g_strdup_printf(
+            "queue name=input leaky=downstream max-size-buffers=0 max-size-bytes=0 max-size-time=1000000000 ! "
+            "decodebin ! audioconvert ! audioresample ! "
+            "opusenc bitrate=%u dtx=%s inband-fec=%s packet-loss-percentage=%u frame-size=%u ! "
+            "rtpopuspay pt=%d name=pay",
+            opus.bitrate * 1000,
+            opus.dtx ? "true" : "false",
+            opus.fec ? "true" : "false",
+            opus.fec ? TRANSCODE_OPUS_PACKET_LOSS : 0,
+            opus.frameSize,
+            payloadType));
+
+    GError* parseError = nullptr;
+    GstElementPtr binPtr(gst_parse_bin_from_description(descriptionPtr.get(), FALSE, &parseError));
+    GErrorPtr parseErrorPtr(parseError);
+    if(parseError) {
+        JANUS_LOG(LOG_ERR,
+            "Media::Private::addAudioTranscoder. gst_parse_bin_from_description failed: %s\n",
+            parseError->message);
+        GstElement* sink = addAppSink(StreamType::Audio, 0);
+        setStreamCaps(streams.size() - 1, sourceCaps);
+        return sink;
+    }
+
+    GstBin* bin = GST_BIN(binPtr.get());
+
+    GstElementPtr payloaderPtr(gst_bin_get_by_name(bin, "pay"));
+    GstElement* sink = addAppSink(StreamType::Audio, 0);
+    gst_bin_add(bin, sink);
+    gst_element_link(payloaderPtr.get(), sink);
+
+    GstCapsPtr capsPtr(
+        gst_caps_new_simple(
+            "application/x-rtp",
+            "media", G_TYPE_STRING, "audio",
+            "clock-rate", G_TYPE_INT, 48000,
+            "encoding-name", G_TYPE_STRING, "OPUS",
+            "encoding-params", G_TYPE_STRING, "2",
+            "payload", G_TYPE_INT, payloadType,
+            "useinbandfec", G_TYPE_STRING, opus.fec ? "1" : "0",
+            "usedtx", G_TYPE_STRING, opus.dtx ? "1" : "0",
+            nullptr));
+    setStreamCaps(streams.size() - 1, capsPtr.get());
+
+    GstElementPtr inputPtr(gst_bin_get_by_name(bin, "input"));
+    GstPadPtr inputPadPtr(gst_element_get_static_pad(inputPtr.get(), "sink"));
+    gst_element_add_pad(GST_ELEMENT(bin), gst_ghost_pad_new("sink", inputPadPtr.get()));
+
+    return binPtr.release();
+}
+
+static bool IsTranscodingClass(GstElement* element)
+{
+    GstElementFactory* factory = gst_element_get_factory(element);
+    const gchar* klass =
+        factory ? gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS) : nullptr;
+
+    return klass && (strstr(klass, "Decoder") || strstr(klass, "Encoder"));
+}
+
+static bool IsQueue(GstElement* element)
+{
+    GstElementFactory* factory = gst_element_get_factory(element);
+
+    return factory && g_str_has_prefix(GST_OBJECT_NAME(factory), "queue");
+}
+
+// element decodes or encodes, or feeds decoder or encoder in the same streaming thread
+static bool IsTranscoding(GstElement* element, unsigned depth)
+{
+    if(IsTranscodingClass(element))
+        return true;
+
+    if(depth > MAX_TRANSCODING_LOOKUP_DEPTH)
+        return false;
+
+    bool transcoding = false;
+
+    GstIterator* padsIterator = gst_element_iterate_src_pads(element);
+    GValue item = G_VALUE_INIT;
+    while(!transcoding && GST_ITERATOR_OK == gst_iterator_next(padsIterator, &item)) {
+        GstPadPtr peerPtr(gst_pad_get_peer(GST_PAD(g_value_get_object(&item))));
+        GstElementPtr peerElementPtr;
+        while(peerPtr) {
+            peerElementPtr.reset(gst_pad_get_parent_element(peerPtr.get()));
+            if(!peerElementPtr || IsTranscodingClass(peerElementPtr.get())) {
+                transcoding = !!peerElementPtr;
+                break;
+            }
+
+            // ghost pads are followed to elements inside bins
+            if(!GST_IS_GHOST_PAD(peerPtr.get()))
+                break;
+            peerPtr.reset(gst_ghost_pad_get_target(GST_GHOST_PAD(peerPtr.get())));
+        }
+
+        // queues run the rest of the branch in their own threads
+        GstElement* peerElement = peerElementPtr.get();
+        if(!transcoding && peerPtr && peerElement && !IsQueue(peerElement))
+            transcoding = IsTranscoding(peerElement, depth + 1);
+
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(padsIterator);
+
+    return transcoding;
+}
+
+static void SetThreadCpus(const std::vector<unsigned>& cpus)
+{
+    if(cpus.empty())
+        return;
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for(unsigned cpu: cpus)
+        CPU_SET(cpu, &cpuSet);
+
+    if(const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet))
+        JANUS_LOG(LOG_ERR, "Failed to set streaming thread affinity: %s\n", g_strerror(error));
+}
+
+static void SetThreadScheduling(MediaConfig::Threads::Scheduling scheduling, int priority)
+{
+    switch(scheduling) {
+        case MediaConfig::Threads::Scheduling::Default:
+            break;
+        case MediaConfig::Threads::Scheduling::Fifo: {
+            sched_param param = {};
+            param.sched_priority = priority;
+            if(const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param))
+                JANUS_LOG(LOG_ERR, "Failed to set streaming thread SCHED_FIFO: %s\n", g_strerror(error));
+            break;
+        }
+        case MediaConfig::Threads::Scheduling::Nice:
+            if(0 != setpriority(PRIO_PROCESS, syscall(SYS_gettid), priority))
+                JANUS_LOG(LOG_ERR, "Failed to set streaming thread nice: %s\n", g_strerror(errno));
+            break;
+    }
+}
+
+// called from entered streaming thread.
+// Threads created by encoders (like x264enc) inherit placement of thread opening encoder
+void Media::Private::placeThread(GstElement* owner)
+{
+    const MediaConfig::Threads& threads = config.threads;
+
+    if(owner && IsTranscoding(owner, 0)) {
+        SetThreadCpus(threads.encoderCpus);
+    } else {
+        SetThreadCpus(threads.cpus);
+        SetThreadScheduling(threads.scheduling, threads.priority);
+    }
+}
+
 
-Media::Media() :
+Media::Media(const MediaConfig& config) :
     _p(new Private)
 {
+    _p->config = config;
 }
 
 Media::~Media()
@@ -88,6 +510,11 @@ Media::~Media()
     _p.reset();
 }
 
+const MediaConfig& Media::config() const
+{
+    return _p->config;
+}
+
 bool Media::hasSdp() const
 {
     return nullptr != sdp();
@@ -109,58 +536,129 @@ std::vector<Media::Stream> Media::streams() const
     return std::move(streams);
 }
 
+const GstCaps* Media::streamCaps(unsigned stream) const
+{
+    if(stream >= _p->streams.size())
+        return nullptr;
+
+    return _p->streams[stream].capsPtr.get();
+}
+
+void Media::requestKeyFrame(unsigned stream)
+{
+    if(stream >= _p->streams.size() || !_p->streams[stream].sink)
+        return;
+
+    // the same as gst_video_event_new_upstream_force_key_unit
+    GstStructure* structure =
+        gst_structure_new(
+            "GstForceKeyUnit",
+            "running-time", G_TYPE_UINT64, GST_CLOCK_TIME_NONE,
+            "all-headers", G_TYPE_BOOLEAN, TRUE,
+            "count", G_TYPE_UINT, 0,
+            nullptr);
+
+    gst_element_send_event(
+        GST_ELEMENT(_p->streams[stream].sink),
+        gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM, structure));
+}
+
 void Media::run(
     const PreparedCallback& prepared,
     const OnBufferCallback& onBuffer,
-    const EosCallback& eos)
+    const EosCallback& eos,
+    const ThreadsCallback& threads)
 {
     _p->preparedCallback = prepared;
     _p->onBufferCallback = onBuffer;
     _p->eosCallback = eos;
+    _p->threadsCallback = threads;
+
+    // recycled pipeline starts without streaming threads, but LEAVE messages
+    // of its previous run could be dropped by bus flush on the way to NULL
+    _p->threads = 0;
 
     doRun();
 }
 
-GstElement* Media::addStream(StreamType streamType)
+void Media::beginShutdown()
 {
-    GstElementPtr appSinkPtr(gst_element_factory_make("appsink", nullptr));
-    GstAppSink* appSink = GST_APP_SINK(appSinkPtr.get());
+}
 
-    gst_app_sink_set_drop(appSink, TRUE);
+bool Media::recycle()
+{
+    return false;
+}
 
-    auto onAppSinkEosCallback =
-        [] (GstAppSink* appsink, gpointer userData)
-    {
-        Private* self = static_cast<Private*>(userData);
-    };
-    auto onAppSinkPrerollCallback =
-        [] (GstAppSink* appsink, gpointer userData) -> GstFlowReturn
-    {
-        Private* self = static_cast<Private*>(userData);
-        return self->onAppSinkPreroll(appsink);
-    };
-    auto onAppSinkSampleCallback =
-        [] (GstAppSink* appsink, gpointer userData) -> GstFlowReturn
-    {
-        Private* self = static_cast<Private*>(userData);
-        return self->onAppSinkSample(appsink);
-    };
+GstElement* Media::addStream(StreamType streamType, const GstCaps* sourceCaps)
+{
+    bool transcode = !IsWebRtcCompatible(sourceCaps);
+    if(StreamType::Audio == streamType) {
+        switch(_p->config.audioTranscode) {
+            case MediaConfig::AudioTranscode::Auto:
+                break;
+            case MediaConfig::AudioTranscode::Always:
+                transcode = true;
+                break;
+            case MediaConfig::AudioTranscode::Never:
+                transcode = false;
+                break;
+        }
+    }
+
+    if(transcode) {
+        GCharPtr capsStrPtr(gst_caps_to_string(sourceCaps));
+        JANUS_LOG(LOG_INFO, "Stream will be transcoded: %s\n", capsStrPtr.get());
+    }
+
+    if(StreamType::Video == streamType && (transcode || !_p->config.ladder.empty()))
+        return _p->addVideoBranches(sourceCaps, transcode);
+
+    if(StreamType::Audio == streamType && transcode)
+        return _p->addAudioTranscoder(sourceCaps);
+
+    GstElement* sink = _p->addAppSink(streamType, 0);
+    _p->setStreamCaps(_p->streams.size() - 1, sourceCaps);
+
+    return sink;
+}
 
-    GstAppSinkCallbacks callbacks =
-        {onAppSinkEosCallback, onAppSinkPrerollCallback, onAppSinkSampleCallback};
-    gst_app_sink_set_callbacks(
-        appSink,
-        &callbacks,
-        _p.get(),
-        nullptr);
+unsigned Media::addRtpStream(StreamType streamType, const GstCaps* caps)
+{
+    _p->streams.emplace_back(Private::Stream{{streamType, std::string(), 0}, nullptr});
+    _p->setStreamCaps(_p->streams.size() - 1, caps);
 
-    _p->streams.emplace_back(Private::Stream{{streamType}, appSink});
+    return _p->streams.size() - 1;
+}
 
-    return appSinkPtr.release();
+void Media::setStreamCaps(unsigned stream, const GstCaps* caps)
+{
+    _p->setStreamCaps(stream, caps);
+}
+
+void Media::clearStreams()
+{
+    _p->streams.clear();
+}
+
+void Media::pushBuffer(unsigned stream, const void* data, gsize size)
+{
+    if(_p->onBufferCallback)
+        _p->onBufferCallback(stream, data, size);
 }
 
 void Media::prepared()
 {
+    for(unsigned i = 0; i < _p->streams.size(); ++i) {
+        Private::Stream& stream = _p->streams[i];
+        if(stream.capsPtr || !stream.sink)
+            continue;
+
+        GstPadPtr sinkPadPtr(gst_element_get_static_pad(GST_ELEMENT(stream.sink), "sink"));
+        GstCapsPtr capsPtr(gst_pad_get_current_caps(sinkPadPtr.get()));
+        setStreamCaps(i, capsPtr.get());
+    }
+
     if(_p->preparedCallback)
         _p->preparedCallback();
 }
@@ -170,3 +668,54 @@ void Media::eos(bool error)
     if(_p->eosCallback)
         _p->eosCallback(error);
 }
+
+void Media::placeThreads(GstBus* bus)
+{
+    const MediaConfig::Threads& threads = _p->config.threads;
+    if(threads.cpus.empty() && threads.encoderCpus.empty() &&
+       MediaConfig::Threads::Scheduling::Default == threads.scheduling)
+    {
+        return;
+    }
+
+    auto onSyncMessage =
+        [] (GstBus*, GstMessage* message, gpointer userData) -> GstBusSyncReply
+    {
+        if(GST_MESSAGE_STREAM_STATUS != GST_MESSAGE_TYPE(message))
+            return GST_BUS_PASS;
+
+        GstStreamStatusType type;
+        GstElement* owner;
+        gst_message_parse_stream_status(message, &type, &owner);
+        if(GST_STREAM_STATUS_TYPE_ENTER == type) {
+            Private* p = static_cast<Private*>(userData);
+            p->placeThread(owner);
+        }
+
+        return GST_BUS_PASS;
+    };
+
+    gst_bus_set_sync_handler(bus, onSyncMessage, _p.get(), nullptr);
+}
+
+void Media::streamStatus(GstMessage* message)
+{
+    GstStreamStatusType type;
+    GstElement* owner;
+    gst_message_parse_stream_status(message, &type, &owner);
+
+    switch(type) {
+        case GST_STREAM_STATUS_TYPE_ENTER:
+            ++_p->threads;
+            break;
+        case GST_STREAM_STATUS_TYPE_LEAVE:
+            if(_p->threads)
+                --_p->threads;
+            break;
+        default:
+            return;
+    }
+
+    if(_p->threadsCallback)
+        _p->threadsCallback(_p->threads);
+}
@@ -3,12 +3,15 @@
 #include <memory>
 #include <functional>
 #include <vector>
+#include <string>
 
 #include <glib.h>
 
 #include <gst/gst.h>
 #include <gst/sdp/gstsdpmessage.h>
 
+#include "MediaConfig.h"
+
 
 class Media
 {
@@ -25,31 +28,63 @@ public:
 
     struct Stream {
         StreamType type;
+        std::string encodingName;
+        unsigned layer; // 0 - source stream, N - Nth rendition of MediaConfig::ladder
     };
 
-    Media();
+    Media(const MediaConfig&);
     virtual ~Media();
 
+    const MediaConfig& config() const;
+
     bool hasSdp() const;
     virtual const GstSDPMessage* sdp() const = 0;
 
     unsigned streamsCount() const;
     std::vector<Stream> streams() const;
+    const GstCaps* streamCaps(unsigned stream) const;
+
+    // asks encoders feeding the stream (if any) to produce key frame as soon as possible
+    void requestKeyFrame(unsigned stream);
 
     typedef std::function<void ()> PreparedCallback;
     typedef std::function<void (int stream, const void* data, gsize size)> OnBufferCallback;
     typedef std::function<void (bool error)> EosCallback;
+    // streaming threads currently running in media pipeline
+    typedef std::function<void (unsigned threads)> ThreadsCallback;
     // OnBufferCallback will be called from a streaming thread
-    void run(const PreparedCallback&, const OnBufferCallback&, const EosCallback&);
+    void run(
+        const PreparedCallback&, const OnBufferCallback&, const EosCallback&,
+        const ThreadsCallback& = ThreadsCallback());
+    // starts shutdown without waiting for it, so several media could be stopped in parallel.
+    // It's still required to call shutdown() (which waits for it) later
+    virtual void beginShutdown();
     virtual void shutdown() = 0;
+    // prepares shut down media to be run again without rebuilding pipeline,
+    // false - media can't be reused and has to be recreated
+    virtual bool recycle();
 
 protected:
     virtual void doRun() = 0;
 
-    GstElement* addStream(StreamType);
+    // returns bin with transcoded renditions for video streams if MediaConfig::ladder is not empty,
+    // and bin transcoding source if sourceCaps (if known) are not playable by browsers
+    // (audio is transcoded according to MediaConfig::audioTranscode)
+    GstElement* addStream(StreamType, const GstCaps* sourceCaps = nullptr);
+    // stream fed by derived class with pushBuffer instead of GStreamer pipeline
+    unsigned addRtpStream(StreamType, const GstCaps*);
+    void setStreamCaps(unsigned stream, const GstCaps*);
+    // forgets streams, their sinks have to be removed from pipeline by derived class
+    void clearStreams();
+    void pushBuffer(unsigned stream, const void* data, gsize size);
 
     void prepared();
     void eos(bool error);
+    // has to be called for GST_MESSAGE_STREAM_STATUS of media pipeline
+    void streamStatus(GstMessage*);
+    // places streaming threads of pipeline according to MediaConfig::threads
+    // (installs sync handler of pipeline bus)
+    void placeThreads(GstBus*);
 
 private:
     struct Private;
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+struct MediaConfig
+{
+    enum class LadderCodec {
+        H264,
+        VP8,
+    };
+
+    struct Rendition
+    {
+        unsigned width;
+        unsigned height;
+        unsigned bitrate; // kbit/s
+    };
+
+    enum class AudioTranscode {
+        Auto, // only if browsers can't play source audio
+        Always,
+        Never,
+    };
+
+    struct Opus
+    {
+        unsigned bitrate = 32; // kbit/s
+        bool dtx = false;
+        bool fec = true;
+        unsigned frameSize = 20; // ms
+    };
+
+    // time shift ring of relayed RTP
+    struct Dvr
+    {
+        enum class Storage {
+            None,
+            Memory,
+            File, // memory mapped
+        };
+
+        Storage storage = Storage::None;
+        unsigned size = 64; // MiB
+        unsigned duration = 300; // s, max time shift
+        // %, playback speed of time shifted viewer till it catches up with live,
+        // 100 - viewer stays behind live
+        unsigned catchUpSpeed = 125;
+        std::string path; // for Storage::File
+    };
+
+    // rolling rtpdump segments of relayed RTP
+    struct Record
+    {
+        std::string path; // directory, empty - recording is disabled
+        unsigned segmentDuration = 600; // s
+        unsigned maxSegments = 144; // the oldest ones are deleted, 0 - keep all
+    };
+
+    // relayed RTP is forwarded to other nodes
+    struct Forward
+    {
+        struct Destination
+        {
+            std::string host; // IPv4 address, unicast or multicast
+            unsigned short port; // video, audio is forwarded to port + 2
+        };
+
+        std::vector<Destination> destinations;
+        unsigned ttl = 1; // for multicast destinations
+    };
+
+    // low latency HLS of relayed streams, muxed without transcoding
+    struct Hls
+    {
+        std::string path; // directory, empty - HLS is disabled
+        unsigned segmentDuration = 2; // s
+        unsigned partDuration = 200; // ms
+        unsigned segments = 6; // in playlist
+    };
+
+    // placement of media pipeline streaming threads
+    struct Threads
+    {
+        enum class Scheduling {
+            Default,
+            Fifo, // SCHED_FIFO with priority
+            Nice, // SCHED_OTHER with priority as nice value
+        };
+
+        std::vector<unsigned> cpus; // source and fan-out threads, empty - not pinned
+        std::vector<unsigned> encoderCpus; // decoding and encoding threads, empty - not pinned
+        Scheduling scheduling = Scheduling::Default; // of source and fan-out threads
+        int priority = 0;
+    };
+
+    // relayed RTP served by embedded RTSP server
+    struct Republish
+    {
+        std::string path; // empty - republishing is disabled
+        unsigned port = 8554;
+    };
+
+    LadderCodec ladderCodec = LadderCodec::H264;
+    std::vector<Rendition> ladder; // from highest to lowest
+
+    AudioTranscode audioTranscode = AudioTranscode::Auto;
+    Opus opus;
+
+    unsigned mtu = 0; // max size of relayed RTP packets, 0 - relay as received
+
+    Threads threads;
+
+    Dvr dvr;
+    Record record;
+    Forward forward;
+    Republish republish;
+    Hls hls;
+};
@@ -0,0 +1,282 @@
+#include "MosaicMedia.h"
+
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+
+#include <gst/app/gstappsrc.h>
+
+extern "C" {
+#include "janus/debug.h"
+}
+
+#include "CxxPtr/GstPtr.h"
+
+#include "MountPoint.h"
+#include "MountPointTap.h"
+
+
+namespace {
+
+enum {
+    TILES_UPDATE_INTERVAL = 1, // s
+    TILE_TIMEOUT = 3000000, // us, tile is replaced with placeholder if source is silent longer
+    TILE_QUEUE_SIZE = 500, // packets
+    MOSAIC_PAYLOAD_TYPE = 96,
+    PLACEHOLDER_COLOR = 0xff303030,
+};
+
+struct Grid
+{
+    unsigned columns;
+    unsigned rows;
+    unsigned tileWidth;
+    unsigned tileHeight;
+};
+
+}
+
+static Grid MosaicGrid(unsigned sourcesCount, const MosaicConfig& config)
+{
+    Grid grid;
+    grid.columns =
+        config.columns ?
+            config.columns :
+            std::max(1u, static_cast<unsigned>(std::ceil(std::sqrt(sourcesCount))));
+    grid.rows =
+        config.rows ?
+            config.rows :
+            std::max(1u, (sourcesCount + grid.columns - 1) / grid.columns);
+    grid.tileWidth = config.width / grid.columns & ~1u;
+    grid.tileHeight = config.height / grid.rows & ~1u;
+
+    return grid;
+}
+
+static unsigned TilesCount(unsigned sourcesCount, const MosaicConfig& config)
+{
+    const Grid grid = MosaicGrid(sourcesCount, config);
+    return std::min(sourcesCount, grid.columns * grid.rows);
+}
+
+static std::string MosaicPipeline(unsigned sourcesCount, const MosaicConfig& config)
+{
+    const Grid grid = MosaicGrid(sourcesCount, config);
+    const unsigned tilesCount = TilesCount(sourcesCount, config);
+
+    // sink_0 is placeholder background making compositor live even if all sources are down
+    std::string pipeline = "compositor name=mosaic sink_0::zorder=0";
+    for(unsigned i = 0; i < tilesCount; ++i) {
+        pipeline +=
+            " sink_" + std::to_string(i + 1) +
+            "::xpos=" + std::to_string(i % grid.columns * grid.tileWidth) +
+            " sink_" + std::to_string(i + 1) +
+            "::ypos=" + std::to_string(i / grid.columns * grid.tileHeight) +
+            " sink_" + std::to_string(i + 1) + "::zorder=1";
+    }
+
+    const std::string rawCaps =
+        "video/x-raw, width=" + std::to_string(config.width) +
+        ", height=" + std::to_string(config.height) +
+        ", framerate=" + std::to_string(config.framerate) + "/1";
+
+    pipeline +=
+        " ! " + rawCaps +
+        " ! videoconvert"
+        " ! x264enc tune=zerolatency speed-preset=ultrafast"
+            " bitrate=" + std::to_string(config.bitrate) +
+            " key-int-max=" + std::to_string(config.framerate * 2) +
+        " ! video/x-h264, profile=constrained-baseline"
+        " ! rtph264pay config-interval=-1"
+            " pt=" + std::to_string(MOSAIC_PAYLOAD_TYPE) +
+            " name=videopay";
+
+    pipeline +=
+        " videotestsrc is-live=true pattern=solid-color"
+            " foreground-color=" + std::to_string(PLACEHOLDER_COLOR) +
+        " ! " + rawCaps +
+        " ! mosaic.sink_0";
+
+    // sources are scaled down right after decoding, and excessive frames are dropped before that
+    for(unsigned i = 0; i < tilesCount; ++i) {
+        pipeline +=
+            " appsrc name=tile" + std::to_string(i) +
+                " is-live=true do-timestamp=true format=time"
+            " ! queue leaky=downstream max-size-buffers=" + std::to_string(TILE_QUEUE_SIZE) +
+                " max-size-bytes=0 max-size-time=0"
+            " ! decodebin"
+            " ! videorate drop-only=true max-rate=" + std::to_string(config.framerate) +
+            " ! videoscale ! videoconvert"
+            " ! video/x-raw, width=" + std::to_string(grid.tileWidth) +
+                ", height=" + std::to_string(grid.tileHeight) +
+                ", pixel-aspect-ratio=1/1"
+            " ! mosaic.sink_" + std::to_string(i + 1);
+    }
+
+    return pipeline;
+}
+
+
+// feeds video of one source mount point into mosaic
+class MosaicMedia::Tile : public MountPointTap
+{
+public:
+    Tile(MountPoint* source, GstElement* appSrc, GstPad* compositorPad) :
+        _source(source),
+        _appSrcPtr(appSrc), _compositorPadPtr(compositorPad),
+        _videoStream(-1), _waitingKeyFrame(true), _lastPacketTime(0), _visible(true) {}
+
+    MountPoint* source() const
+        { return _source; }
+
+    void mediaPrepared(const std::vector<Stream>& streams) override;
+    void onPacket(unsigned stream, bool keyFrame, const char* data, size_t size) override;
+
+    void update(gint64 now);
+
+private:
+    MountPoint *const _source;
+
+    GstElementPtr _appSrcPtr;
+    GstPadPtr _compositorPadPtr;
+
+    std::atomic<int> _videoStream;
+    std::atomic<bool> _waitingKeyFrame;
+    std::atomic<gint64> _lastPacketTime;
+
+    bool _visible;
+};
+
+void MosaicMedia::Tile::mediaPrepared(const std::vector<Stream>& streams)
+{
+    _videoStream = -1;
+
+    for(const Stream& stream: streams) {
+        if(!stream.video)
+            continue;
+
+        g_object_set(_appSrcPtr.get(), "caps", stream.caps, NULL);
+        _videoStream = stream.index;
+
+        break;
+    }
+}
+
+void MosaicMedia::Tile::onPacket(unsigned stream, bool keyFrame, const char* data, size_t size)
+{
+    if(static_cast<int>(stream) != _videoStream)
+        return;
+
+    // decoder can't start from the middle of GOP
+    if(_waitingKeyFrame && !keyFrame)
+        return;
+    _waitingKeyFrame = false;
+
+    GstBuffer* buffer = gst_buffer_new_allocate(nullptr, size, nullptr);
+    gst_buffer_fill(buffer, 0, data, size);
+    gst_app_src_push_buffer(GST_APP_SRC(_appSrcPtr.get()), buffer);
+
+    _lastPacketTime = g_get_monotonic_time();
+}
+
+void MosaicMedia::Tile::update(gint64 now)
+{
+    const bool visible = now - _lastPacketTime < TILE_TIMEOUT;
+    if(visible == _visible)
+        return;
+
+    // makes background placeholder visible instead of frozen picture
+    g_object_set(_compositorPadPtr.get(), "alpha", visible ? 1.0 : 0.0, NULL);
+    _visible = visible;
+
+    if(!visible)
+        _waitingKeyFrame = true;
+}
+
+
+MosaicMedia::MosaicMedia(
+    const std::vector<MountPoint*>& sources,
+    const MosaicConfig& mosaicConfig,
+    const MediaConfig& config) :
+    LaunchMedia(MosaicPipeline(sources.size(), mosaicConfig), config),
+    _sources(sources.begin(), sources.begin() + TilesCount(sources.size(), mosaicConfig))
+{
+}
+
+MosaicMedia::~MosaicMedia()
+{
+    shutdown();
+}
+
+void MosaicMedia::doRun()
+{
+    LaunchMedia::doRun();
+
+    GstElement* pipeline = this->pipeline();
+    if(!pipeline)
+        return;
+
+    GstElementPtr compositorPtr(gst_bin_get_by_name(GST_BIN(pipeline), "mosaic"));
+    if(!compositorPtr)
+        return;
+
+    for(unsigned i = 0; i < _sources.size(); ++i) {
+        if(!_sources[i])
+            continue; // tile will show placeholder forever
+
+        GCharPtr appSrcNamePtr(g_strdup_printf("tile%u", i));
+        GCharPtr padNamePtr(g_strdup_printf("sink_%u", i + 1));
+
+        GstElement* appSrc = gst_bin_get_by_name(GST_BIN(pipeline), appSrcNamePtr.get());
+        GstPad* compositorPad = gst_element_get_static_pad(compositorPtr.get(), padNamePtr.get());
+        if(!appSrc || !compositorPad) {
+            JANUS_LOG(LOG_ERR, "MosaicMedia::doRun. Tile %u is not found\n", i);
+            if(appSrc)
+                gst_object_unref(appSrc);
+            if(compositorPad)
+                gst_object_unref(compositorPad);
+            continue;
+        }
+
+        _tiles.emplace_back(new Tile(_sources[i], appSrc, compositorPad));
+        _sources[i]->addTap(_tiles.back().get());
+    }
+
+    auto update =
+         [] (gpointer userData) -> gboolean
+    {
+        MosaicMedia* media = static_cast<MosaicMedia*>(userData);
+        media->updateTiles();
+
+        return TRUE;
+    };
+
+    _tilesTimerPtr.reset(g_timeout_source_new_seconds(TILES_UPDATE_INTERVAL));
+    GSource* timeoutSource = _tilesTimerPtr.get();
+    g_source_set_callback(
+        timeoutSource,
+        (GSourceFunc) update,
+        this, nullptr);
+    g_source_attach(timeoutSource, g_main_context_get_thread_default());
+}
+
+void MosaicMedia::updateTiles()
+{
+    const gint64 now = g_get_monotonic_time();
+    for(const std::unique_ptr<Tile>& tile: _tiles)
+        tile->update(now);
+}
+
+void MosaicMedia::shutdown()
+{
+    if(_tilesTimerPtr) {
+        g_source_destroy(_tilesTimerPtr.get());
+        _tilesTimerPtr.reset();
+    }
+
+    for(const std::unique_ptr<Tile>& tile: _tiles)
+        tile->source()->removeTap(tile.get());
+    _tiles.clear();
+
+    LaunchMedia::shutdown();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+
+#include "CxxPtr/GlibPtr.h"
+
+#include "LaunchMedia.h"
+
+
+class MountPoint;
+
+struct MosaicConfig
+{
+    // 0 - enough to fit all sources into nearly square grid
+    unsigned columns = 0;
+    unsigned rows = 0;
+
+    unsigned width = 1280;
+    unsigned height = 720;
+    unsigned framerate = 15;
+    unsigned bitrate = 2000; // kbit/s
+};
+
+// composites video of other mount points (tapping their already running media) into one stream
+class MosaicMedia : public LaunchMedia
+{
+public:
+    MosaicMedia(
+        const std::vector<MountPoint*>& sources,
+        const MosaicConfig&,
+        const MediaConfig&);
+    ~MosaicMedia();
+
+    void shutdown() override;
+
+protected:
+    void doRun() override;
+
+private:
+    class Tile;
+
+    void updateTiles();
+
+private:
+    const std::vector<MountPoint*> _sources;
+    std::vector<std::unique_ptr<Tile>> _tiles;
+    GSourcePtr _tilesTimerPtr;
+};
@@ -0,0 +1,33 @@
+#include "MosaicMountPoint.h"
+
+extern "C" {
+#include "janus/debug.h"
+}
+
+
+MosaicMountPoint::MosaicMountPoint(
+    janus_callbacks* janus, janus_plugin* plugin,
+    const std::map<int, std::unique_ptr<MountPoint>>& mountPoints,
+    const std::vector<int>& sources,
+    const MosaicConfig& mosaicConfig,
+    const MediaConfig& mediaConfig,
+    const std::string& description) :
+    MountPoint(janus, plugin, RESTREAM_VIDEO, mediaConfig, description),
+    _mountPoints(mountPoints), _sources(sources), _mosaicConfig(mosaicConfig)
+{
+}
+
+std::unique_ptr<Media> MosaicMountPoint::createMedia()
+{
+    std::vector<MountPoint*> sources;
+    for(int id: _sources) {
+        auto it = _mountPoints.find(id);
+        if(it == _mountPoints.end() || it->second.get() == this) {
+            JANUS_LOG(LOG_ERR, "Invalid mosaic \"%s\" source %d\n", description().c_str(), id);
+            sources.push_back(nullptr);
+        } else
+            sources.push_back(it->second.get());
+    }
+
+    return std::unique_ptr<Media>(new MosaicMedia(sources, _mosaicConfig, mediaConfig()));
+}
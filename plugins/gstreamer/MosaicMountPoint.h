@@ -0,0 +1,30 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "MountPoint.h"
+#include "MosaicMedia.h"
+
+
+class MosaicMountPoint : public MountPoint
+{
+public:
+    // sources are looked up in mountPoints only when media is created,
+    // so they can be defined in any order
+    MosaicMountPoint(
+        janus_callbacks*, janus_plugin*,
+        const std::map<int, std::unique_ptr<MountPoint>>& mountPoints,
+        const std::vector<int>& sources,
+        const MosaicConfig&,
+        const MediaConfig&,
+        const std::string& description);
+
+protected:
+    std::unique_ptr<Media> createMedia() override;
+
+private:
+    const std::map<int, std::unique_ptr<MountPoint>>& _mountPoints;
+    const std::vector<int> _sources;
+    const MosaicConfig _mosaicConfig;
+};
@@ -3,16 +3,30 @@
 #include <algorithm>
 #include <cassert>
 
+extern "C" {
+#include "janus/utils.h"
+}
+
 #include "CxxPtr/GlibPtr.h"
 #include "CxxPtr/GstPtr.h"
 #include "CxxPtr/JanssonPtr.h"
 #include "Session.h"
+#include "WebRtcFormat.h"
+#include "Probes.h"
 
 
 enum {
     RECONNECT_TIMEOUT = 5,
     MAX_RECONNECT_COUNT = 5,
     MAX_CLIENTS_COUNT = -1,
+    LAYERS_UPDATE_INTERVAL = 1,
+    AUTO_LAYER_UP_THRESHOLD = 80, // % of estimated bitrate better layer should fit in
+    // s, without receiver estimation automatically selected layer is chosen by max bitrate
+    AUTO_LAYER_FEEDBACK_TIMEOUT = 5,
+    DVR_PLAYBACK_INTERVAL = 10, // ms
+    DVR_CATCH_UP_LAG = 500, // ms, time shifted viewer closer to live is switched to live
+    // source can relay a few more packets until listiner is removed
+    SWITCH_SEQ_GAP = 100,
 };
 
 
@@ -37,14 +51,70 @@ bool operator < (const MountPoint::ListinerAction& x, const MountPoint::Listiner
     return x.janusSessionPtr.get() < y.janusSessionPtr.get();
 }
 
+bool operator < (const MountPoint::Listiner& listiner, janus_plugin_session* janusSession)
+{
+    return listiner.janusSessionPtr.get() < janusSession;
+}
+
 
 MountPoint::MountPoint(
     janus_callbacks* janus, janus_plugin* plugin,
-    Flags flags, const std::string& description) :
+    Flags flags,
+    const MediaConfig& mediaConfig,
+    const std::string& description) :
     _janus(janus), _plugin(plugin),
-    _flags(flags), _description(description),
-    _reconnectCount(0), _prepared(false)
+    _flags(flags), _mediaConfig(mediaConfig), _description(description),
+    _tapsCount(0), _keyFrameWaiters(0), _threads(0), _reconnectCount(0), _maxLayer(0), _prepared(false)
+{
+    // media can't be prepared from constructor, so it's up to owner
+    if(MediaConfig::Dvr::Storage::None != mediaConfig.dvr.storage) {
+        _dvrPtr.reset(new Dvr(mediaConfig.dvr));
+        if(_dvrPtr->isValid())
+            _taps.push_back(_dvrPtr.get());
+        else
+            _dvrPtr.reset();
+    }
+
+    if(!mediaConfig.record.path.empty()) {
+        _recorderPtr.reset(new SegmentRecorder(mediaConfig.record));
+        _taps.push_back(_recorderPtr.get());
+    }
+
+    if(!mediaConfig.forward.destinations.empty()) {
+        _forwarderPtr.reset(new UdpForwarder(mediaConfig.forward));
+        if(_forwarderPtr->isValid())
+            _taps.push_back(_forwarderPtr.get());
+        else
+            _forwarderPtr.reset();
+    }
+
+    if(!mediaConfig.republish.path.empty()) {
+        _republisherPtr.reset(new RtspRepublisher(mediaConfig.republish));
+        _taps.push_back(_republisherPtr.get());
+    }
+
+    if(!mediaConfig.hls.path.empty()) {
+        _hlsWriterPtr.reset(new HlsWriter(mediaConfig.hls));
+        _taps.push_back(_hlsWriterPtr.get());
+    }
+
+    _tapsCount = _taps.size();
+}
+
+MountPoint::~MountPoint()
+{
+    stopLayersTimer();
+    stopDvrTimer();
+
+    if(_media) {
+        _media->shutdown();
+        _media.reset();
+    }
+}
+
+const MediaConfig& MountPoint::mediaConfig() const
 {
+    return _mediaConfig;
 }
 
 const std::string&  MountPoint::description() const
@@ -57,6 +127,47 @@ bool MountPoint::isUsed() const
     return !_clients.empty();
 }
 
+bool MountPoint::keepsMedia() const
+{
+    return !_taps.empty();
+}
+
+unsigned MountPoint::threadsCount() const
+{
+    return _threads;
+}
+
+const MediaConfig::Threads& MountPoint::threadsPlacement() const
+{
+    return _mediaConfig.threads;
+}
+
+void MountPoint::addTap(MountPointTap* tap)
+{
+    {
+        std::lock_guard<std::mutex> lock(_tapsGuard);
+        _taps.push_back(tap);
+        _tapsCount = _taps.size();
+    }
+
+    if(_prepared)
+        tap->mediaPrepared(tapStreams());
+    else
+        prepareMedia();
+}
+
+void MountPoint::removeTap(MountPointTap* tap)
+{
+    {
+        std::lock_guard<std::mutex> lock(_tapsGuard);
+        _taps.erase(std::remove(_taps.begin(), _taps.end(), tap), _taps.end());
+        _tapsCount = _taps.size();
+    }
+
+    if(_clients.empty() && !keepsMedia())
+        releaseMedia();
+}
+
 void MountPoint::pushError(const char* errorText)
 {
     JANUS_LOG(LOG_ERR, "%s\n", errorText);
@@ -81,118 +192,160 @@ void MountPoint::pushError(
     PushError(_janus, _plugin, janusSession, transaction, errorText);
 }
 
-void MountPoint::pushSdp(janus_plugin_session* janusSession, const std::string& transaction)
+static void AddFormat(GstSDPMedia* media, const GstCaps* caps)
 {
-    if(!media() || !media()->hasSdp()) {
-        JANUS_LOG(LOG_ERR, "MountPoint::pushSdp. SDP missing.");
-        return;
-    }
+    GstCapsPtr formatCapsPtr(WebRtcFormatCaps(caps));
+    gst_sdp_media_set_media_from_caps(formatCapsPtr.get(), media);
+}
 
-    const bool restreamVideo = _flags & RESTREAM_VIDEO;
-    const bool restreamAudio = _flags & RESTREAM_AUDIO;
+MountPoint::SdpMediaPtr MountPoint::sdpMedia(bool video) const
+{
+    if(!media() || !_prepared)
+        return nullptr;
 
-    Session* session = GetSession(janusSession);
+    return video ? _videoSdpMediaPtr : _audioSdpMediaPtr;
+}
 
-    GstSDPMessage* outSdp;
-    gst_sdp_message_new(&outSdp);
-    GstSDPMessagePtr outSdpPtr(outSdp);
+// offer is built from actually relayed streams, not from source SDP,
+// since some of them can be transcoded
+MountPoint::SdpMediaPtr MountPoint::buildSdpMedia(bool video) const
+{
+    if(!media())
+        return nullptr;
 
-    gst_sdp_message_set_version(outSdp, "0");
-    gst_sdp_message_set_origin(outSdp,
-        "-", session->sdpSessionId.get(), "1", "IN", "IP4", "127.0.0.1");
+    const RestreamAs restreamAs = video ? RestreamAs::Video : RestreamAs::Audio;
+    for(unsigned i = 0; i < _streams.size(); ++i) {
+        const Stream& s = _streams[i];
+        if(s.restreamAs != restreamAs || s.layer > 0)
+            continue;
 
-    gst_sdp_message_set_session_name(outSdp, "Session streamed with Janus Gstreamer plugin");
+        const GstCaps* caps = media()->streamCaps(i);
+        if(!caps || gst_caps_is_empty(caps))
+            return nullptr;
 
-    const GstSDPMessage* sourceSdp = media()->sdp();
-    const guint mediaCount = gst_sdp_message_medias_len(sourceSdp);
-    for(unsigned m = 0; m < mediaCount; ++m) {
-        const GstSDPMedia* inMedia = gst_sdp_message_get_media(sourceSdp, m);
-        if(0 == g_strcmp0(inMedia->media, "video")) {
-            if(!restreamVideo)
-                continue;
-        } else if(0 == g_strcmp0(inMedia->media, "audio")) {
-            if(!restreamAudio)
+        GstSDPMedia* outMedia;
+        gst_sdp_media_new(&outMedia);
+
+        gst_sdp_media_set_proto(outMedia, "RTP/AVP");
+        AddFormat(outMedia, caps);
+
+        // transcoded renditions can use payload type different from source one
+        for(unsigned l = 0; RestreamAs::Video == s.restreamAs && l < _streams.size(); ++l) {
+            if(RestreamAs::Video != _streams[l].restreamAs || 0 == _streams[l].layer)
                 continue;
-        } else
-            continue;
 
-        JANUS_LOG(LOG_VERB, "inMedia: %s\n", gst_sdp_media_as_text(inMedia));
-
-        GstSDPMediaPtr outMediaPtr;
-
-        if(0 == g_strcmp0(inMedia->media, "video")) {
-            GstSDPMedia* outMedia;
-            gst_sdp_media_new(&outMedia);
-            outMediaPtr.reset(outMedia);
-
-            gst_sdp_media_set_proto(outMedia, gst_sdp_media_get_proto(inMedia));
-
-            const guint fmtCount = gst_sdp_media_formats_len(inMedia);
-            for(guint fmtIdx = 0; fmtIdx < fmtCount; ++fmtIdx) {
-                const gchar* fmt = gst_sdp_media_get_format(inMedia, fmtIdx);
-                GstCaps* caps = gst_sdp_media_get_caps_from_media(inMedia, atoi(fmt));
-                GstCapsPtr capsPtr(caps);
-                if(caps) {
-                    const guint size = gst_caps_get_size(caps);
-                    for(int i = 0; i < size; ++i) {
-                        GstStructure* structure = gst_caps_get_structure(caps, i);
-                        const gchar* encodingName =
-                            gst_structure_get_string(structure, "encoding-name");
-                        if(0 == g_strcmp0(encodingName, "H264")) {
-                            gst_structure_set(
-                                structure,
-                                "profile-level-id", G_TYPE_STRING, "42c015",
-                                NULL);
-                        }
-                    }
-                    gst_sdp_media_set_media_from_caps(caps, outMedia);
-                }
+            const GstCaps* layerCaps = media()->streamCaps(l);
+            gint payloadType;
+            if(!layerCaps ||
+               !gst_structure_get_int(gst_caps_get_structure(layerCaps, 0), "payload", &payloadType))
+            {
+                continue;
             }
-        } else {
-            GstSDPMedia* outMedia;
-            gst_sdp_media_copy(inMedia, &outMedia);
-            outMediaPtr.reset(outMedia);
+
+            bool hasFormat = false;
+            const guint outFmtCount = gst_sdp_media_formats_len(outMedia);
+            for(guint fmtIdx = 0; fmtIdx < outFmtCount && !hasFormat; ++fmtIdx)
+                hasFormat = atoi(gst_sdp_media_get_format(outMedia, fmtIdx)) == payloadType;
+
+            if(!hasFormat)
+                AddFormat(outMedia, layerCaps);
         }
 
-        if(outMediaPtr) {
-            gst_sdp_media_set_port_info(outMediaPtr.get(), 1, 1); // Have to set port to some non zero value. Why?
-            gst_sdp_message_add_media(outSdp, outMediaPtr.get());
+        JANUS_LOG(LOG_VERB, "outMedia: %s\n", GCharPtr(gst_sdp_media_as_text(outMedia)).get());
+
+        // receiver estimation drives automatic layer selection
+        for(guint fmtIdx = 0; video && fmtIdx < gst_sdp_media_formats_len(outMedia); ++fmtIdx) {
+            const std::string rtcpFb = std::string(gst_sdp_media_get_format(outMedia, fmtIdx)) + " goog-remb";
+            gst_sdp_media_add_attribute(outMedia, "rtcp-fb", rtcpFb.c_str());
         }
+
+        gst_sdp_media_set_port_info(outMedia, 1, 1); // Have to set port to some non zero value. Why?
+
+        return SdpMediaPtr(outMedia, gst_sdp_media_free);
     }
 
-    GCharPtr sdpPtr(gst_sdp_message_as_text(outSdp));
-    const gchar* sdp = sdpPtr.get();
-    JANUS_LOG(LOG_VERB, "PushSdp. \n%s\n", sdpPtr.get());
+    return nullptr;
+}
+
+void MountPoint::pushSdp(janus_plugin_session* janusSession, const std::string& transaction)
+{
+    if(!media() || !_prepared) {
+        JANUS_LOG(LOG_ERR, "MountPoint::pushSdp. Media is not prepared.");
+        return;
+    }
 
-    JsonPtr eventPtr(json_object());
-    json_t* event = eventPtr.get();
+    const auto clientIt =
+        std::lower_bound(_clients.begin(), _clients.end(), janusSession);
+    if(clientIt == _clients.end() || *clientIt != janusSession)
+        return;
+
+    Delivery& delivery = *clientIt->deliveryPtr;
+    Session* session = GetSession(janusSession);
+
+    // streams get m-lines of session's PeerConnection on the first offer
+    for(const Stream& s: _streams) {
+        if(RestreamAs::None == s.restreamAs || s.layer > 0)
+            continue;
+
+        const bool video = RestreamAs::Video == s.restreamAs;
+        int& mindex = video ? delivery.videoMindex : delivery.audioMindex;
+        if(mindex >= 0)
+            continue;
 
-    json_object_set_new(event, "streaming", json_string("event"));
+        SdpMediaPtr mediaPtr = sdpMedia(video);
+        if(!mediaPtr)
+            continue;
 
-    JsonPtr jsepPtr(
-        json_pack("{ssss}",
-            "type", "offer",
-            "sdp", sdp));
-    json_t* jsep = jsepPtr.get();
+        mindex = session->mediaSections.size();
+        session->mediaSections.emplace_back(MediaSection{this, video, std::move(mediaPtr)});
+    }
 
-    _janus->push_event(
-        janusSession, _plugin,
-        transaction.c_str(), event, jsep);
+    PushOffer(_janus, _plugin, janusSession, transaction);
+}
+
+std::vector<MountPointTap::Stream> MountPoint::tapStreams() const
+{
+    std::vector<MountPointTap::Stream> streams;
+    for(unsigned i = 0; i < _streams.size(); ++i) {
+        const Stream& s = _streams[i];
+        if(RestreamAs::None == s.restreamAs || s.layer > 0)
+            continue;
+
+        streams.push_back(
+            MountPointTap::Stream{
+                i,
+                RestreamAs::Video == s.restreamAs,
+                _media->streamCaps(i)});
+    }
+
+    return streams;
 }
 
 void MountPoint::mediaPrepared()
 {
+    PROBE1(media_prepared, this);
+
     const bool restreamVideo = _flags & RESTREAM_VIDEO;
     const bool restreamAudio = _flags & RESTREAM_AUDIO;
 
     const std::vector<Media::Stream> streams = _media->streams();
 
     _streams.resize(streams.size());
+    _maxLayer = 0;
 
     bool videoFound = false, audioFound = false;
+    bool videoLayers = false; // renditions of restreamed video follow it
     for(unsigned i = 0; i < streams.size(); ++i) {
         const Media::Stream& stream = streams[i];
-        if(restreamVideo && !videoFound && Media::StreamType::Video == stream.type) {
+        _streams[i].layer = stream.layer;
+
+        if(Media::StreamType::Video == stream.type && stream.layer > 0) {
+            if(videoLayers) {
+                _streams[i].restreamAs = RestreamAs::Video;
+                _maxLayer = std::max(_maxLayer, stream.layer);
+            } else
+                _streams[i].restreamAs = RestreamAs::None;
+        } else if(restreamVideo && !videoFound && Media::StreamType::Video == stream.type) {
             _streams[i].restreamAs = RestreamAs::Video;
             videoFound = true;
         } else if(restreamAudio && !audioFound && Media::StreamType::Audio == stream.type) {
@@ -201,12 +354,272 @@ void MountPoint::mediaPrepared()
         } else {
             _streams[i].restreamAs = RestreamAs::None;
         }
+
+        if(Media::StreamType::Video == stream.type && 0 == stream.layer)
+            videoLayers = RestreamAs::Video == _streams[i].restreamAs;
+
+        _streams[i].codec =
+            RestreamAs::Video == _streams[i].restreamAs ?
+                H26xCodecFromEncodingName(stream.encodingName.c_str()) :
+                H26xCodec::None;
+        _streams[i].vp8 =
+            RestreamAs::Video == _streams[i].restreamAs &&
+            0 == g_ascii_strcasecmp(stream.encodingName.c_str(), "VP8");
+
+        gint clockRate = 0;
+        const GstCaps* caps = _media->streamCaps(i);
+        if(caps && !gst_caps_is_empty(caps))
+            gst_structure_get_int(gst_caps_get_structure(caps, 0), "clock-rate", &clockRate);
+        _streams[i].clockRate = clockRate > 0 ? clockRate : 90000;
+
+        _streams[i].gopFrames = 0;
+        _streams[i].lastGopFrames = 0;
+        _streams[i].gopNonReference = false;
+        _streams[i].referenceChain = false;
+
+        // FU-A and STAP-A are not allowed in single NAL unit mode
+        const gchar* packetizationMode =
+            caps && !gst_caps_is_empty(caps) ?
+                gst_structure_get_string(gst_caps_get_structure(caps, 0), "packetization-mode") :
+                nullptr;
+        const bool canRepacketize =
+            H26xCodec::H265 == _streams[i].codec ||
+            (H26xCodec::H264 == _streams[i].codec && 0 == g_strcmp0(packetizationMode, "1"));
+        _streams[i].repacketizerPtr.reset(
+            _mediaConfig.mtu && canRepacketize ?
+                new H26xRepacketizer(_streams[i].codec, _mediaConfig.mtu) :
+                nullptr);
+    }
+
+    // after reconnect viewers have to wait for key frame again
+    for(const Client& client: _clients) {
+        for(const TrackPtr& trackPtr: { client.videoTrackPtr, client.audioTrackPtr }) {
+            if(!trackPtr)
+                continue;
+
+            std::lock_guard<std::mutex> lock(trackPtr->guard);
+            trackPtr->activeLayer = -1;
+        }
+    }
+
+    if(!_taps.empty()) {
+        const std::vector<MountPointTap::Stream> streams = tapStreams();
+        for(MountPointTap* tap: _taps)
+            tap->mediaPrepared(streams);
     }
 
+    _videoSdpMediaPtr = buildSdpMedia(true);
+    _audioSdpMediaPtr = buildSdpMedia(false);
+
     _prepared = true; // FIXME! protect from reordering
 
-    for(const Client& client: _clients)
+    for(Client& client: _clients)
         pushSdp(client.janusSessionPtr.get(), client.transaction);
+
+    if(_deferredSwitches.empty())
+        return;
+
+    std::deque<DeferredSwitch> deferredSwitches;
+    deferredSwitches.swap(_deferredSwitches);
+    for(const DeferredSwitch& deferredSwitch: deferredSwitches) {
+        janus_plugin_session* janusSession = deferredSwitch.janusSessionPtr.get();
+        // session could be destroyed meanwhile
+        if(janusSession->plugin_handle)
+            deferredSwitch.retry(janusSession, deferredSwitch.transaction);
+    }
+
+    // none of viewers was switched
+    if(_clients.empty() && !keepsMedia())
+        releaseMedia();
+}
+
+void MountPoint::beginReleaseMedia()
+{
+    if(_media)
+        _media->beginShutdown();
+}
+
+void MountPoint::releaseMedia()
+{
+    if(_media) {
+        parkMedia();
+        _streams.clear();
+        _prepared = false;
+        _videoSdpMediaPtr.reset();
+        _audioSdpMediaPtr.reset();
+    }
+    assert(_streams.empty() && !_prepared);
+}
+
+unsigned MountPoint::selectLayer(const ViewerOptions& options) const
+{
+    if(options.layer >= 0)
+        return std::min<unsigned>(options.layer, _maxLayer);
+
+    if(!options.maxBitrate)
+        return 0;
+
+    const std::vector<MediaConfig::Rendition>& ladder = _mediaConfig.ladder;
+    for(unsigned i = 0; i < ladder.size() && i < _maxLayer; ++i) {
+        if(ladder[i].bitrate <= options.maxBitrate)
+            return i + 1;
+    }
+
+    return _maxLayer;
+}
+
+int MountPoint::layerStream(unsigned layer) const
+{
+    for(unsigned i = 0; i < _streams.size(); ++i) {
+        if(RestreamAs::Video == _streams[i].restreamAs && _streams[i].layer == layer)
+            return i;
+    }
+
+    return -1;
+}
+
+unsigned MountPoint::layerBitrate(unsigned layer) const
+{
+    const int stream = layerStream(layer);
+    if(stream >= 0 && _streams[stream].bitrate)
+        return _streams[stream].bitrate;
+
+    if(layer > 0 && layer <= _mediaConfig.ladder.size())
+        return _mediaConfig.ladder[layer - 1].bitrate;
+
+    return 0;
+}
+
+unsigned MountPoint::autoLayer(unsigned currentLayer, unsigned bitrate) const
+{
+    for(unsigned layer = 0; layer < _maxLayer; ++layer) {
+        const unsigned layerBitrate = this->layerBitrate(layer);
+        if(!layerBitrate)
+            continue;
+
+        // switch to better layer only with some headroom to avoid flapping
+        const unsigned limit =
+            layer < currentLayer ?
+                bitrate * AUTO_LAYER_UP_THRESHOLD / 100 :
+                bitrate;
+        if(layerBitrate <= limit)
+            return layer;
+    }
+
+    return _maxLayer;
+}
+
+void MountPoint::setTargetLayer(const Client& client, unsigned layer)
+{
+    if(client.videoTrackPtr->targetLayer.exchange(layer) == layer)
+        return;
+
+    JANUS_LOG(LOG_VERB, "Switching viewer of \"%s\" to layer %u\n", description().c_str(), layer);
+
+    const int stream = layerStream(layer);
+    if(_media && stream >= 0)
+        _media->requestKeyFrame(stream);
+}
+
+void MountPoint::startLayersTimer()
+{
+    if(_layersTimerPtr)
+        return;
+
+    auto update =
+         [] (gpointer userData) -> gboolean
+    {
+        MountPoint* mountPoint = static_cast<MountPoint*>(userData);
+        mountPoint->updateLayers();
+
+        return TRUE;
+    };
+
+    _layersTimerPtr.reset(g_timeout_source_new_seconds(LAYERS_UPDATE_INTERVAL));
+    GSource* timeoutSource = _layersTimerPtr.get();
+    g_source_set_callback(
+        timeoutSource,
+        (GSourceFunc) update,
+        this, nullptr);
+    g_source_attach(timeoutSource, g_main_context_get_thread_default());
+}
+
+void MountPoint::stopLayersTimer()
+{
+    if(!_layersTimerPtr)
+        return;
+
+    g_source_destroy(_layersTimerPtr.get());
+    _layersTimerPtr.reset();
+}
+
+void MountPoint::updateLayers()
+{
+    for(Stream& s: _streams) {
+        const guint64 octets = g_atomic_int_and(&s.octets, 0);
+        const unsigned bitrate = octets * 8 / 1000 / LAYERS_UPDATE_INTERVAL;
+        s.bitrate = s.bitrate ? (s.bitrate * 3 + bitrate) / 4 : bitrate;
+    }
+
+    const gint64 now = g_get_monotonic_time();
+    for(const Client& client: _clients) {
+        if(!client.videoTrackPtr || !client.options.autoLayer)
+            continue;
+
+        unsigned bitrate = GetSession(client.janusSessionPtr.get())->estimatedBitrate / 1000;
+        if(!bitrate) {
+            // receiver doesn't send REMB, so the best guess is max bitrate
+            if(now - client.autoLayerStart >= AUTO_LAYER_FEEDBACK_TIMEOUT * G_USEC_PER_SEC) {
+                ViewerOptions options = client.options;
+                options.layer = -1;
+                setTargetLayer(client, selectLayer(options));
+            }
+            continue;
+        }
+
+        if(client.options.maxBitrate)
+            bitrate = std::min(bitrate, client.options.maxBitrate);
+
+        setTargetLayer(client, autoLayer(client.videoTrackPtr->targetLayer, bitrate));
+    }
+}
+
+bool MountPoint::thin(Listiner& listiner, const Stream& s, bool parameterSets)
+{
+    if(FrameType::Unknown == s.frameType) {
+        // packets preceding the first slice of access unit
+        return parameterSets;
+    }
+
+    if(listiner.accessUnit != s.accessUnit) {
+        listiner.accessUnit = s.accessUnit;
+
+        const Thinning& thinning = listiner.thinning;
+        switch(s.frameType) {
+            case FrameType::Key:
+                listiner.dropAccessUnit = false;
+                listiner.nonReferenceFrames = 0;
+                break;
+            case FrameType::Reference:
+                // frames after dropped reference frame are not decodable till key frame
+                listiner.dropAccessUnit =
+                    thinning.keyFramesOnly ||
+                    (thinning.frameInterval > 1 &&
+                     s.referenceChain &&
+                     (s.gopFrames - 1) * thinning.frameInterval >= s.lastGopFrames);
+                break;
+            case FrameType::NonReference:
+                listiner.dropAccessUnit =
+                    thinning.keyFramesOnly ||
+                    (thinning.frameInterval > 1 &&
+                     listiner.nonReferenceFrames++ % thinning.frameInterval != 0);
+                break;
+            case FrameType::Unknown:
+                break;
+        }
+    }
+
+    return !listiner.dropAccessUnit;
 }
 
 void MountPoint::onBuffer(
@@ -221,6 +634,8 @@ void MountPoint::onBuffer(
     if(s.actionsAvailable) {
         std::deque<ListinerAction> listinersActions;
 
+        PROBE2(actions_merge_begin, this, stream);
+
         _modifyListenersGuard.lock();
         listinersActions.swap(s.listinersActions);
         s.actionsAvailable = false;
@@ -238,52 +653,255 @@ void MountPoint::onBuffer(
                 janus_plugin_session* janusSession = it->janusSessionPtr.get();
                 const auto listinerIt =
                     std::lower_bound(s.listiners.begin(), s.listiners.end(), janusSession);
+                const bool found =
+                    listinerIt != s.listiners.end() &&
+                    listinerIt->janusSessionPtr.get() == janusSession;
                 if(it->add) {
-                    if(listinerIt == s.listiners.end() || *listinerIt != it->janusSessionPtr)
-                        s.listiners.emplace(listinerIt, std::move(it->janusSessionPtr));
+                    if(!found) {
+                        s.listiners.emplace(
+                            listinerIt,
+                            Listiner{
+                                std::move(it->janusSessionPtr),
+                                it->thinning,
+                                std::move(it->trackPtr),
+                                std::move(it->deliveryPtr)});
+                    }
                 } else {
-                    if(listinerIt != s.listiners.end() && *listinerIt == janusSession)
+                    if(found)
                         s.listiners.erase(listinerIt);
                 }
                 ++it;
             }
         }
-        assert(std::is_sorted(s.listiners.begin(), s.listiners.end()));
+
+        assert(
+            std::is_sorted(s.listiners.begin(), s.listiners.end(),
+                [] (const Listiner& x, const Listiner& y) {
+                    return x.janusSessionPtr.get() < y.janusSessionPtr.get();
+                }));
+
+        s.thinningListiners =
+            std::count_if(s.listiners.begin(), s.listiners.end(),
+                [] (const Listiner& listiner) {
+                    return listiner.thinning.enabled();
+                });
+        s.trackListiners =
+            std::count_if(s.listiners.begin(), s.listiners.end(),
+                [] (const Listiner& listiner) {
+                    return listiner.trackPtr != nullptr;
+                });
+
+        PROBE3(actions_merge_end, this, stream, listinersActions.size());
     }
 
     if(RestreamAs::None == s.restreamAs)
         return;
 
+    if(s.repacketizerPtr) {
+        s.repacketizerPtr->push(
+            static_cast<const char*>(data), size,
+            [this, stream] (const char* packet, size_t packetSize) {
+                relayPacket(stream, packet, packetSize);
+            });
+    } else
+        relayPacket(stream, static_cast<const char*>(data), size);
+}
+
+void MountPoint::relayPacket(unsigned stream, const char* data, gsize size)
+{
+    Stream& s = _streams[stream];
+
+    if(size > G_MAXUINT16) {
+        JANUS_LOG(LOG_WARN, "Dropping RTP packet of %" G_GSIZE_FORMAT " bytes\n", size);
+        return;
+    }
+
+    const bool layered = RestreamAs::Video == s.restreamAs && _maxLayer > 0;
+    if(layered)
+        g_atomic_int_add(&s.octets, size);
+
+    const bool tapped = 0 == s.layer && _tapsCount > 0;
+    const bool video = RestreamAs::Video == s.restreamAs;
+    const bool keyFrameWaiters = video && _keyFrameWaiters > 0;
+
+    if(size >= sizeof(janus_rtp_header)) {
+        const janus_rtp_header* header = reinterpret_cast<const janus_rtp_header*>(data);
+        g_atomic_int_set(&s.lastSsrc, ntohl(header->ssrc));
+        g_atomic_int_set(&s.lastSeq, ntohs(header->seq_number));
+        g_atomic_int_set(&s.lastTimestamp, ntohl(header->timestamp));
+    }
+
+    char* buffer = const_cast<char*>(data);
+    const bool rewrite =
+        ((s.thinningListiners && H26xCodec::None != s.codec) || s.trackListiners) &&
+        size >= sizeof(janus_rtp_header);
+    bool thinning = false;
+    bool parameterSets = false;
+    bool keyFrameStart = false; // layer can be switched starting from this packet
+    if((rewrite || tapped || keyFrameWaiters) && size >= sizeof(janus_rtp_header)) {
+        if(rewrite) {
+            s.packet.assign(buffer, buffer + size);
+            buffer = s.packet.data();
+        }
+
+        const janus_rtp_header* header = reinterpret_cast<janus_rtp_header*>(buffer);
+        const guint32 timestamp = ntohl(header->timestamp);
+        if(!s.accessUnit || timestamp != s.accessUnitTimestamp) {
+            ++s.accessUnit;
+            s.accessUnitTimestamp = timestamp;
+            s.frameType = FrameType::Unknown;
+        }
+
+        int payloadSize = 0;
+        const char* payload = janus_rtp_payload(buffer, size, &payloadSize);
+
+        H26xPacketInfo info;
+        if(H26xCodec::None != s.codec) {
+            thinning = s.thinningListiners != 0;
+
+            if(payload &&
+               ParseH26xPayload(
+                   s.codec,
+                   reinterpret_cast<const uint8_t*>(payload), payloadSize,
+                   &info))
+            {
+                // parameter sets precede key frame slices
+                keyFrameStart =
+                    FrameType::Unknown == s.frameType &&
+                    (info.parameterSets || (info.sliceStart && info.keyFrame));
+
+                if(info.sliceStart && FrameType::Unknown == s.frameType) {
+                    s.frameType =
+                        info.keyFrame ? FrameType::Key :
+                        info.reference ? FrameType::Reference :
+                        FrameType::NonReference;
+
+                    if(FrameType::Key == s.frameType) {
+                        const bool referenceChain = s.gopFrames > 1 && !s.gopNonReference;
+                        if(referenceChain && !s.referenceChain)
+                            JANUS_LOG(LOG_VERB, "Stream has no non-reference frames, frame interval thins GOPs\n");
+
+                        s.referenceChain = referenceChain;
+                        s.lastGopFrames = s.gopFrames;
+                        s.gopFrames = 0;
+                        s.gopNonReference = false;
+                    } else if(FrameType::NonReference == s.frameType) {
+                        s.gopNonReference = true;
+                    }
+                    ++s.gopFrames;
+                }
+                parameterSets = info.parameterSets;
+            }
+        } else if(s.vp8) {
+            keyFrameStart = payload && janus_vp8_is_keyframe(payload, payloadSize);
+        } else {
+            keyFrameStart = true; // key frames can't be detected
+        }
+    }
+
+    if(tapped) {
+        std::lock_guard<std::mutex> lock(_tapsGuard);
+        for(MountPointTap* tap: _taps)
+            tap->onPacket(stream, keyFrameStart, data, size);
+    }
+
     janus_plugin_rtp rtpPacket {
-        .video = RestreamAs::Video == s.restreamAs ? TRUE : FALSE,
-        .buffer = (char*)data,
+        .video = video ? TRUE : FALSE,
+        .buffer = buffer,
         .length = static_cast<uint16_t>(size)
     };
     janus_plugin_rtp_extensions_reset(&rtpPacket.extensions);
 
-    for(JanusPluginSessionPtr& janusSession: s.listiners) {
-        _janus->relay_rtp(janusSession.get(), &rtpPacket);
+    janus_rtp_header* header = reinterpret_cast<janus_rtp_header*>(buffer);
+    const guint16 seq = rewrite ? ntohs(header->seq_number) : 0;
+    const guint32 timestamp = rewrite ? ntohl(header->timestamp) : 0;
+
+    auto relay = [&] (Listiner& listiner, RtpRewriter& rewriter) {
+        if(thinning && listiner.thinning.enabled() && !thin(listiner, s, parameterSets)) {
+            rewriter.drop();
+            return;
+        }
+
+        rewriter.rewrite(header, seq, timestamp, s.clockRate);
+        PROBE2(relay_begin, listiner.janusSessionPtr.get(), size);
+        _janus->relay_rtp(listiner.janusSessionPtr.get(), &rtpPacket);
+        PROBE1(relay_end, listiner.janusSessionPtr.get());
+    };
+
+    for(Listiner& listiner: s.listiners) {
+        Delivery& delivery = *listiner.deliveryPtr;
+        if(delivery.paused || !(video ? delivery.video : delivery.audio))
+            continue;
+
+        if(keyFrameWaiters && delivery.waitingKeyFrame) {
+            if(!keyFrameStart)
+                continue;
+
+            if(delivery.waitingKeyFrame.exchange(false))
+                --_keyFrameWaiters;
+        }
+
+#if JANUS_PLUGIN_API_VERSION >= 100
+        rtpPacket.mindex = video ? delivery.videoMindex : delivery.audioMindex;
+#endif
+
+        if(!rewrite) {
+            PROBE2(relay_begin, listiner.janusSessionPtr.get(), size);
+            _janus->relay_rtp(listiner.janusSessionPtr.get(), &rtpPacket);
+            PROBE1(relay_end, listiner.janusSessionPtr.get());
+            continue;
+        }
+
+        Track* track = listiner.trackPtr.get();
+        if(!track) {
+            relay(listiner, listiner.rewriter);
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(track->guard);
+        if(track->activeLayer != static_cast<int>(s.layer)) {
+            if(track->targetLayer != s.layer || !keyFrameStart)
+                continue;
+
+            track->activeLayer = s.layer;
+            track->rewriter.switchSource();
+        }
+
+        relay(listiner, track->rewriter);
     }
 }
 
 void MountPoint::onEos(bool error)
 {
-    _media->shutdown();
-    _media.reset();
+    parkMedia();
+    _prepared = false;
+    _videoSdpMediaPtr.reset();
+    _audioSdpMediaPtr.reset();
 
     if(_reconnectCount >= MAX_RECONNECT_COUNT - 1) {
         JANUS_LOG(LOG_ERR,
             "Max reconnect count is reached\n");
 
         pushError("fail to start streaming");
+        for(const DeferredSwitch& deferredSwitch: _deferredSwitches) {
+            pushError(
+                deferredSwitch.janusSessionPtr.get(),
+                deferredSwitch.transaction,
+                "fail to start streaming");
+        }
+        _deferredSwitches.clear();
 
         _reconnectCount = 0;
 
-        return;
+        // taps have to get media as soon as source is back
+        if(!keepsMedia())
+            return;
     }
 
     ++_reconnectCount;
 
+    PROBE2(reconnect_scheduled, this, _reconnectCount);
+
     JANUS_LOG(LOG_INFO,
         "Scheduling reconnect to  \"%s\"\n",
         description().c_str());
@@ -292,8 +910,12 @@ void MountPoint::onEos(bool error)
     {
         MountPoint* mountPoint = static_cast<MountPoint*>(userData);
         // FIXME! take into account application shutdown
-        if(!mountPoint->_clients.empty())
+        if(!mountPoint->_clients.empty() ||
+           !mountPoint->_deferredSwitches.empty() ||
+           mountPoint->keepsMedia())
+        {
             mountPoint->prepareMedia();
+        }
 
         return FALSE;
     };
@@ -312,11 +934,17 @@ void MountPoint::prepareMedia()
     if(_media)
         return;
 
-    _media = createMedia();
+    PROBE2(media_prepare, this, _parkedMedia != nullptr);
+
+    if(_parkedMedia)
+        _media = std::move(_parkedMedia);
+    else
+        _media = createMedia();
     _media->run(
         std::bind(&MountPoint::mediaPrepared, this),
         std::bind(&MountPoint::onBuffer, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
-        std::bind(&MountPoint::onEos, this, std::placeholders::_1)
+        std::bind(&MountPoint::onEos, this, std::placeholders::_1),
+        [this] (unsigned threads) { _threads = threads; }
      );
 }
 
@@ -325,9 +953,21 @@ const Media* MountPoint::media() const
     return _media.get();
 }
 
+void MountPoint::parkMedia()
+{
+    _media->shutdown();
+    if(_media->recycle())
+        _parkedMedia = std::move(_media);
+    else
+        _media.reset();
+
+    _threads = 0;
+}
+
 void MountPoint::addWatcher(
     janus_plugin_session* janusSession,
-    const std::string& transaction)
+    const std::string& transaction,
+    const ViewerOptions& options)
 {
     if(MAX_CLIENTS_COUNT >= 0 && _clients.size() >= MAX_CLIENTS_COUNT) {
         pushError(janusSession, transaction, "max clients count reached");
@@ -338,13 +978,15 @@ void MountPoint::addWatcher(
         std::lower_bound(_clients.begin(), _clients.end(), janusSession);
     if(clientIt == _clients.end() || clientIt->janusSessionPtr.get() != janusSession) {
         janus_refcount_increase(&janusSession->ref);
-        _clients.emplace(clientIt, Client{JanusPluginSessionPtr(janusSession), transaction});
+        _clients.emplace(
+            clientIt,
+            Client{JanusPluginSessionPtr(janusSession), transaction, options});
     } else {
         JANUS_LOG(LOG_ERR, "janus session already watching\n");
         return;
     }
 
-    if(media() && media()->hasSdp())
+    if(media() && _prepared)
          pushSdp(janusSession, transaction);
 }
 
@@ -359,16 +1001,63 @@ void MountPoint::startStream(
         return;
     }
 
-    std::lock_guard<std::mutex> lock(_modifyListenersGuard);
-    for(Stream& s: _streams) {
-        if(RestreamAs::None == s.restreamAs)
-            continue;
+    Client& client = *clientIt;
 
-        janus_refcount_increase(&janusSession->ref);
-        s.listinersActions.emplace_back(
-            ListinerAction{JanusPluginSessionPtr(janusSession), true});
-        s.actionsAvailable = true;
+    // repeated on every renegotiation of multistream session
+    if(client.streaming)
+        return;
+    client.streaming = true;
+
+    if(client.options.dvrOffset) {
+        if(startDvrPlayback(client))
+            return;
+
+        JANUS_LOG(LOG_WARN,
+            "Time shift is not available for \"%s\", playing live\n",
+            description().c_str());
+    }
+
+    addListiners(client);
+}
+
+void MountPoint::addListiners(Client& client)
+{
+    janus_plugin_session* janusSession = client.janusSessionPtr.get();
+
+    const unsigned layer = selectLayer(client.options);
+    // viewer is listening all layers, but relays only one of them.
+    // Thinned video is rewritten by track too, so it can be continued on switch
+    if((_maxLayer > 0 || client.options.thinning.enabled()) && !client.videoTrackPtr) {
+        client.videoTrackPtr = std::make_shared<Track>();
+        client.videoTrackPtr->targetLayer = layer;
+    }
+
+    if(_maxLayer > 0 && client.options.autoLayer) {
+        client.autoLayerStart = g_get_monotonic_time();
+        startLayersTimer();
     }
+
+    {
+        std::lock_guard<std::mutex> lock(_modifyListenersGuard);
+        for(Stream& s: _streams) {
+            if(RestreamAs::None == s.restreamAs)
+                continue;
+
+            janus_refcount_increase(&janusSession->ref);
+            s.listinersActions.emplace_back(
+                ListinerAction{
+                    JanusPluginSessionPtr(janusSession),
+                    true,
+                    client.options.thinning,
+                    RestreamAs::Video == s.restreamAs ? client.videoTrackPtr : client.audioTrackPtr,
+                    client.deliveryPtr});
+            s.actionsAvailable = true;
+        }
+    }
+
+    const int stream = layerStream(layer);
+    if(client.videoTrackPtr && _media && stream >= 0)
+        _media->requestKeyFrame(stream);
 }
 
 void MountPoint::stopStream(janus_plugin_session* janusSession)
@@ -379,16 +1068,315 @@ void MountPoint::stopStream(janus_plugin_session* janusSession)
         return;
     }
 
-    std::lock_guard<std::mutex> lock(_modifyListenersGuard);
-    for(Stream& s: _streams) {
+    clientIt->streaming = false;
+
+    if(!stopDvrPlayback(janusSession)) {
+        std::lock_guard<std::mutex> lock(_modifyListenersGuard);
+        for(Stream& s: _streams) {
+            if(RestreamAs::None == s.restreamAs)
+                continue;
+
+            janus_refcount_increase(&janusSession->ref);
+            s.listinersActions.emplace_back(
+                ListinerAction{JanusPluginSessionPtr(janusSession), false});
+            s.actionsAvailable = true;
+        }
+    }
+
+    clientIt->videoTrackPtr.reset();
+    clientIt->audioTrackPtr.reset();
+
+    if(clientIt->deliveryPtr->waitingKeyFrame.exchange(false))
+        --_keyFrameWaiters;
+}
+
+void MountPoint::switchLayer(
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    unsigned layer)
+{
+    const auto clientIt =
+        std::lower_bound(_clients.begin(), _clients.end(), janusSession);
+    if(clientIt == _clients.end() || *clientIt != janusSession) {
+        pushError(janusSession, transaction, "configure without attach");
+        return;
+    }
+
+    Client& client = *clientIt;
+    client.options.autoLayer = false;
+    client.options.layer = layer;
+
+    if(client.videoTrackPtr)
+        setTargetLayer(client, selectLayer(client.options));
+}
+
+void MountPoint::switchToAutoLayer(
+    janus_plugin_session* janusSession,
+    const std::string& transaction)
+{
+    const auto clientIt =
+        std::lower_bound(_clients.begin(), _clients.end(), janusSession);
+    if(clientIt == _clients.end() || *clientIt != janusSession) {
+        pushError(janusSession, transaction, "configure without attach");
+        return;
+    }
+
+    Client& client = *clientIt;
+    client.options.autoLayer = true;
+    client.autoLayerStart = g_get_monotonic_time();
+
+    if(client.videoTrackPtr)
+        startLayersTimer();
+}
+
+MountPoint::Client* MountPoint::findClient(
+    janus_plugin_session* janusSession,
+    const std::string& transaction)
+{
+    const auto clientIt =
+        std::lower_bound(_clients.begin(), _clients.end(), janusSession);
+    if(clientIt == _clients.end() || *clientIt != janusSession) {
+        pushError(janusSession, transaction, "configure without attach");
+        return nullptr;
+    }
+
+    return &(*clientIt);
+}
+
+// viewer can't decode video from the middle of GOP
+void MountPoint::resumeVideo(const Client& client)
+{
+    unsigned layer = 0;
+    if(client.videoTrackPtr) {
+        std::lock_guard<std::mutex> lock(client.videoTrackPtr->guard);
+        client.videoTrackPtr->activeLayer = -1;
+        layer = client.videoTrackPtr->targetLayer;
+    } else if(!client.deliveryPtr->waitingKeyFrame.exchange(true))
+        ++_keyFrameWaiters;
+
+    const int stream = layerStream(layer);
+    if(_media && stream >= 0)
+        _media->requestKeyFrame(stream);
+}
+
+void MountPoint::pause(
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    bool paused)
+{
+    Client* client = findClient(janusSession, transaction);
+    if(!client)
+        return;
+
+    if(client->deliveryPtr->paused.exchange(paused) == paused)
+        return;
+
+    if(pauseDvrPlayback(janusSession, paused))
+        return;
+
+    if(!paused && client->deliveryPtr->video)
+        resumeVideo(*client);
+}
+
+void MountPoint::enableAudio(
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    bool enable)
+{
+    Client* client = findClient(janusSession, transaction);
+    if(!client)
+        return;
+
+    client->deliveryPtr->audio = enable;
+}
+
+void MountPoint::enableVideo(
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    bool enable)
+{
+    Client* client = findClient(janusSession, transaction);
+    if(!client)
+        return;
+
+    if(!client->deliveryPtr->video.exchange(enable) && enable && !client->deliveryPtr->paused)
+        resumeVideo(*client);
+}
+
+// format of every relayed stream, viewer can be switched only between mount points with the same ones
+std::string MountPoint::relayedFormats() const
+{
+    std::string formats;
+    for(unsigned i = 0; i < _streams.size(); ++i) {
+        const Stream& s = _streams[i];
         if(RestreamAs::None == s.restreamAs)
             continue;
 
-        janus_refcount_increase(&janusSession->ref);
-        s.listinersActions.emplace_back(
-            ListinerAction{JanusPluginSessionPtr(janusSession), false});
-        s.actionsAvailable = true;
+        const GstCaps* caps = _media->streamCaps(i);
+        if(!caps || gst_caps_is_empty(caps))
+            continue;
+
+        const GstStructure* structure = gst_caps_get_structure(caps, 0);
+        const gchar* encodingName = gst_structure_get_string(structure, "encoding-name");
+        gint payloadType = 0;
+        gst_structure_get_int(structure, "payload", &payloadType);
+
+        GCharPtr formatPtr(
+            g_strdup_printf(
+                "%s/%u %s/%u/%d;",
+                RestreamAs::Video == s.restreamAs ? "video" : "audio",
+                s.layer,
+                encodingName ? encodingName : "",
+                s.clockRate,
+                payloadType));
+        formats += formatPtr.get();
+    }
+
+    return formats;
+}
+
+// viewer without track received packets of this mount point as is
+// (thinned ones are rewritten by track), so track continues RTP stream from the last of them
+MountPoint::TrackPtr MountPoint::continueTrack(RestreamAs restreamAs) const
+{
+    TrackPtr trackPtr = std::make_shared<Track>();
+    trackPtr->targetLayer = 0;
+
+    for(const Stream& s: _streams) {
+        if(s.restreamAs != restreamAs || s.layer > 0)
+            continue;
+
+        trackPtr->rewriter.continueFrom(
+            g_atomic_int_get(&s.lastSsrc),
+            g_atomic_int_get(&s.lastSeq) + SWITCH_SEQ_GAP,
+            g_atomic_int_get(&s.lastTimestamp));
+        break;
+    }
+
+    return trackPtr;
+}
+
+void MountPoint::resyncTrack(Track& track)
+{
+    std::lock_guard<std::mutex> lock(track.guard);
+    track.activeLayer = -1;
+}
+
+// tracks keep sequence numbers and timestamps continuous,
+// and start relaying from the next key frame (which is requested by addListiners)
+void MountPoint::resyncTracks(const Client& client) const
+{
+    resyncTrack(*client.videoTrackPtr);
+    resyncTrack(*client.audioTrackPtr);
+    client.videoTrackPtr->targetLayer = selectLayer(client.options);
+}
+
+bool MountPoint::isPrepared() const
+{
+    return media() && _prepared;
+}
+
+bool MountPoint::switchWatcher(
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    MountPoint* target)
+{
+    const auto clientIt =
+        std::lower_bound(_clients.begin(), _clients.end(), janusSession);
+    if(clientIt == _clients.end() || *clientIt != janusSession) {
+        pushError(janusSession, transaction, "switch without watch");
+        return false;
+    }
+
+    if(!_prepared || !target->isPrepared()) {
+        pushError(janusSession, transaction, "mount point is not ready");
+        return false;
+    }
+
+    const auto targetClientIt =
+        std::lower_bound(target->_clients.begin(), target->_clients.end(), janusSession);
+    if(targetClientIt != target->_clients.end() && *targetClientIt == janusSession) {
+        pushError(janusSession, transaction, "already watching");
+        return false;
+    }
+
+    // viewer is detached only if it can be attached to target
+    const std::string formats = relayedFormats();
+    const std::string targetFormats = target->relayedFormats();
+    if(targetFormats != formats) {
+        JANUS_LOG(LOG_ERR,
+            "Can't switch viewer to \"%s\": %s != %s\n",
+            target->description().c_str(), formats.c_str(), targetFormats.c_str());
+        pushError(janusSession, transaction, "incompatible mount point");
+        return false;
     }
+
+    // dvr playback has tracks already, so they are continued
+    stopDvrPlayback(janusSession);
+
+    Client& client = *clientIt;
+    if(!client.videoTrackPtr)
+        client.videoTrackPtr = continueTrack(RestreamAs::Video);
+    if(!client.audioTrackPtr)
+        client.audioTrackPtr = continueTrack(RestreamAs::Audio);
+
+    TrackPtr videoTrackPtr = client.videoTrackPtr;
+    TrackPtr audioTrackPtr = client.audioTrackPtr;
+    const bool streaming = client.streaming;
+    stopStream(janusSession);
+
+    Client switchedClient {
+        std::move(client.janusSessionPtr),
+        transaction,
+        client.options,
+        std::move(videoTrackPtr),
+        std::move(audioTrackPtr),
+        std::move(client.deliveryPtr)};
+    switchedClient.options.dvrOffset = 0;
+    switchedClient.streaming = streaming;
+
+    _clients.erase(clientIt);
+    if(_clients.empty()) {
+        stopLayersTimer();
+
+        if(!keepsMedia())
+            releaseMedia();
+    }
+
+    target->addSwitchedWatcher(std::move(switchedClient));
+
+    return true;
+}
+
+void MountPoint::deferSwitch(
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    const SwitchRetry& retry)
+{
+    janus_refcount_increase(&janusSession->ref);
+    _deferredSwitches.emplace_back(
+        DeferredSwitch{JanusPluginSessionPtr(janusSession), transaction, retry});
+
+    prepareMedia();
+}
+
+void MountPoint::addSwitchedWatcher(Client&& client)
+{
+    janus_plugin_session* janusSession = client.janusSessionPtr.get();
+
+    const auto clientIt =
+        std::lower_bound(_clients.begin(), _clients.end(), janusSession);
+    Client& switchedClient = *_clients.emplace(clientIt, std::move(client));
+
+    startSwitchedWatcher(switchedClient);
+}
+
+void MountPoint::startSwitchedWatcher(Client& client)
+{
+    resyncTracks(client);
+
+    if(client.streaming)
+        addListiners(client);
 }
 
 void MountPoint::removeWatcher(janus_plugin_session* janusSession)
@@ -401,12 +1389,280 @@ void MountPoint::removeWatcher(janus_plugin_session* janusSession)
         JANUS_LOG(LOG_ERR, "trying to remove not watching session\n");
 
     if(_clients.empty()) {
-        if(_media) {
-            _media->shutdown();
-            _media.reset();
-            _streams.clear();
-            _prepared = false;
+        stopLayersTimer();
+
+        if(!keepsMedia())
+            releaseMedia();
+    }
+}
+
+void MountPoint::goLive(
+    janus_plugin_session* janusSession,
+    const std::string& transaction)
+{
+    const auto clientIt =
+        std::lower_bound(_clients.begin(), _clients.end(), janusSession);
+    if(clientIt == _clients.end() || *clientIt != janusSession) {
+        pushError(janusSession, transaction, "configure without attach");
+        return;
+    }
+
+    Client& client = *clientIt;
+    client.options.dvrOffset = 0;
+
+    if(!stopDvrPlayback(janusSession))
+        return;
+
+    // live stream continues playback through the same tracks
+    resyncTracks(client);
+    addListiners(client);
+}
+
+bool MountPoint::startDvrPlayback(Client& client)
+{
+    if(!_dvrPtr)
+        return false;
+
+    const gint64 time =
+        g_get_real_time() - gint64(client.options.dvrOffset) * G_USEC_PER_SEC;
+
+    Dvr::Position position;
+    gint64 keyFrameTime;
+    if(!_dvrPtr->seek(time, &position, &keyFrameTime))
+        return false;
+
+    if(!client.videoTrackPtr)
+        client.videoTrackPtr = std::make_shared<Track>();
+    if(!client.audioTrackPtr)
+        client.audioTrackPtr = std::make_shared<Track>();
+    resyncTracks(client);
+
+    janus_plugin_session* janusSession = client.janusSessionPtr.get();
+    janus_refcount_increase(&janusSession->ref);
+    _dvrViewers.emplace_back(
+        DvrViewer{
+            JanusPluginSessionPtr(janusSession),
+            position,
+            keyFrameTime,
+            g_get_monotonic_time(),
+            client.deliveryPtr,
+            0,
+            client.videoTrackPtr,
+            client.audioTrackPtr,
+            0,
+            0,
+            0,
+            0});
+
+    startDvrTimer();
+
+    return true;
+}
+
+bool MountPoint::stopDvrPlayback(janus_plugin_session* janusSession)
+{
+    const auto it =
+        std::find_if(_dvrViewers.begin(), _dvrViewers.end(),
+            [janusSession] (const DvrViewer& viewer) {
+                return viewer.janusSessionPtr.get() == janusSession;
+            });
+    if(it == _dvrViewers.end())
+        return false;
+
+    _dvrViewers.erase(it);
+
+    if(_dvrViewers.empty())
+        stopDvrTimer();
+
+    return true;
+}
+
+// paused playback is resumed from the key frame preceding pause point
+bool MountPoint::pauseDvrPlayback(janus_plugin_session* janusSession, bool paused)
+{
+    const auto it =
+        std::find_if(_dvrViewers.begin(), _dvrViewers.end(),
+            [janusSession] (const DvrViewer& viewer) {
+                return viewer.janusSessionPtr.get() == janusSession;
+            });
+    if(it == _dvrViewers.end())
+        return false;
+
+    DvrViewer& viewer = *it;
+    const gint64 now = g_get_monotonic_time();
+    if(paused) {
+        viewer.pausedAt = now;
+        return true;
+    }
+
+    const gint64 pausedTime =
+        viewer.startTime +
+        (viewer.pausedAt - viewer.playbackStart) * _mediaConfig.dvr.catchUpSpeed / 100;
+    gint64 keyFrameTime;
+    if(_dvrPtr->seek(pausedTime, &viewer.position, &keyFrameTime))
+        viewer.startTime = keyFrameTime;
+    else
+        viewer.startTime = pausedTime;
+    viewer.playbackStart = now;
+
+    // playback is restarted from the key frame preceding already relayed records
+    resyncTrack(*viewer.videoTrackPtr);
+    resyncTrack(*viewer.audioTrackPtr);
+
+    return true;
+}
+
+void MountPoint::startDvrTimer()
+{
+    if(_dvrTimerPtr)
+        return;
+
+    auto play =
+         [] (gpointer userData) -> gboolean
+    {
+        MountPoint* mountPoint = static_cast<MountPoint*>(userData);
+        mountPoint->playDvr();
+
+        return TRUE;
+    };
+
+    _dvrTimerPtr.reset(g_timeout_source_new(DVR_PLAYBACK_INTERVAL));
+    GSource* timeoutSource = _dvrTimerPtr.get();
+    g_source_set_callback(
+        timeoutSource,
+        (GSourceFunc) play,
+        this, nullptr);
+    g_source_attach(timeoutSource, g_main_context_get_thread_default());
+}
+
+void MountPoint::stopDvrTimer()
+{
+    if(!_dvrTimerPtr)
+        return;
+
+    g_source_destroy(_dvrTimerPtr.get());
+    _dvrTimerPtr.reset();
+}
+
+// relays to every dvr viewer records due by now. Playback runs at catch up speed,
+// so viewer reaches the write head eventually and is switched to live
+void MountPoint::playDvr()
+{
+    const gint64 now = g_get_monotonic_time();
+    const unsigned speed = _mediaConfig.dvr.catchUpSpeed;
+    const bool catchingUp = speed > 100;
+
+    std::vector<janus_plugin_session*> caughtUp;
+    for(DvrViewer& viewer: _dvrViewers) {
+        const Delivery& delivery = *viewer.deliveryPtr;
+        if(delivery.paused)
+            continue;
+
+        const gint64 notLaterThan =
+            viewer.startTime + (now - viewer.playbackStart) * speed / 100;
+
+        Dvr::ReadResult result;
+        while(Dvr::ReadResult::Ok ==
+              (result = _dvrPtr->read(&viewer.position, notLaterThan, &_dvrRecord)))
+        {
+            const unsigned stream = _dvrRecord.stream;
+            if(stream >= _streams.size() || RestreamAs::None == _streams[stream].restreamAs)
+                continue;
+
+            const bool video = RestreamAs::Video == _streams[stream].restreamAs;
+            if(!(video ? delivery.video : delivery.audio))
+                continue;
+
+            // audio played faster than recorded is garbled by browser jitter buffer
+            if(!video && catchingUp)
+                continue;
+
+            std::vector<char>& packet = _dvrRecord.packet;
+            if(packet.size() < sizeof(janus_rtp_header))
+                continue;
+
+            janus_rtp_header* header = reinterpret_cast<janus_rtp_header*>(packet.data());
+            const guint32 ssrc = ntohl(header->ssrc);
+            guint32 timestamp = ntohl(header->timestamp);
+
+            Track& track = video ? *viewer.videoTrackPtr : *viewer.audioTrackPtr;
+            guint32& lastSsrc = video ? viewer.videoSsrc : viewer.audioSsrc;
+            {
+                std::lock_guard<std::mutex> lock(track.guard);
+                // the first record after seek or source reconnect
+                if(track.activeLayer != 0 || ssrc != lastSsrc) {
+                    track.activeLayer = 0;
+                    track.rewriter.switchSource();
+                    lastSsrc = ssrc;
+
+                    if(video) {
+                        viewer.videoTimestampBase = timestamp;
+                        viewer.scaledVideoTimestampBase = timestamp;
+                    }
+                }
+
+                if(video && catchingUp) {
+                    // browser renders video by timestamps, so they are compressed by speed
+                    const gint32 elapsed = static_cast<gint32>(timestamp - viewer.videoTimestampBase);
+                    const guint32 scaled =
+                        viewer.scaledVideoTimestampBase +
+                        static_cast<guint32>(gint64(elapsed) * 100 / gint64(speed));
+                    // keeps elapsed far from overflow
+                    if(elapsed > G_MAXINT32 / 2) {
+                        viewer.videoTimestampBase = timestamp;
+                        viewer.scaledVideoTimestampBase = scaled;
+                    }
+                    timestamp = scaled;
+                }
+
+                track.rewriter.rewrite(
+                    header,
+                    ntohs(header->seq_number), timestamp,
+                    _streams[stream].clockRate);
+            }
+
+            janus_plugin_rtp rtpPacket {
+                .video = video ? TRUE : FALSE,
+                .buffer = packet.data(),
+                .length = static_cast<uint16_t>(packet.size())
+            };
+            janus_plugin_rtp_extensions_reset(&rtpPacket.extensions);
+#if JANUS_PLUGIN_API_VERSION >= 100
+            rtpPacket.mindex = video ? delivery.videoMindex : delivery.audioMindex;
+#endif
+
+            PROBE2(relay_begin, viewer.janusSessionPtr.get(), rtpPacket.length);
+            _janus->relay_rtp(viewer.janusSessionPtr.get(), &rtpPacket);
+            PROBE1(relay_end, viewer.janusSessionPtr.get());
+        }
+
+        if(Dvr::ReadResult::Lost == result) {
+            // ring is shorter than requested offset, continue from the oldest key frame
+            gint64 keyFrameTime;
+            if(_dvrPtr->seek(0, &viewer.position, &keyFrameTime)) {
+                viewer.startTime = keyFrameTime;
+                viewer.playbackStart = now;
+                resyncTrack(*viewer.videoTrackPtr);
+                resyncTrack(*viewer.audioTrackPtr);
+            }
+            continue;
+        }
+
+        if(catchingUp &&
+           (Dvr::ReadResult::End == result ||
+            g_get_real_time() - notLaterThan < DVR_CATCH_UP_LAG * (G_USEC_PER_SEC / 1000)))
+        {
+            caughtUp.push_back(viewer.janusSessionPtr.get());
+        }
+    }
+
+    // live listiners continue through viewer's tracks from the next key frame
+    for(janus_plugin_session* janusSession: caughtUp) {
+        const auto clientIt =
+            std::lower_bound(_clients.begin(), _clients.end(), janusSession);
+        if(clientIt != _clients.end() && *clientIt == janusSession) {
+            JANUS_LOG(LOG_VERB, "Dvr viewer of \"%s\" caught up with live\n", description().c_str());
+            goLive(janusSession, clientIt->transaction);
         }
-        assert(_streams.empty() && !_prepared);
     }
 }
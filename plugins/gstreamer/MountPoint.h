@@ -2,14 +2,26 @@
 
 #include <deque>
 #include <mutex>
+#include <atomic>
+#include <memory>
 
 extern "C" {
 #include "janus/plugins/plugin.h"
 }
 
+#include "CxxPtr/GlibPtr.h"
 #include "CxxPtr/JanusPtr.h"
 
 #include "Media.h"
+#include "H26xRtp.h"
+#include "H26xRepacketizer.h"
+#include "RtpRewriter.h"
+#include "MountPointTap.h"
+#include "Dvr.h"
+#include "SegmentRecorder.h"
+#include "UdpForwarder.h"
+#include "RtspRepublisher.h"
+#include "HlsWriter.h"
 
 
 class MountPoint
@@ -21,29 +33,138 @@ public:
         RESTREAM_BOTH = RESTREAM_VIDEO | RESTREAM_AUDIO,
     };
 
+    struct Thinning
+    {
+        bool keyFramesOnly = false;
+        // relay only every Nth non-reference frame. 0 and 1 mean relay all.
+        // Streams without non-reference frames (IPPP) are thinned by relaying
+        // only the first 1/N of every GOP, since dropped reference frame breaks the rest of it
+        unsigned frameInterval = 0;
+
+        bool enabled() const
+            { return keyFramesOnly || frameInterval > 1; }
+    };
+
+    struct ViewerOptions
+    {
+        Thinning thinning;
+
+        // video layer to relay, -1 - select by maxBitrate
+        int layer = -1;
+        unsigned maxBitrate = 0; // kbit/s, 0 - unlimited
+        // follow receiver bandwidth estimation (limited by maxBitrate)
+        bool autoLayer = false;
+
+        // s, start from the past if mount point has dvr, 0 - live
+        unsigned dvrOffset = 0;
+    };
+
     MountPoint(
         janus_callbacks*, janus_plugin*, Flags,
+        const MediaConfig&,
         const std::string& description);
+    virtual ~MountPoint();
 
     const std::string& description() const;
 
     bool isUsed() const;
+    // media is running regardless of viewers (for taps, ...)
+    virtual bool keepsMedia() const;
+    // streaming threads of media pipeline, could be called from any thread
+    unsigned threadsCount() const;
+    const MediaConfig::Threads& threadsPlacement() const;
+
+    // taps are not owned by mount point
+    void addTap(MountPointTap*);
+    void removeTap(MountPointTap*);
 
     void prepareMedia();
+    // starts media shutdown, releaseMedia() finishes it
+    void beginReleaseMedia();
+    void releaseMedia();
+
+    // built once per media preparation and shared by offers of all viewers
+    typedef std::shared_ptr<const GstSDPMedia> SdpMediaPtr;
+    // m-line of relayed audio or video, nullptr if media is not prepared
+    SdpMediaPtr sdpMedia(bool video) const;
 
-    void addWatcher(janus_plugin_session*, const std::string& transaction);
+    void addWatcher(
+        janus_plugin_session*,
+        const std::string& transaction,
+        const ViewerOptions&);
     void startStream(janus_plugin_session*, const std::string& transaction);
     void stopStream(janus_plugin_session*);
+    // switch happens on the next key frame of target layer
+    void switchLayer(
+        janus_plugin_session*,
+        const std::string& transaction,
+        unsigned layer);
+    void switchToAutoLayer(janus_plugin_session*, const std::string& transaction);
+    // stops dvr playback
+    void goLive(janus_plugin_session*, const std::string& transaction);
+    // only stops/resumes relaying, PeerConnection is kept
+    void pause(janus_plugin_session*, const std::string& transaction, bool paused);
+    void enableAudio(janus_plugin_session*, const std::string& transaction, bool enable);
+    void enableVideo(janus_plugin_session*, const std::string& transaction, bool enable);
+    bool isPrepared() const;
+    // moves viewer to another prepared mount point relaying the same formats,
+    // PeerConnection is kept. Switch happens on the next key frame of target mount point
+    bool switchWatcher(
+        janus_plugin_session*,
+        const std::string& transaction,
+        MountPoint* target);
+    // formats can be compared only with prepared mount point, so media is prepared
+    // and switch is retried after that. Viewer keeps watching its mount point meanwhile
+    typedef std::function<void (janus_plugin_session*, const std::string& transaction)> SwitchRetry;
+    void deferSwitch(
+        janus_plugin_session*,
+        const std::string& transaction,
+        const SwitchRetry&);
     void removeWatcher(janus_plugin_session*);
 
 protected:
+    const MediaConfig& mediaConfig() const;
+
     virtual std::unique_ptr<Media> createMedia() = 0;
 
 private:
+    // viewer's video or audio, shared between streaming threads of all layers
+    // and kept while viewer is switched between mount points
+    struct Track
+    {
+        std::atomic<unsigned> targetLayer;
+
+        std::mutex guard;
+        int activeLayer = -1;
+        RtpRewriter rewriter;
+    };
+    typedef std::shared_ptr<Track> TrackPtr;
+
+    // viewer's switches, shared with its listiners in all streams
+    struct Delivery
+    {
+        // m-lines of session's PeerConnection, assigned before streaming is started
+        int videoMindex = -1;
+        int audioMindex = -1;
+
+        std::atomic<bool> paused {false};
+        std::atomic<bool> audio {true};
+        std::atomic<bool> video {true};
+        // video is relayed from key frame after resume (if there are no layers)
+        std::atomic<bool> waitingKeyFrame {false};
+    };
+    typedef std::shared_ptr<Delivery> DeliveryPtr;
+
     struct Client
     {
         JanusPluginSessionPtr janusSessionPtr;
         std::string transaction;
+        ViewerOptions options;
+        TrackPtr videoTrackPtr; // only if there are several layers, video is thinned, viewer was switched or played dvr
+        TrackPtr audioTrackPtr; // only if viewer was switched or played dvr
+        DeliveryPtr deliveryPtr = std::make_shared<Delivery>();
+        bool streaming = false;
+        gint64 autoLayerStart = 0; // monotonic time automatic layer selection was requested
     };
     friend bool operator == (const Client&, janus_plugin_session*);
     friend bool operator < (const Client&, janus_plugin_session*);
@@ -53,9 +174,56 @@ private:
     {
         JanusPluginSessionPtr janusSessionPtr;
         bool add;
+        Thinning thinning;
+        TrackPtr trackPtr;
+        DeliveryPtr deliveryPtr;
     };
     friend bool operator < (const ListinerAction&, const ListinerAction&);
 
+    enum class FrameType {
+        Unknown,
+        Key,
+        Reference,
+        NonReference,
+    };
+
+    struct Listiner
+    {
+        JanusPluginSessionPtr janusSessionPtr;
+        Thinning thinning;
+        TrackPtr trackPtr;
+        DeliveryPtr deliveryPtr;
+
+        unsigned accessUnit;
+        bool dropAccessUnit;
+        unsigned nonReferenceFrames;
+
+        RtpRewriter rewriter;
+    };
+    friend bool operator < (const Listiner&, janus_plugin_session*);
+
+    struct DvrViewer
+    {
+        JanusPluginSessionPtr janusSessionPtr;
+        Dvr::Position position;
+        gint64 startTime; // wall clock time of the first relayed record
+        gint64 playbackStart; // monotonic time
+        DeliveryPtr deliveryPtr;
+        gint64 pausedAt; // monotonic time
+
+        // records are relayed through viewer's tracks,
+        // so live stream continues playback without sequence number and timestamp jumps
+        TrackPtr videoTrackPtr;
+        TrackPtr audioTrackPtr;
+        // source SSRC of the last relayed records, changes if source was reconnected
+        guint32 videoSsrc;
+        guint32 audioSsrc;
+
+        // video timestamps are scaled from these ones while catching up
+        guint32 videoTimestampBase;
+        guint32 scaledVideoTimestampBase;
+    };
+
     enum class RestreamAs {
         None,
         Video,
@@ -65,25 +233,83 @@ private:
     struct Stream
     {
         RestreamAs restreamAs;
+        unsigned layer;
+        H26xCodec codec;
+        bool vp8;
+        guint32 clockRate;
 
         std::deque<ListinerAction> listinersActions;
         bool actionsAvailable;
 
-        std::deque<JanusPluginSessionPtr> listiners;
+        std::deque<Listiner> listiners;
+        unsigned thinningListiners;
+        unsigned trackListiners;
+
+        // current access unit, tracked only while there are thinning listiners
+        unsigned accessUnit;
+        guint32 accessUnitTimestamp;
+        FrameType frameType;
+        unsigned gopFrames; // including current one
+        unsigned lastGopFrames;
+        bool gopNonReference; // current GOP has non-reference frames
+        bool referenceChain; // the last GOP had no non-reference frames
+
+        std::vector<char> packet; // writable copy for per listiner header rewriting
+
+        std::unique_ptr<H26xRepacketizer> repacketizerPtr;
+
+        // g_atomic, header of the last packet relayed as is,
+        // switched viewer continues from it on another mount point
+        guint lastSsrc;
+        guint lastSeq;
+        guint lastTimestamp;
+
+        guint octets; // g_atomic, counted only if there are several layers
+        unsigned bitrate; // kbit/s, measured while there are auto layer viewers
     };
 
     const Media* media() const;
+    void parkMedia();
 
     void pushError(const char* errorText);
     void pushError(
         janus_plugin_session* janusSession,
         const std::string& transaction,
         const char* errorText);
+    SdpMediaPtr buildSdpMedia(bool video) const;
     void pushSdp(janus_plugin_session*, const std::string& transaction);
+    std::vector<MountPointTap::Stream> tapStreams() const;
     void mediaPrepared();
+    unsigned selectLayer(const ViewerOptions&) const;
+    int layerStream(unsigned layer) const;
+    unsigned layerBitrate(unsigned layer) const;
+    unsigned autoLayer(unsigned currentLayer, unsigned bitrate) const;
+    void setTargetLayer(const Client&, unsigned layer);
+    void startLayersTimer();
+    void stopLayersTimer();
+    void updateLayers();
+    void addListiners(Client&);
+    Client* findClient(
+        janus_plugin_session*,
+        const std::string& transaction);
+    void resumeVideo(const Client&);
+    std::string relayedFormats() const;
+    TrackPtr continueTrack(RestreamAs) const;
+    static void resyncTrack(Track&);
+    void resyncTracks(const Client&) const;
+    void addSwitchedWatcher(Client&&);
+    void startSwitchedWatcher(Client&);
+    bool startDvrPlayback(Client&);
+    bool stopDvrPlayback(janus_plugin_session*);
+    bool pauseDvrPlayback(janus_plugin_session*, bool paused);
+    void startDvrTimer();
+    void stopDvrTimer();
+    void playDvr();
+    static bool thin(Listiner&, const Stream&, bool parameterSets);
     void onBuffer(
         int stream,
         const void* data, gsize size);
+    void relayPacket(unsigned stream, const char* data, gsize size);
     void onEos(bool error);
 
 private:
@@ -94,12 +320,44 @@ private:
 
     const Flags _flags;
 
+    const MediaConfig _mediaConfig;
+
+    std::unique_ptr<Dvr> _dvrPtr;
+    std::unique_ptr<SegmentRecorder> _recorderPtr;
+    std::unique_ptr<UdpForwarder> _forwarderPtr;
+    std::unique_ptr<RtspRepublisher> _republisherPtr;
+    std::unique_ptr<HlsWriter> _hlsWriterPtr;
+    std::vector<MountPointTap*> _taps;
+    std::atomic<unsigned> _tapsCount;
+
+    std::atomic<unsigned> _keyFrameWaiters; // viewers with Delivery::waitingKeyFrame
+    std::atomic<unsigned> _threads;
+    std::mutex _tapsGuard;
+
     std::deque<Client> _clients;
 
     std::unique_ptr<Media> _media;
+    std::unique_ptr<Media> _parkedMedia; // shut down, reused instead of recreation
     unsigned _reconnectCount;
     std::deque<Stream> _streams;
+    unsigned _maxLayer;
     bool _prepared;
+    SdpMediaPtr _videoSdpMediaPtr;
+    SdpMediaPtr _audioSdpMediaPtr;
+
+    struct DeferredSwitch
+    {
+        JanusPluginSessionPtr janusSessionPtr;
+        std::string transaction;
+        SwitchRetry retry;
+    };
+    std::deque<DeferredSwitch> _deferredSwitches;
+
+    GSourcePtr _layersTimerPtr;
+
+    std::deque<DvrViewer> _dvrViewers;
+    Dvr::Record _dvrRecord;
+    GSourcePtr _dvrTimerPtr;
 
     std::mutex _modifyListenersGuard;
 };
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+#include <gst/gst.h>
+
+
+// consumer of RTP relayed by mount point, independent from viewers.
+// Mount point with taps keeps media running even without viewers.
+class MountPointTap
+{
+public:
+    struct Stream
+    {
+        unsigned index;
+        bool video;
+        const GstCaps* caps; // valid only during mediaPrepared call
+    };
+
+    virtual ~MountPointTap() {}
+
+    // called from plugin thread every time media is (re)prepared,
+    // only restreamed streams (without transcoded layers) are listed
+    virtual void mediaPrepared(const std::vector<Stream>&) {}
+
+    // called from streaming threads, so should never block.
+    // keyFrame - decoding can be started from this packet
+    virtual void onPacket(unsigned stream, bool keyFrame, const char* data, size_t size) = 0;
+};
@@ -1,7 +1,14 @@
 #pragma once
 
+#include "MediaConfig.h"
+#include "RtspMedia.h"
+
+
 struct PluginConfig
 {
     bool enableDynamicMountPoints = false;
     unsigned maxDynamicMountPoints = 10;
+    unsigned rtspServerPort = 8554; // for "rtsp_push" and republished mount points
+    RtspConfig rtsp; // defaults of "rtsp" and dynamic mount points
+    MediaConfig::Threads threads; // defaults of all mount points
 };
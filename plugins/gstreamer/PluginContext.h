@@ -1,6 +1,7 @@
 #pragma once
 
 #include <map>
+#include <mutex>
 #include <thread>
 
 extern "C" {
@@ -25,6 +26,10 @@ struct PluginContext
     QueueSourcePtr queueSourcePtr;
     std::thread mainThread;
 
+    // protects plugin_handle of sessions used from Janus threads
+    // against session destruction on plugin thread
+    std::mutex sessionsGuard;
+
     std::map<int, std::unique_ptr<MountPoint>> mountPoints;
     std::map<std::string, std::unique_ptr<MountPoint>> dynamicMountPoints;
 };
@@ -1,6 +1,7 @@
 #include "PluginMain.h"
 
 #include <cassert>
+#include <algorithm>
 
 extern "C" {
 #include "janus/debug.h"
@@ -13,10 +14,17 @@ extern "C" {
 #include "Session.h"
 #include "Request.h"
 #include "RtspMountPoint.h"
+#include "StateWorkers.h"
+#include "StoragePool.h"
 
 
 namespace {
 
+enum {
+    SHUTDOWN_TIMEOUT = 10, // s, for all media together
+    MESSAGES_POOL_CAPACITY = 256,
+};
+
 struct PluginMessage : public QueueItem
 {
     enum class Origin
@@ -28,14 +36,18 @@ struct PluginMessage : public QueueItem
     JanusPluginSessionPtr janusSessionPtr;
 };
 
-struct ClientMessage : public PluginMessage
+struct ClientMessage : public PluginMessage, public Pooled<ClientMessage>
 {
+    static StoragePool& Pool();
+
     std::string transaction;
     JsonPtr json;
 };
 
-struct JanusMessage : public PluginMessage
+struct JanusMessage : public PluginMessage, public Pooled<JanusMessage>
 {
+    static StoragePool& Pool();
+
     enum class Type
     {
         Hangup,
@@ -43,6 +55,21 @@ struct JanusMessage : public PluginMessage
     } type;
 };
 
+// never destroyed, since messages could be still queued on plugin unload
+StoragePool& ClientMessage::Pool()
+{
+    static StoragePool* pool =
+        new StoragePool("client_messages", sizeof(ClientMessage), MESSAGES_POOL_CAPACITY);
+    return *pool;
+}
+
+StoragePool& JanusMessage::Pool()
+{
+    static StoragePool* pool =
+        new StoragePool("janus_messages", sizeof(JanusMessage), MESSAGES_POOL_CAPACITY);
+    return *pool;
+}
+
 }
 
 static void StopWatching(janus_plugin_session* janusSession)
@@ -50,6 +77,12 @@ static void StopWatching(janus_plugin_session* janusSession)
     Session* session = GetSession(janusSession);
 
     if(session->watching) {
+        for(MountPoint* mountPoint: session->subscriptions) {
+            mountPoint->stopStream(janusSession);
+            mountPoint->removeWatcher(janusSession);
+        }
+        session->subscriptions.clear();
+
         session->watching->stopStream(janusSession);
 
         session->watching->removeWatcher(janusSession);
@@ -58,12 +91,55 @@ static void StopWatching(janus_plugin_session* janusSession)
             Context().dynamicMountPoints.erase(session->watching->description());
 
         session->watching = nullptr;
+        session->mediaSections.clear();
         session->sdpSessionId.reset();
+        session->sdpVersion = 0;
 
         Context().janus->close_pc(janusSession);
     }
 }
 
+static MountPoint::ViewerOptions ParseViewerOptions(const JsonPtr& message)
+{
+    MountPoint::ViewerOptions options;
+    if(json_t* jsonKeyFramesOnly = json_object_get(message.get(), "keyframes_only"))
+        options.thinning.keyFramesOnly = json_is_true(jsonKeyFramesOnly);
+    if(json_t* jsonFrameInterval = json_object_get(message.get(), "frame_interval")) {
+        const json_int_t frameInterval = json_integer_value(jsonFrameInterval);
+        if(frameInterval > 0)
+            options.thinning.frameInterval = frameInterval;
+    }
+    if(json_t* jsonLayer = json_object_get(message.get(), "layer")) {
+        if(json_is_string(jsonLayer) && 0 == strcasecmp(json_string_value(jsonLayer), "auto")) {
+            options.autoLayer = true;
+        } else {
+            const json_int_t layer = json_integer_value(jsonLayer);
+            if(layer >= 0)
+                options.layer = layer;
+        }
+    }
+    if(json_t* jsonMaxBitrate = json_object_get(message.get(), "max_bitrate")) {
+        const json_int_t maxBitrate = json_integer_value(jsonMaxBitrate);
+        if(maxBitrate > 0)
+            options.maxBitrate = maxBitrate;
+    }
+    if(json_t* jsonOffset = json_object_get(message.get(), "offset")) {
+        const json_int_t offset = json_integer_value(jsonOffset);
+        if(offset > 0)
+            options.dvrOffset = offset;
+    }
+
+    return options;
+}
+
+static MediaConfig DynamicMediaConfig()
+{
+    MediaConfig mediaConfig;
+    mediaConfig.threads = Context().config.threads;
+
+    return mediaConfig;
+}
+
 static void HandleWatchMessage(
     janus_plugin_session* janusSession,
     const std::string& transaction,
@@ -133,6 +209,8 @@ static void HandleWatchMessage(
         return;
     }
 
+    const MountPoint::ViewerOptions options = ParseViewerOptions(message);
+
     Session* session = GetSession(janusSession);
     if(session->watching) {
         if((id >= 0 && session->watching != mountPoint) ||
@@ -171,7 +249,9 @@ static void HandleWatchMessage(
                             new RtspMountPoint(
                                 context.janus, context.janusPlugin.get(),
                                 mrl,
+                                context.config.rtsp,
                                 MountPoint::RESTREAM_BOTH,
+                                DynamicMediaConfig(),
                                 mrl))
                         ).first;
                 mountPoint = it->second.get();
@@ -197,7 +277,7 @@ static void HandleWatchMessage(
         if(!session->sdpSessionId)
             session->sdpSessionId.reset(g_strdup_printf("%" PRId64, janus_get_real_time()));
 
-        mountPoint->addWatcher(janusSession, transaction);
+        mountPoint->addWatcher(janusSession, transaction, options);
 
         session->watching = mountPoint;
 
@@ -220,6 +300,8 @@ static void HandleStartMessage(
     }
 
     session->watching->startStream(janusSession, transaction);
+    for(MountPoint* mountPoint: session->subscriptions)
+        mountPoint->startStream(janusSession, transaction);
 }
 
 static void HandleStopMessage(
@@ -239,6 +321,278 @@ static void HandleStopMessage(
     StopWatching(janusSession);
 }
 
+static void HandleConfigureMessage(
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    const JsonPtr& message)
+{
+    PluginContext& context = Context();
+
+    Session* session = GetSession(janusSession);
+
+    if(!session->watching) {
+        JANUS_LOG(LOG_ERR, "%s: trying to configure without watch\n", GetPluginName());
+        PushError(
+            context.janus,
+            context.janusPlugin.get(),
+            janusSession,
+            transaction,
+            "configure without watch");
+        return;
+    }
+
+    if(json_t* jsonLayer = json_object_get(message.get(), "layer")) {
+        if(json_is_string(jsonLayer) && 0 == strcasecmp(json_string_value(jsonLayer), "auto")) {
+            session->watching->switchToAutoLayer(janusSession, transaction);
+        } else if(json_is_integer(jsonLayer) && json_integer_value(jsonLayer) >= 0) {
+            session->watching->switchLayer(janusSession, transaction, json_integer_value(jsonLayer));
+        } else {
+            JANUS_LOG(LOG_ERR, "%s: invalid layer\n", GetPluginName());
+            PushError(
+                context.janus,
+                context.janusPlugin.get(),
+                janusSession,
+                transaction,
+                "invalid layer");
+        }
+    }
+
+    if(json_is_true(json_object_get(message.get(), "live")))
+        session->watching->goLive(janusSession, transaction);
+
+    if(json_t* jsonPaused = json_object_get(message.get(), "paused"))
+        session->watching->pause(janusSession, transaction, json_is_true(jsonPaused));
+    if(json_t* jsonAudio = json_object_get(message.get(), "audio"))
+        session->watching->enableAudio(janusSession, transaction, json_is_true(jsonAudio));
+    if(json_t* jsonVideo = json_object_get(message.get(), "video"))
+        session->watching->enableVideo(janusSession, transaction, json_is_true(jsonVideo));
+}
+
+static void SwitchWatcher(
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    MountPoint* target)
+{
+    PluginContext& context = Context();
+
+    Session* session = GetSession(janusSession);
+
+    if(!session->watching) {
+        JANUS_LOG(LOG_ERR, "%s: trying to switch without watch\n", GetPluginName());
+        PushError(
+            context.janus,
+            context.janusPlugin.get(),
+            janusSession,
+            transaction,
+            "switch without watch");
+        return;
+    }
+
+    if(target == session->watching) {
+        PushResult(context.janus, context.janusPlugin.get(), janusSession, transaction, "ok");
+        return;
+    }
+
+    const auto& subscriptions = session->subscriptions;
+    if(std::find(subscriptions.begin(), subscriptions.end(), target) != subscriptions.end()) {
+        JANUS_LOG(LOG_ERR, "%s: trying to switch to subscribed mount point\n", GetPluginName());
+        PushError(
+            context.janus,
+            context.janusPlugin.get(),
+            janusSession,
+            transaction,
+            "already watching");
+        return;
+    }
+
+    // target is not dynamic, so it's alive until retry
+    if(!target->isPrepared()) {
+        target->deferSwitch(
+            janusSession, transaction,
+            [target] (janus_plugin_session* janusSession, const std::string& transaction) {
+                SwitchWatcher(janusSession, transaction, target);
+            });
+        // "ok" follows when target is prepared
+        PushResult(context.janus, context.janusPlugin.get(), janusSession, transaction, "deferred");
+        return;
+    }
+
+    MountPoint* source = session->watching;
+    if(!source->switchWatcher(janusSession, transaction, target))
+        return;
+
+    // PeerConnection and sdpSessionId are kept
+    if(session->dynamicMountPointWatching && !source->isUsed())
+        context.dynamicMountPoints.erase(source->description());
+
+    session->watching = target;
+    session->dynamicMountPointWatching = false;
+
+    for(MediaSection& section: session->mediaSections) {
+        if(section.mountPoint == source)
+            section.mountPoint = target;
+    }
+
+    PushResult(context.janus, context.janusPlugin.get(), janusSession, transaction, "ok");
+}
+
+static void HandleSwitchMessage(
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    const JsonPtr& message)
+{
+    PluginContext& context = Context();
+
+    MountPoint* target = nullptr;
+    if(json_t* jsonId = json_object_get(message.get(), "id")) {
+        const json_int_t id = json_integer_value(jsonId);
+        auto it = context.mountPoints.find(id);
+        if(context.mountPoints.end() != it)
+            target = it->second.get();
+    }
+
+    if(!target) {
+        JANUS_LOG(LOG_ERR, "%s: unknown mount point id to switch to\n", GetPluginName());
+        PushError(
+            context.janus,
+            context.janusPlugin.get(),
+            janusSession,
+            transaction,
+            "unknown mount point id");
+        return;
+    }
+
+    SwitchWatcher(janusSession, transaction, target);
+}
+
+static MountPoint* FindMountPoint(
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    const JsonPtr& message)
+{
+    PluginContext& context = Context();
+
+    if(json_t* jsonId = json_object_get(message.get(), "id")) {
+        auto it = context.mountPoints.find(json_integer_value(jsonId));
+        if(context.mountPoints.end() != it)
+            return it->second.get();
+    }
+
+    JANUS_LOG(LOG_ERR, "%s: unknown mount point id\n", GetPluginName());
+    PushError(
+        context.janus,
+        context.janusPlugin.get(),
+        janusSession,
+        transaction,
+        "unknown mount point id");
+
+    return nullptr;
+}
+
+static void HandleSubscribeMessage(
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    const JsonPtr& message)
+{
+    PluginContext& context = Context();
+
+    Session* session = GetSession(janusSession);
+
+    if(!session->watching) {
+        JANUS_LOG(LOG_ERR, "%s: trying to subscribe without watch\n", GetPluginName());
+        PushError(
+            context.janus,
+            context.janusPlugin.get(),
+            janusSession,
+            transaction,
+            "subscribe without watch");
+        return;
+    }
+
+#if JANUS_PLUGIN_API_VERSION < 100
+    JANUS_LOG(LOG_ERR, "%s: multistream requires newer Janus\n", GetPluginName());
+    PushError(
+        context.janus,
+        context.janusPlugin.get(),
+        janusSession,
+        transaction,
+        "multistream is not supported");
+#else
+    MountPoint* mountPoint = FindMountPoint(janusSession, transaction, message);
+    if(!mountPoint)
+        return;
+
+    std::vector<MountPoint*>& subscriptions = session->subscriptions;
+    if(mountPoint == session->watching ||
+       std::find(subscriptions.begin(), subscriptions.end(), mountPoint) != subscriptions.end())
+    {
+        JANUS_LOG(LOG_ERR,
+            "%s: already watching \"%s\".\n",
+            GetPluginName(),
+            mountPoint->description().c_str());
+        PushError(
+            context.janus,
+            context.janusPlugin.get(),
+            janusSession,
+            transaction,
+            "already watching");
+        return;
+    }
+
+    // new m-lines are offered as soon as mount point media is prepared
+    subscriptions.push_back(mountPoint);
+    mountPoint->addWatcher(janusSession, transaction, ParseViewerOptions(message));
+    mountPoint->prepareMedia();
+
+    PushResult(context.janus, context.janusPlugin.get(), janusSession, transaction, "ok");
+#endif
+}
+
+static void HandleUnsubscribeMessage(
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    const JsonPtr& message)
+{
+    PluginContext& context = Context();
+
+    Session* session = GetSession(janusSession);
+
+    MountPoint* mountPoint = FindMountPoint(janusSession, transaction, message);
+    if(!mountPoint)
+        return;
+
+    std::vector<MountPoint*>& subscriptions = session->subscriptions;
+    const auto it = std::find(subscriptions.begin(), subscriptions.end(), mountPoint);
+    if(it == subscriptions.end()) {
+        JANUS_LOG(LOG_ERR, "%s: trying to unsubscribe not subscribed mount point\n", GetPluginName());
+        PushError(
+            context.janus,
+            context.janusPlugin.get(),
+            janusSession,
+            transaction,
+            "not subscribed");
+        return;
+    }
+
+    subscriptions.erase(it);
+    mountPoint->stopStream(janusSession);
+    mountPoint->removeWatcher(janusSession);
+
+    // m-lines are kept disabled, so other ones keep their indexes
+    bool offered = false;
+    for(MediaSection& section: session->mediaSections) {
+        if(section.mountPoint == mountPoint) {
+            section.mountPoint = nullptr;
+            offered = true;
+        }
+    }
+
+    if(offered)
+        PushOffer(context.janus, context.janusPlugin.get(), janusSession, transaction);
+    else
+        PushResult(context.janus, context.janusPlugin.get(), janusSession, transaction, "ok");
+}
+
 static void HandleClientMessage(const ClientMessage& message)
 {
     const Request request = ParseRequest(message.json);
@@ -255,6 +609,22 @@ static void HandleClientMessage(const ClientMessage& message)
         JANUS_LOG(LOG_DBG, "%s: HandlePluginMessage. Request::Stop\n", GetPluginName());
         HandleStopMessage(message.janusSessionPtr.get(), message.transaction, message.json);
         break;
+    case Request::Configure:
+        JANUS_LOG(LOG_DBG, "%s: HandlePluginMessage. Request::Configure\n", GetPluginName());
+        HandleConfigureMessage(message.janusSessionPtr.get(), message.transaction, message.json);
+        break;
+    case Request::Switch:
+        JANUS_LOG(LOG_DBG, "%s: HandlePluginMessage. Request::Switch\n", GetPluginName());
+        HandleSwitchMessage(message.janusSessionPtr.get(), message.transaction, message.json);
+        break;
+    case Request::Subscribe:
+        JANUS_LOG(LOG_DBG, "%s: HandlePluginMessage. Request::Subscribe\n", GetPluginName());
+        HandleSubscribeMessage(message.janusSessionPtr.get(), message.transaction, message.json);
+        break;
+    case Request::Unsubscribe:
+        JANUS_LOG(LOG_DBG, "%s: HandlePluginMessage. Request::Unsubscribe\n", GetPluginName());
+        HandleUnsubscribeMessage(message.janusSessionPtr.get(), message.transaction, message.json);
+        break;
     case Request::Invalid:
         JANUS_LOG(LOG_DBG, "%s: HandlePluginMessage. Request::Invalid\n", GetPluginName());
         break;
@@ -275,12 +645,14 @@ static void HandleHangupMessage(janus_plugin_session* janusSession)
 
 static void HandleDestroyMessage(janus_plugin_session* janusSession)
 {
-    Session* session = GetSession(janusSession);
-    std::unique_ptr<Session> SessionPtr(session);
-
     StopWatching(janusSession);
 
-    janusSession->plugin_handle = nullptr;
+    std::unique_ptr<Session> SessionPtr;
+    {
+        std::lock_guard<std::mutex> lock(Context().sessionsGuard);
+        SessionPtr.reset(GetSession(janusSession));
+        janusSession->plugin_handle = nullptr;
+    }
 }
 
 static void HandleJanusMessage(const JanusMessage& message)
@@ -317,6 +689,9 @@ static void PluginMain()
 
     gst_init(0, nullptr);
 
+    // kept for plugin lifetime, so all media share the same workers
+    std::shared_ptr<StateWorkers> stateWorkersPtr = StateWorkers::Shared();
+
     context.mainContextPtr.reset(g_main_context_new());
     GMainContext* mainContext = context.mainContextPtr.get();
 
@@ -327,14 +702,50 @@ static void PluginMain()
 
     GMainLoop* loop = context.loopPtr.get();
 
+    // mount points with taps (dvr, ...) or publish paths are running regardless of viewers
+    for(auto& pair: context.mountPoints) {
+        if(pair.second->keepsMedia())
+            pair.second->prepareMedia();
+    }
+
     g_main_loop_run(loop);
 
+    // sources are stopped in parallel, so shutdown takes as long as the slowest of them
+    for(auto& pair: context.mountPoints)
+        pair.second->beginReleaseMedia();
+    for(auto& pair: context.dynamicMountPoints)
+        pair.second->beginReleaseMedia();
+
+    if(!stateWorkersPtr->waitAll(g_get_monotonic_time() + gint64(SHUTDOWN_TIMEOUT) * G_USEC_PER_SEC)) {
+        JANUS_LOG(LOG_ERR,
+            "%s: some media were not stopped in time, leaving them to process exit\n",
+            context.janusPlugin->get_name());
+
+        // stuck state changes still use media, workers and GStreamer, so mount points (with their media)
+        // and workers are intentionally leaked, and GStreamer is not deinitialized
+        for(auto& pair: context.mountPoints)
+            pair.second.release();
+        for(auto& pair: context.dynamicMountPoints)
+            pair.second.release();
+        context.mountPoints.clear();
+        context.dynamicMountPoints.clear();
+        new std::shared_ptr<StateWorkers>(std::move(stateWorkersPtr));
+
+        return;
+    }
+
+    // mosaics tap other mount points, so media has to be stopped before any of them is destroyed
+    for(auto& pair: context.mountPoints)
+        pair.second->releaseMedia();
+
     context.mountPoints.clear();
     context.dynamicMountPoints.clear();
 
     context.loopPtr.reset();
     context.mainContextPtr.reset();
 
+    stateWorkersPtr.reset();
+
     gst_deinit();
 }
 
@@ -382,4 +793,9 @@ void PostDestroyMessage(
     janusMessagePtr->janusSessionPtr.reset(janusSession);
     janusMessagePtr->origin = PluginMessage::Origin::Janus;
     janusMessagePtr->type = JanusMessage::Type::Destroy;
+
+    // session is destroyed on plugin thread, so its storage returns to pool
+    QueueSourcePush(
+        Context().queueSourcePtr,
+        janusMessagePtr.release());
 }
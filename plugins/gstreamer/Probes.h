@@ -0,0 +1,38 @@
+#pragma once
+
+// USDT probes of "janus_gstreamer" provider, see tools/bpftrace.
+// Disabled probe costs a single nop, but its arguments are still evaluated,
+// so only already computed values have to be passed.
+// Probes are compiled out if <sys/sdt.h> (systemtap-sdt-dev) is not available or NO_PROBES is defined
+
+#if !defined(NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef HAVE_PROBES
+
+#include <sys/sdt.h>
+
+#define PROBE0(name) \
+    STAP_PROBE(janus_gstreamer, name)
+#define PROBE1(name, arg1) \
+    STAP_PROBE1(janus_gstreamer, name, arg1)
+#define PROBE2(name, arg1, arg2) \
+    STAP_PROBE2(janus_gstreamer, name, arg1, arg2)
+#define PROBE3(name, arg1, arg2, arg3) \
+    STAP_PROBE3(janus_gstreamer, name, arg1, arg2, arg3)
+
+#else
+
+#define PROBE0(name) \
+    do {} while(0)
+#define PROBE1(name, arg1) \
+    do { (void)(arg1); } while(0)
+#define PROBE2(name, arg1, arg2) \
+    do { (void)(arg1); (void)(arg2); } while(0)
+#define PROBE3(name, arg1, arg2, arg3) \
+    do { (void)(arg1); (void)(arg2); (void)(arg3); } while(0)
+
+#endif
@@ -3,6 +3,8 @@
 #include <sys/eventfd.h>
 #include <unistd.h>
 
+#include "Probes.h"
+
 
 struct QueueSource
 {
@@ -46,8 +48,11 @@ static gboolean dispatch(GSource* source,
 
     QueueItemHandleFunc callback = reinterpret_cast<QueueItemHandleFunc>(sourceCallback);
 
-    if(gpointer item = g_async_queue_try_pop(queueSource->queue))
+    if(gpointer item = g_async_queue_try_pop(queueSource->queue)) {
+        PROBE1(queue_dispatch_begin, item);
         callback(std::unique_ptr<QueueItem>(static_cast<QueueItem*>(item)), userData);
+        PROBE1(queue_dispatch_end, item);
+    }
 
     return G_SOURCE_CONTINUE;
 }
@@ -98,6 +103,8 @@ void QueueSourcePush(QueueSourcePtr& queueSourcePtr, QueueItem* item)
 {
     g_return_if_fail(item != nullptr);
 
+    PROBE1(queue_push, item);
+
     g_async_queue_push(queueSourcePtr->queue, item);
 
     eventfd_write(queueSourcePtr->notify_fd, 1);
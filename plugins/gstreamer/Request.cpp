@@ -24,6 +24,14 @@ Request ParseRequest(const json_t* message)
         return Request::Start;
     else if(0 == strcasecmp(strRequest, "stop"))
         return Request::Stop;
+    else if(0 == strcasecmp(strRequest, "configure"))
+        return Request::Configure;
+    else if(0 == strcasecmp(strRequest, "switch"))
+        return Request::Switch;
+    else if(0 == strcasecmp(strRequest, "subscribe"))
+        return Request::Subscribe;
+    else if(0 == strcasecmp(strRequest, "unsubscribe"))
+        return Request::Unsubscribe;
     else {
         JANUS_LOG(LOG_ERR, "%s: unsupported request \"%s\"\n", GetPluginName(), strRequest);
         return Request::Invalid;
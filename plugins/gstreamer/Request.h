@@ -10,6 +10,10 @@ enum class Request
     Watch,
     Start,
     Stop,
+    Configure,
+    Switch,
+    Subscribe,
+    Unsubscribe,
 };
 
 Request ParseRequest(const json_t* message);
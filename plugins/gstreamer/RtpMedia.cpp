@@ -0,0 +1,280 @@
+#include "RtpMedia.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+extern "C" {
+#include "janus/debug.h"
+}
+
+#include "CxxPtr/GlibPtr.h"
+#include "CxxPtr/GstPtr.h"
+
+#include "WebRtcFormat.h"
+#include "RtpReceiver.h"
+#include "ShmRing.h"
+
+
+namespace {
+
+enum {
+    SOCKET_RECEIVE_BUFFER = 1024 * 1024,
+};
+
+}
+
+struct RtpMedia::Private
+{
+    Private(RtpMedia* owner, const ShmConfig& shmConfig) :
+        owner(owner), shmConfig(shmConfig) {}
+
+    RtpMedia *const owner;
+    const ShmConfig shmConfig;
+
+    GstSDPMessagePtr sdpPtr;
+
+    std::shared_ptr<RtpReceiver> receiver;
+    std::vector<int> sockets;
+
+    std::unique_ptr<ShmRing> shmRingPtr;
+    std::vector<int> mediaStreams; // m-line index -> stream, -1 if m-line is not relayed
+
+    GSourcePtr startSourcePtr;
+
+    int openSocket(const GstSDPMedia*, const GstSDPConnection*);
+    bool start();
+    bool startShmRing();
+    void closeSockets();
+};
+
+GstCaps* SdpMediaRtpCaps(const GstSDPMedia* media)
+{
+    if(!gst_sdp_media_formats_len(media))
+        return nullptr;
+
+    const gint payloadType = atoi(gst_sdp_media_get_format(media, 0));
+    GstCaps* caps = gst_sdp_media_get_caps_from_media(media, payloadType);
+    if(!caps)
+        return nullptr;
+
+    gst_sdp_media_attributes_to_caps(media, caps);
+    gst_structure_set_name(gst_caps_get_structure(caps, 0), "application/x-rtp");
+
+    return caps;
+}
+
+static bool IsMulticast(const in_addr& address)
+{
+    return IN_MULTICAST(ntohl(address.s_addr));
+}
+
+int RtpMedia::Private::openSocket(const GstSDPMedia* media, const GstSDPConnection* connection)
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(gst_sdp_media_get_port(media));
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    in_addr group = {};
+    const bool multicast =
+        connection && connection->address &&
+        1 == inet_pton(AF_INET, connection->address, &group) &&
+        IsMulticast(group);
+    if(multicast)
+        address.sin_addr = group; // to not receive other groups sent to the same port
+
+    const int socket = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(socket < 0) {
+        JANUS_LOG(LOG_ERR, "Failed to create RTP socket: %s\n", g_strerror(errno));
+        return -1;
+    }
+
+    const int reuse = 1;
+    setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    const int receiveBuffer = SOCKET_RECEIVE_BUFFER;
+    setsockopt(socket, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+
+    if(0 != bind(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address))) {
+        JANUS_LOG(LOG_ERR,
+            "Failed to bind RTP socket to port %u: %s\n",
+            gst_sdp_media_get_port(media), g_strerror(errno));
+        close(socket);
+        return -1;
+    }
+
+    if(multicast) {
+        ip_mreq request = {};
+        request.imr_multiaddr = group;
+        request.imr_interface.s_addr = htonl(INADDR_ANY);
+        if(0 != setsockopt(socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request))) {
+            JANUS_LOG(LOG_ERR,
+                "Failed to join multicast group %s: %s\n",
+                connection->address, g_strerror(errno));
+            close(socket);
+            return -1;
+        }
+    }
+
+    return socket;
+}
+
+bool RtpMedia::Private::start()
+{
+    const GstSDPMessage* sdp = sdpPtr.get();
+    if(!sdp)
+        return false;
+
+    const bool shm = !shmConfig.path.empty();
+    if(!shm)
+        receiver = RtpReceiver::Shared();
+
+    const GstSDPConnection* sessionConnection = gst_sdp_message_get_connection(sdp);
+    for(guint i = 0; i < gst_sdp_message_medias_len(sdp); ++i) {
+        const GstSDPMedia* media = gst_sdp_message_get_media(sdp, i);
+
+        const gchar* mediaType = gst_sdp_media_get_media(media);
+        const StreamType streamType =
+            0 == g_strcmp0(mediaType, "video") ? StreamType::Video :
+            0 == g_strcmp0(mediaType, "audio") ? StreamType::Audio :
+            StreamType::Unknown;
+        mediaStreams.push_back(-1);
+        if(StreamType::Unknown == streamType || !gst_sdp_media_formats_len(media))
+            continue;
+
+        GstCapsPtr capsPtr(SdpMediaRtpCaps(media));
+        if(!capsPtr)
+            continue;
+
+        GstCaps* caps = capsPtr.get();
+
+        if(!IsWebRtcCompatible(caps)) {
+            GCharPtr capsStrPtr(gst_caps_to_string(caps));
+            JANUS_LOG(LOG_WARN, "Ingested RTP is not playable by browsers: %s\n", capsStrPtr.get());
+        }
+
+        if(shm) {
+            mediaStreams.back() = owner->addRtpStream(streamType, caps);
+            continue;
+        }
+
+        const GstSDPConnection* connection =
+            gst_sdp_media_connections_len(media) ?
+                gst_sdp_media_get_connection(media, 0) :
+                sessionConnection;
+        const int socket = openSocket(media, connection);
+        if(socket < 0)
+            return false;
+        sockets.push_back(socket);
+
+        const unsigned stream = owner->addRtpStream(streamType, caps);
+        RtpMedia* owner = this->owner;
+        if(!receiver->add(socket,
+            [owner, stream] (const char* data, size_t size) {
+                owner->pushBuffer(stream, data, size);
+            }))
+        {
+            return false;
+        }
+    }
+
+    return shm ? startShmRing() : !sockets.empty();
+}
+
+bool RtpMedia::Private::startShmRing()
+{
+    shmRingPtr.reset(new ShmRing(shmConfig.path, size_t(shmConfig.size) * 1024 * 1024));
+    if(!shmRingPtr->isValid())
+        return false;
+
+    RtpMedia* owner = this->owner;
+    const std::vector<int>& mediaStreams = this->mediaStreams;
+    return shmRingPtr->start(
+        [owner, &mediaStreams] (unsigned mline, const char* data, size_t size) {
+            if(mline < mediaStreams.size() && mediaStreams[mline] >= 0)
+                owner->pushBuffer(mediaStreams[mline], data, size);
+        });
+}
+
+void RtpMedia::Private::closeSockets()
+{
+    for(int socket: sockets) {
+        if(receiver)
+            receiver->remove(socket);
+        close(socket);
+    }
+    sockets.clear();
+
+    // waits callbacks completion
+    shmRingPtr.reset();
+}
+
+
+RtpMedia::RtpMedia(
+    const std::string& sdp,
+    const ShmConfig& shmConfig,
+    const MediaConfig& config) :
+    Media(config), _p(new Private(this, shmConfig))
+{
+    GstSDPMessage* sdpMessage;
+    gst_sdp_message_new(&sdpMessage);
+    _p->sdpPtr.reset(sdpMessage);
+
+    if(GST_SDP_OK !=
+       gst_sdp_message_parse_buffer(
+           reinterpret_cast<const guint8*>(sdp.data()), sdp.size(), sdpMessage))
+    {
+        JANUS_LOG(LOG_ERR, "Failed to parse RTP mount point SDP\n");
+        _p->sdpPtr.reset();
+    }
+}
+
+RtpMedia::~RtpMedia()
+{
+    shutdown();
+}
+
+const GstSDPMessage* RtpMedia::sdp() const
+{
+    return _p->sdpPtr.get();
+}
+
+void RtpMedia::doRun()
+{
+    // callbacks can't be called from run() itself, since media can be destroyed by them
+    auto start =
+         [] (gpointer userData) -> gboolean
+    {
+        RtpMedia* self = static_cast<RtpMedia*>(userData);
+        self->_p->startSourcePtr.reset();
+
+        if(self->_p->start()) {
+            self->prepared();
+        } else {
+            self->_p->closeSockets();
+            self->eos(true);
+        }
+
+        return FALSE;
+    };
+
+    _p->startSourcePtr.reset(g_idle_source_new());
+    GSource* idleSource = _p->startSourcePtr.get();
+    g_source_set_callback(
+        idleSource,
+        (GSourceFunc) start,
+        this, nullptr);
+    g_source_attach(idleSource, g_main_context_get_thread_default());
+}
+
+void RtpMedia::shutdown()
+{
+    if(_p->startSourcePtr) {
+        g_source_destroy(_p->startSourcePtr.get());
+        _p->startSourcePtr.reset();
+    }
+
+    _p->closeSockets();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Media.h"
+
+
+struct ShmConfig
+{
+    // unix socket of shared memory ring, empty - RTP is received from UDP ports of SDP
+    std::string path;
+    unsigned size = 8; // MiB
+};
+
+// caps of RTP described by the first format of m-line, nullptr if there are no formats
+GstCaps* SdpMediaRtpCaps(const GstSDPMedia*);
+
+// receives RTP described by SDP from UDP (unicast or multicast) ports
+// or from shared memory ring of local producer (see ShmRing.h)
+// and relays it as is, without GStreamer pipeline (so without transcoding)
+class RtpMedia : public Media
+{
+    RtpMedia(const RtpMedia&) = delete;
+    RtpMedia(RtpMedia&&) = delete;
+    RtpMedia& operator = (const RtpMedia&) = delete;
+
+public:
+    RtpMedia(const std::string& sdp, const ShmConfig&, const MediaConfig&);
+    ~RtpMedia();
+
+    const GstSDPMessage* sdp() const override;
+
+    void shutdown() override;
+
+protected:
+    void doRun() override;
+
+private:
+    struct Private;
+    std::unique_ptr<Private> _p;
+};
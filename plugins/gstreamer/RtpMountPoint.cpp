@@ -0,0 +1,19 @@
+#include "RtpMountPoint.h"
+
+
+RtpMountPoint::RtpMountPoint(
+    janus_callbacks* janus, janus_plugin* plugin,
+    const std::string& sdp,
+    const ShmConfig& shmConfig,
+    Flags flags,
+    const MediaConfig& mediaConfig,
+    const std::string& description) :
+    MountPoint(janus, plugin, flags, mediaConfig, description),
+    _sdp(sdp), _shmConfig(shmConfig)
+{
+}
+
+std::unique_ptr<Media> RtpMountPoint::createMedia()
+{
+    return std::unique_ptr<Media>(new RtpMedia(_sdp, _shmConfig, mediaConfig()));
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "MountPoint.h"
+#include "RtpMedia.h"
+
+
+class RtpMountPoint : public MountPoint
+{
+public:
+    RtpMountPoint(
+        janus_callbacks*, janus_plugin*,
+        const std::string& sdp,
+        const ShmConfig&,
+        Flags,
+        const MediaConfig&,
+        const std::string& description);
+
+protected:
+    std::unique_ptr<Media> createMedia() override;
+
+private:
+    const std::string _sdp;
+    const ShmConfig _shmConfig;
+};
@@ -0,0 +1,170 @@
+#include "RtpReceiver.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <glib.h>
+
+extern "C" {
+#include "janus/debug.h"
+}
+
+
+namespace {
+
+enum {
+    RECV_BATCH = 64, // packets
+    MAX_PACKET_SIZE = 2048,
+    MAX_EVENTS = 64,
+};
+
+}
+
+std::shared_ptr<RtpReceiver> RtpReceiver::Shared()
+{
+    static std::mutex guard;
+    static std::weak_ptr<RtpReceiver> sharedReceiver;
+
+    std::lock_guard<std::mutex> lock(guard);
+
+    std::shared_ptr<RtpReceiver> receiver = sharedReceiver.lock();
+    if(!receiver) {
+        receiver = std::make_shared<RtpReceiver>();
+        sharedReceiver = receiver;
+    }
+
+    return receiver;
+}
+
+RtpReceiver::RtpReceiver() :
+    _epoll(epoll_create1(EPOLL_CLOEXEC)),
+    _stopEvent(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    _buffers(RECV_BATCH * MAX_PACKET_SIZE),
+    _iovecs(RECV_BATCH),
+    _messages(RECV_BATCH)
+{
+    for(unsigned i = 0; i < RECV_BATCH; ++i) {
+        _iovecs[i].iov_base = _buffers.data() + i * MAX_PACKET_SIZE;
+        _iovecs[i].iov_len = MAX_PACKET_SIZE;
+        _messages[i].msg_hdr.msg_iov = &_iovecs[i];
+        _messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    if(_epoll < 0 || _stopEvent < 0) {
+        JANUS_LOG(LOG_ERR, "Failed to create RTP receiver: %s\n", g_strerror(errno));
+        return;
+    }
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = _stopEvent;
+    epoll_ctl(_epoll, EPOLL_CTL_ADD, _stopEvent, &event);
+
+    _thread = std::thread(&RtpReceiver::run, this);
+}
+
+RtpReceiver::~RtpReceiver()
+{
+    if(_thread.joinable()) {
+        const uint64_t stop = 1;
+        if(write(_stopEvent, &stop, sizeof(stop)) != sizeof(stop))
+            JANUS_LOG(LOG_ERR, "Failed to stop RTP receiver: %s\n", g_strerror(errno));
+        _thread.join();
+    }
+
+    if(_stopEvent >= 0)
+        close(_stopEvent);
+    if(_epoll >= 0)
+        close(_epoll);
+}
+
+bool RtpReceiver::add(int socket, const OnPacket& onPacket)
+{
+    return add(socket, Handler{onPacket, OnReadable()});
+}
+
+bool RtpReceiver::add(int fd, const OnReadable& onReadable)
+{
+    return add(fd, Handler{OnPacket(), onReadable});
+}
+
+bool RtpReceiver::add(int fd, Handler&& handler)
+{
+    if(!_thread.joinable())
+        return false;
+
+    std::lock_guard<std::mutex> lock(_guard);
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if(0 != epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &event)) {
+        JANUS_LOG(LOG_ERR, "Failed to watch descriptor: %s\n", g_strerror(errno));
+        return false;
+    }
+
+    _handlers[fd] = std::move(handler);
+
+    return true;
+}
+
+void RtpReceiver::remove(int fd)
+{
+    std::lock_guard<std::mutex> lock(_guard);
+
+    epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+    _handlers.erase(fd);
+}
+
+void RtpReceiver::run()
+{
+    epoll_event events[MAX_EVENTS];
+    for(;;) {
+        const int count = epoll_wait(_epoll, events, MAX_EVENTS, -1);
+        if(count < 0) {
+            if(errno == EINTR)
+                continue;
+
+            JANUS_LOG(LOG_ERR, "RTP receiver failed: %s\n", g_strerror(errno));
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(_guard);
+        for(int i = 0; i < count; ++i) {
+            const int fd = events[i].data.fd;
+            if(fd == _stopEvent)
+                return;
+
+            // descriptor could be removed while epoll_wait was returning
+            auto it = _handlers.find(fd);
+            if(it == _handlers.end())
+                continue;
+
+            if(it->second.onPacket)
+                receive(fd, it->second.onPacket);
+            else
+                it->second.onReadable();
+        }
+    }
+}
+
+void RtpReceiver::receive(int socket, const OnPacket& onPacket)
+{
+    // only one batch per wake up, so busy socket doesn't starve others
+    const int count = recvmmsg(socket, _messages.data(), RECV_BATCH, MSG_DONTWAIT, nullptr);
+    if(count < 0) {
+        if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            JANUS_LOG(LOG_WARN, "Failed to receive RTP: %s\n", g_strerror(errno));
+        return;
+    }
+
+    for(int i = 0; i < count; ++i) {
+        const mmsghdr& message = _messages[i];
+        if(message.msg_hdr.msg_flags & MSG_TRUNC)
+            continue;
+
+        onPacket(static_cast<const char*>(_iovecs[i].iov_base), message.msg_len);
+    }
+}
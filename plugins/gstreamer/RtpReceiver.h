@@ -0,0 +1,57 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+
+
+// one thread reads sockets of all ingesting media, so hundreds of ingested streams
+// cost one epoll_wait and one recvmmsg per batch of packets
+class RtpReceiver
+{
+public:
+    typedef std::function<void (const char* data, size_t size)> OnPacket;
+    typedef std::function<void ()> OnReadable;
+
+    static std::shared_ptr<RtpReceiver> Shared();
+
+    RtpReceiver();
+    ~RtpReceiver();
+
+    // UDP socket, packets are read by receiver
+    bool add(int socket, const OnPacket&);
+    // any other descriptor, it's up to onReadable to read it
+    bool add(int fd, const OnReadable&);
+    // after return callback of descriptor will not be called anymore
+    void remove(int fd);
+
+private:
+    struct Handler
+    {
+        OnPacket onPacket;
+        OnReadable onReadable;
+    };
+
+    bool add(int fd, Handler&&);
+    void run();
+    void receive(int socket, const OnPacket&);
+
+private:
+    int _epoll;
+    int _stopEvent;
+
+    std::mutex _guard; // held while callbacks are called
+    std::map<int, Handler> _handlers;
+
+    // pooled ring reused for every batch, since all sockets are read from the same thread
+    std::vector<char> _buffers;
+    std::vector<iovec> _iovecs;
+    std::vector<mmsghdr> _messages;
+
+    std::thread _thread;
+};
@@ -0,0 +1,48 @@
+#include "RtpRewriter.h"
+
+#include <arpa/inet.h>
+
+
+void RtpRewriter::continueFrom(guint32 ssrc, guint16 lastSeq, guint32 lastTimestamp)
+{
+    _initialized = true;
+    _switching = true;
+
+    _ssrc = ssrc;
+    _lastSeq = lastSeq;
+    _lastTimestamp = lastTimestamp;
+    _lastTime = g_get_monotonic_time();
+}
+
+void RtpRewriter::rewrite(
+    janus_rtp_header* header,
+    guint16 seq, guint32 timestamp,
+    guint32 clockRate)
+{
+    const gint64 now = g_get_monotonic_time();
+
+    if(!_initialized) {
+        _initialized = true;
+        _ssrc = ntohl(header->ssrc);
+    } else if(_switching) {
+        _switching = false;
+
+        // RTP timestamps of different streams are unrelated,
+        // so continue from the last relayed one by wall clock
+        guint32 timestampStep =
+            static_cast<guint32>((now - _lastTime) * clockRate / G_USEC_PER_SEC);
+        if(!timestampStep)
+            timestampStep = 1;
+
+        _seqOffset = _lastSeq + 1 - seq;
+        _timestampOffset = _lastTimestamp + timestampStep - timestamp;
+    }
+
+    _lastSeq = seq + _seqOffset;
+    _lastTimestamp = timestamp + _timestampOffset;
+    _lastTime = now;
+
+    header->ssrc = htonl(_ssrc);
+    header->seq_number = htons(_lastSeq);
+    header->timestamp = htonl(_lastTimestamp);
+}
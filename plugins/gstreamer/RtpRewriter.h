@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glib.h>
+
+extern "C" {
+#include "janus/rtp.h"
+}
+
+
+// keeps SSRC, sequence numbers and timestamps continuous for a listener
+// which doesn't receive every packet or is switched between RTP streams
+class RtpRewriter
+{
+public:
+    // next rewritten packet is the first one from another RTP stream
+    void switchSource()
+        { _switching = _initialized; }
+
+    // next rewritten packet continues RTP stream
+    // which was relayed to listener without rewriting
+    void continueFrom(guint32 ssrc, guint16 lastSeq, guint32 lastTimestamp);
+
+    void drop()
+        { --_seqOffset; }
+
+    void rewrite(
+        janus_rtp_header*,
+        guint16 seq, guint32 timestamp,
+        guint32 clockRate);
+
+private:
+    bool _initialized = false;
+    bool _switching = false;
+
+    guint32 _ssrc = 0;
+    guint16 _seqOffset = 0;
+    guint32 _timestampOffset = 0;
+
+    guint16 _lastSeq = 0;
+    guint32 _lastTimestamp = 0;
+    gint64 _lastTime = 0;
+};
@@ -1,9 +1,11 @@
 #include "RtspMedia.h"
 
 #include <string>
+#include <vector>
 #include <algorithm>
 
 #include <gst/app/gstappsink.h>
+#include <gst/rtsp/gstrtsptransport.h>
 
 extern "C" {
 #include "janus/debug.h"
@@ -12,6 +14,9 @@ extern "C" {
 #include "CxxPtr/GlibPtr.h"
 #include "CxxPtr/GstPtr.h"
 
+#include "StateWorkers.h"
+#include "Probes.h"
+
 #define NO_MORE_PADS_MESSAGE "NO_MORE_PADS"
 
 
@@ -20,6 +25,7 @@ struct RtspMedia::Private
     RtspMedia *const owner;
 
     std::string mrl;
+    RtspConfig rtspConfig;
 
     GstElementPtr pipelinePtr;
     GstElement* rtspsrc;
@@ -28,12 +34,19 @@ struct RtspMedia::Private
 
     GstSDPMessagePtr sdpPtr;
 
+    std::shared_ptr<StateWorkers> stateWorkersPtr = StateWorkers::Shared();
+    StateWorkers::TransitionPtr nullTransitionPtr;
+
+    // added for rtspsrc pads, removed on recycle since pads are added again on restart
+    std::vector<GstElement*> streamSinks;
+
     void setState(GstState);
 
     void prepare();
     void pause();
     void play();
     void null();
+    void beginNull();
 
     void postMessage(const gchar*);
 
@@ -53,7 +66,11 @@ void RtspMedia::Private::setState(GstState state)
         return;
     }
 
-    switch(gst_element_set_state(pipeline, state)) {
+    PROBE2(state_change_begin, pipeline, state);
+    const GstStateChangeReturn result = gst_element_set_state(pipeline, state);
+    PROBE3(state_change_end, pipeline, state, result);
+
+    switch(result) {
         case GST_STATE_CHANGE_FAILURE:
             JANUS_LOG(LOG_ERR, "RtspMedia::Private::setState. gst_element_set_state failed\n");
             break;
@@ -109,6 +126,19 @@ void RtspMedia::Private::prepare()
         "location", mrl.c_str(),
         nullptr);
 
+    switch(rtspConfig.transport) {
+        case RtspConfig::Transport::Auto:
+            break;
+        case RtspConfig::Transport::Tcp:
+            g_object_set(rtspsrc, "protocols", GST_RTSP_LOWER_TRANS_TCP, nullptr);
+            break;
+        case RtspConfig::Transport::Udp:
+            g_object_set(rtspsrc,
+                "protocols", GST_RTSP_LOWER_TRANS_UDP | GST_RTSP_LOWER_TRANS_UDP_MCAST,
+                nullptr);
+            break;
+    }
+
     gst_bin_add(GST_BIN(pipeline), rtspsrcPtr.release());
 
     auto onBusMessageCallback =
@@ -124,6 +154,7 @@ void RtspMedia::Private::prepare()
     GSourcePtr busSourcePtr(gst_bus_create_watch(bus));
     busWatchId =
         gst_bus_add_watch(bus, onBusMessageCallback, this);
+    owner->placeThreads(bus);
 }
 
 void RtspMedia::Private::pause()
@@ -138,7 +169,17 @@ void RtspMedia::Private::play()
 
 void RtspMedia::Private::null()
 {
-    setState(GST_STATE_NULL);
+    beginNull();
+
+    stateWorkersPtr->wait(nullTransitionPtr);
+    nullTransitionPtr.reset();
+}
+
+void RtspMedia::Private::beginNull()
+{
+    // rtspsrc could wait TEARDOWN reply for seconds
+    if(pipelinePtr && !nullTransitionPtr)
+        nullTransitionPtr = stateWorkersPtr->setState(pipelinePtr.get(), GST_STATE_NULL);
 }
 
 void RtspMedia::Private::postMessage(const gchar* message)
@@ -181,12 +222,13 @@ void RtspMedia::Private::rtspSrcPadAdded(
     else if(0 == g_strcmp0(media, "audio"))
         streamType = StreamType::Audio;
 
-    GstElement* streamSink = owner->addStream(streamType);
+    GstElement* streamSink = owner->addStream(streamType, caps);
     if(!streamSink)
         return;
 
     gst_bin_add(GST_BIN(pipelinePtr.get()), streamSink);
     gst_element_set_state(streamSink, GST_STATE_PLAYING);
+    streamSinks.push_back(streamSink);
 
     GstPadPtr sinkPadPtr(gst_element_get_static_pad(streamSink, "sink"));
     GstPad* sinkPad = sinkPadPtr.get();
@@ -229,6 +271,9 @@ gboolean RtspMedia::Private::onBusMessage(GstBus* bus, GstMessage* msg)
             }
             break;
         }
+        case GST_MESSAGE_STREAM_STATUS:
+            owner->streamStatus(msg);
+            break;
         default:
             break;
     }
@@ -237,8 +282,12 @@ gboolean RtspMedia::Private::onBusMessage(GstBus* bus, GstMessage* msg)
 }
 
 
-RtspMedia::RtspMedia(const std::string& mrl) :
-    _p(new Private{.owner = this, .mrl = mrl})
+RtspMedia::RtspMedia(
+    const std::string& mrl,
+    const RtspConfig& rtspConfig,
+    const MediaConfig& config) :
+    Media(config),
+    _p(new Private{.owner = this, .mrl = mrl, .rtspConfig = rtspConfig})
 {
 }
 
@@ -255,12 +304,34 @@ const GstSDPMessage* RtspMedia::sdp() const
 
 void RtspMedia::doRun()
 {
-    _p->prepare();
+    // recycled pipeline is already built
+    if(!_p->pipelinePtr)
+        _p->prepare();
     _p->pause();
     _p->play();
 }
 
+void RtspMedia::beginShutdown()
+{
+    _p->beginNull();
+}
+
 void RtspMedia::shutdown()
 {
     _p->null();
 }
+
+bool RtspMedia::recycle()
+{
+    if(!_p->pipelinePtr || !_p->rtspsrc)
+        return false;
+
+    for(GstElement* streamSink: _p->streamSinks)
+        gst_bin_remove(GST_BIN(_p->pipelinePtr.get()), streamSink);
+    _p->streamSinks.clear();
+
+    clearStreams();
+    _p->sdpPtr.reset();
+
+    return true;
+}
@@ -3,6 +3,18 @@
 #include "Media.h"
 
 
+struct RtspConfig
+{
+    enum class Transport {
+        Auto, // UDP with fallback to TCP
+        Tcp, // interleaved, single connection task instead of socket tasks per stream
+        Udp,
+    };
+
+    Transport transport = Transport::Auto;
+};
+
+
 class RtspMedia : public Media
 {
     RtspMedia(const RtspMedia&) = delete;
@@ -10,12 +22,14 @@ class RtspMedia : public Media
     RtspMedia& operator = (const RtspMedia&) = delete;
 
 public:
-    RtspMedia(const std::string& mrl);
+    RtspMedia(const std::string& mrl, const RtspConfig&, const MediaConfig&);
     ~RtspMedia();
 
     const GstSDPMessage* sdp() const override;
 
+    void beginShutdown() override;
     void shutdown() override;
+    bool recycle() override;
 
 protected:
     void doRun() override;
@@ -6,14 +6,17 @@
 RtspMountPoint::RtspMountPoint(
     janus_callbacks* janus, janus_plugin* plugin,
     const std::string& mrl,
+    const RtspConfig& rtspConfig,
     Flags flags,
+    const MediaConfig& mediaConfig,
     const std::string& description) :
-    MountPoint(janus, plugin, flags, description),
-    _mrl(mrl)
+    MountPoint(janus, plugin, flags, mediaConfig, description),
+    _mrl(mrl),
+    _rtspConfig(rtspConfig)
 {
 }
 
 std::unique_ptr<Media> RtspMountPoint::createMedia()
 {
-    return std::unique_ptr<Media>(new RtspMedia(_mrl));
+    return std::unique_ptr<Media>(new RtspMedia(_mrl, _rtspConfig, mediaConfig()));
 }
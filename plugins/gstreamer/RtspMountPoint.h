@@ -1,6 +1,7 @@
 #pragma once
 
 #include "MountPoint.h"
+#include "RtspMedia.h"
 
 
 class RtspMountPoint : public MountPoint
@@ -9,7 +10,9 @@ public:
     RtspMountPoint(
         janus_callbacks*, janus_plugin*,
         const std::string& mrl,
+        const RtspConfig&,
         Flags,
+        const MediaConfig&,
         const std::string& description);
 
 protected:
@@ -17,4 +20,5 @@ protected:
 
 private:
     const std::string _mrl;
+    const RtspConfig _rtspConfig;
 };
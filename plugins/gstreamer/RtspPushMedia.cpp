@@ -0,0 +1,340 @@
+#include "RtspPushMedia.h"
+
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include <arpa/inet.h>
+
+#include <gst/app/gstappsink.h>
+
+extern "C" {
+#include "janus/debug.h"
+}
+
+#include "CxxPtr/GlibPtr.h"
+#include "CxxPtr/GstPtr.h"
+
+#include "RtpMedia.h"
+#include "RtpRewriter.h"
+#include "RtspServer.h"
+
+
+struct RtspPushMedia::Private
+{
+    Private(RtspPushMedia* owner, const RtspPushConfig& pushConfig) :
+        owner(owner), pushConfig(pushConfig) {}
+
+    RtspPushMedia *const owner;
+    const RtspPushConfig pushConfig;
+
+    std::shared_ptr<RtspServer> server;
+    bool pathAdded = false;
+
+    GstSDPMessagePtr sdpPtr;
+
+    struct Stream
+    {
+        unsigned index; // of Media stream
+        StreamType type;
+        std::string encodingName;
+        guint32 clockRate;
+
+        // accessed only from streaming thread, except switching
+        std::atomic<bool> switching {false};
+        RtpRewriter rewriter;
+        std::vector<char> packet;
+    };
+    std::deque<Stream> streams; // by m-line index
+
+    GstRTSPMedia* publishMedia = nullptr; // of current publisher
+
+    GSourcePtr eosSourcePtr;
+
+    GstRTSPStatusCode announce(const GstSDPMessage*);
+    bool addStreams(const GstSDPMessage*);
+    bool isSameFormats(const GstSDPMessage*) const;
+    void record(GstRTSPMedia*);
+    void onSample(Stream&, GstAppSink*);
+    void publisherLeft();
+    void dropPublisher();
+    void scheduleEos();
+};
+
+static Media::StreamType SdpMediaType(const GstSDPMedia* media)
+{
+    const gchar* mediaType = gst_sdp_media_get_media(media);
+    return
+        0 == g_strcmp0(mediaType, "video") ? Media::StreamType::Video :
+        0 == g_strcmp0(mediaType, "audio") ? Media::StreamType::Audio :
+        Media::StreamType::Unknown;
+}
+
+bool RtspPushMedia::Private::addStreams(const GstSDPMessage* sdp)
+{
+    for(guint i = 0; i < gst_sdp_message_medias_len(sdp); ++i) {
+        const GstSDPMedia* media = gst_sdp_message_get_media(sdp, i);
+
+        streams.emplace_back();
+        Stream& stream = streams.back();
+        stream.index = G_MAXUINT;
+        stream.type = SdpMediaType(media);
+        stream.clockRate = 0;
+
+        GstCapsPtr capsPtr(SdpMediaRtpCaps(media));
+        if(StreamType::Unknown == stream.type || !capsPtr)
+            continue;
+
+        const GstStructure* structure = gst_caps_get_structure(capsPtr.get(), 0);
+        if(const gchar* encodingName = gst_structure_get_string(structure, "encoding-name"))
+            stream.encodingName = encodingName;
+        gint clockRate = 0;
+        gst_structure_get_int(structure, "clock-rate", &clockRate);
+        stream.clockRate = clockRate;
+
+        stream.index = owner->addRtpStream(stream.type, capsPtr.get());
+    }
+
+    return owner->streamsCount() > 0;
+}
+
+bool RtspPushMedia::Private::isSameFormats(const GstSDPMessage* sdp) const
+{
+    if(gst_sdp_message_medias_len(sdp) != streams.size())
+        return false;
+
+    for(guint i = 0; i < streams.size(); ++i) {
+        const GstSDPMedia* media = gst_sdp_message_get_media(sdp, i);
+        if(SdpMediaType(media) != streams[i].type)
+            return false;
+        if(G_MAXUINT == streams[i].index)
+            continue;
+
+        GstCapsPtr capsPtr(SdpMediaRtpCaps(media));
+        const gchar* encodingName =
+            capsPtr ?
+                gst_structure_get_string(gst_caps_get_structure(capsPtr.get(), 0), "encoding-name") :
+                nullptr;
+        if(0 != g_strcmp0(encodingName, streams[i].encodingName.c_str()))
+            return false;
+    }
+
+    return true;
+}
+
+GstRTSPStatusCode RtspPushMedia::Private::announce(const GstSDPMessage* sdp)
+{
+    if(publishMedia) {
+        // publisher behind NAT usually reconnects before its previous session times out
+        JANUS_LOG(LOG_INFO, "New publisher of \"%s\" replaces current one\n", pushConfig.path.c_str());
+        dropPublisher();
+    }
+
+    if(!sdpPtr) {
+        if(!addStreams(sdp)) {
+            JANUS_LOG(LOG_ERR, "There are no audio or video in SDP published to \"%s\"\n", pushConfig.path.c_str());
+            streams.clear();
+            return GST_RTSP_STS_UNSUPPORTED_MEDIA_TYPE;
+        }
+
+        GstSDPMessage* copy;
+        gst_sdp_message_copy(sdp, &copy);
+        sdpPtr.reset(copy);
+
+        owner->prepared();
+
+        return GST_RTSP_STS_OK;
+    }
+
+    if(!isSameFormats(sdp)) {
+        // viewers have to renegotiate, so media is recreated and will accept next publish
+        JANUS_LOG(LOG_WARN, "Publisher of \"%s\" has changed formats\n", pushConfig.path.c_str());
+        scheduleEos();
+        return GST_RTSP_STS_SERVICE_UNAVAILABLE;
+    }
+
+    for(Stream& stream: streams)
+        stream.switching = true;
+
+    return GST_RTSP_STS_OK;
+}
+
+void RtspPushMedia::Private::record(GstRTSPMedia* media)
+{
+    if(publishMedia)
+        return;
+
+    publishMedia = media;
+    g_object_ref(publishMedia);
+
+    auto unpreparedCallback =
+        (void (*)(GstRTSPMedia*, gpointer))
+        [] (GstRTSPMedia* /*media*/, gpointer userData)
+    {
+        Private* self = static_cast<Private*>(userData);
+        self->publisherLeft();
+    };
+    g_signal_connect(media, "unprepared", G_CALLBACK(unpreparedCallback), this);
+
+    GstElementPtr elementPtr(gst_rtsp_media_get_element(media));
+    for(guint i = 0; i < streams.size(); ++i) {
+        if(G_MAXUINT == streams[i].index)
+            continue;
+
+        GCharPtr namePtr(g_strdup_printf("depay%u", i));
+        GstElementPtr appSinkPtr(gst_bin_get_by_name(GST_BIN(elementPtr.get()), namePtr.get()));
+        if(!appSinkPtr)
+            continue;
+
+        struct SinkData
+        {
+            Private* self;
+            Stream* stream;
+        };
+        auto onAppSinkSampleCallback =
+            [] (GstAppSink* appsink, gpointer userData) -> GstFlowReturn
+        {
+            SinkData* sinkData = static_cast<SinkData*>(userData);
+            sinkData->self->onSample(*sinkData->stream, appsink);
+            return GST_FLOW_OK;
+        };
+        auto destroySinkData =
+            [] (gpointer userData)
+        {
+            delete static_cast<SinkData*>(userData);
+        };
+
+        GstAppSinkCallbacks callbacks = {nullptr, nullptr, onAppSinkSampleCallback};
+        gst_app_sink_set_callbacks(
+            GST_APP_SINK(appSinkPtr.get()),
+            &callbacks,
+            new SinkData{this, &streams[i]},
+            destroySinkData);
+    }
+
+    JANUS_LOG(LOG_INFO, "Publisher of \"%s\" started recording\n", pushConfig.path.c_str());
+}
+
+// on streaming thread
+void RtspPushMedia::Private::onSample(Stream& stream, GstAppSink* appSink)
+{
+    GstSamplePtr samplePtr(gst_app_sink_pull_sample(appSink));
+    GstBuffer* buffer = gst_sample_get_buffer(samplePtr.get());
+
+    GstMapInfo mapInfo;
+    if(!buffer || !gst_buffer_map(buffer, &mapInfo, GST_MAP_READ))
+        return;
+
+    if(mapInfo.size >= sizeof(janus_rtp_header)) {
+        // RTP of all publishers is relayed as one stream
+        stream.packet.assign(mapInfo.data, mapInfo.data + mapInfo.size);
+        janus_rtp_header* header = reinterpret_cast<janus_rtp_header*>(stream.packet.data());
+        if(stream.switching.exchange(false))
+            stream.rewriter.switchSource();
+        stream.rewriter.rewrite(
+            header,
+            ntohs(header->seq_number), ntohl(header->timestamp),
+            stream.clockRate);
+
+        owner->pushBuffer(stream.index, stream.packet.data(), stream.packet.size());
+    }
+
+    gst_buffer_unmap(buffer, &mapInfo);
+}
+
+void RtspPushMedia::Private::publisherLeft()
+{
+    if(!publishMedia)
+        return;
+
+    JANUS_LOG(LOG_INFO, "Publisher of \"%s\" has left\n", pushConfig.path.c_str());
+
+    g_signal_handlers_disconnect_by_data(publishMedia, this);
+    g_object_unref(publishMedia);
+    publishMedia = nullptr;
+}
+
+void RtspPushMedia::Private::dropPublisher()
+{
+    GstRTSPMedia* media = publishMedia;
+    if(!media)
+        return;
+
+    g_object_ref(media);
+    publisherLeft();
+    // stops streaming threads
+    gst_rtsp_media_unprepare(media);
+    g_object_unref(media);
+}
+
+void RtspPushMedia::Private::scheduleEos()
+{
+    if(eosSourcePtr)
+        return;
+
+    // media can't be destroyed from RTSP server callbacks
+    auto eos =
+         [] (gpointer userData) -> gboolean
+    {
+        RtspPushMedia* self = static_cast<RtspPushMedia*>(userData);
+        self->_p->eosSourcePtr.reset();
+        self->eos(true);
+
+        return FALSE;
+    };
+
+    eosSourcePtr.reset(g_idle_source_new());
+    GSource* idleSource = eosSourcePtr.get();
+    g_source_set_callback(
+        idleSource,
+        (GSourceFunc) eos,
+        owner, nullptr);
+    g_source_attach(idleSource, g_main_context_get_thread_default());
+}
+
+
+RtspPushMedia::RtspPushMedia(const RtspPushConfig& pushConfig, const MediaConfig& config) :
+    Media(config), _p(new Private(this, pushConfig))
+{
+}
+
+RtspPushMedia::~RtspPushMedia()
+{
+    shutdown();
+}
+
+const GstSDPMessage* RtspPushMedia::sdp() const
+{
+    return _p->sdpPtr.get();
+}
+
+void RtspPushMedia::doRun()
+{
+    _p->server = RtspServer::Shared(_p->pushConfig.port);
+
+    Private* p = _p.get();
+    _p->pathAdded =
+        _p->server->addPublishPath(
+            _p->pushConfig.path,
+            _p->pushConfig.user, _p->pushConfig.password,
+            [p] (const GstSDPMessage* sdp) { return p->announce(sdp); },
+            [p] (GstRTSPMedia* media) { p->record(media); });
+    if(!_p->pathAdded)
+        _p->scheduleEos();
+}
+
+void RtspPushMedia::shutdown()
+{
+    if(_p->eosSourcePtr) {
+        g_source_destroy(_p->eosSourcePtr.get());
+        _p->eosSourcePtr.reset();
+    }
+
+    _p->dropPublisher();
+
+    if(_p->pathAdded) {
+        _p->server->removePath(_p->pushConfig.path);
+        _p->pathAdded = false;
+    }
+    _p->server.reset();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Media.h"
+
+
+struct RtspPushConfig
+{
+    unsigned port = 8554; // of embedded RTSP server, shared by all push mount points
+    std::string path; // publisher ANNOUNCEs rtsp://<host>:<port><path>
+    // Basic credentials required from publisher
+    std::string user;
+    std::string password;
+};
+
+// RTP published into embedded RTSP server (ANNOUNCE/RECORD) is relayed as is.
+// Media is prepared by the first publish, and stays alive while publisher is away,
+// next publisher continues the same RTP streams (if it publishes the same formats).
+// New publish replaces current publisher, so reconnected one isn't refused till its stale session times out
+class RtspPushMedia : public Media
+{
+    RtspPushMedia(const RtspPushMedia&) = delete;
+    RtspPushMedia(RtspPushMedia&&) = delete;
+    RtspPushMedia& operator = (const RtspPushMedia&) = delete;
+
+public:
+    RtspPushMedia(const RtspPushConfig&, const MediaConfig&);
+    ~RtspPushMedia();
+
+    const GstSDPMessage* sdp() const override;
+
+    void shutdown() override;
+
+protected:
+    void doRun() override;
+
+private:
+    struct Private;
+    std::unique_ptr<Private> _p;
+};
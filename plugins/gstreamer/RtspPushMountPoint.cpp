@@ -0,0 +1,23 @@
+#include "RtspPushMountPoint.h"
+
+
+RtspPushMountPoint::RtspPushMountPoint(
+    janus_callbacks* janus, janus_plugin* plugin,
+    const RtspPushConfig& pushConfig,
+    Flags flags,
+    const MediaConfig& mediaConfig,
+    const std::string& description) :
+    MountPoint(janus, plugin, flags, mediaConfig, description),
+    _pushConfig(pushConfig)
+{
+}
+
+bool RtspPushMountPoint::keepsMedia() const
+{
+    return true;
+}
+
+std::unique_ptr<Media> RtspPushMountPoint::createMedia()
+{
+    return std::unique_ptr<Media>(new RtspPushMedia(_pushConfig, mediaConfig()));
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "MountPoint.h"
+#include "RtspPushMedia.h"
+
+
+class RtspPushMountPoint : public MountPoint
+{
+public:
+    RtspPushMountPoint(
+        janus_callbacks*, janus_plugin*,
+        const RtspPushConfig&,
+        Flags,
+        const MediaConfig&,
+        const std::string& description);
+
+    // publish path is registered by media, so publisher is accepted even without viewers
+    bool keepsMedia() const override;
+
+protected:
+    std::unique_ptr<Media> createMedia() override;
+
+private:
+    const RtspPushConfig _pushConfig;
+};
@@ -0,0 +1,187 @@
+#include "RtspRepublisher.h"
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <gst/app/gstappsrc.h>
+
+extern "C" {
+#include "janus/debug.h"
+#include "janus/rtp.h"
+}
+
+#include "CxxPtr/GlibPtr.h"
+
+#include "RtspServer.h"
+
+
+RtspRepublisher::RtspRepublisher(const MediaConfig::Republish& config) :
+    _config(config), _pathAdded(false), _media(nullptr)
+{
+}
+
+RtspRepublisher::~RtspRepublisher()
+{
+    releaseMedia(true);
+
+    if(_pathAdded)
+        _server->removePath(_config.path);
+}
+
+void RtspRepublisher::mediaPrepared(const std::vector<Stream>& streams)
+{
+    std::string formats;
+    {
+        std::lock_guard<std::mutex> lock(_guard);
+
+        for(Source* source: { &_video, &_audio }) {
+            source->stream = -1;
+            source->capsPtr.reset();
+
+            // reconnected source starts new RTP streams
+            source->rewriter.switchSource();
+        }
+
+        for(const Stream& stream: streams) {
+            Source& source = stream.video ? _video : _audio;
+            if(source.stream >= 0 || !stream.caps || gst_caps_is_empty(stream.caps))
+                continue;
+
+            gint clockRate = 0;
+            gst_structure_get_int(gst_caps_get_structure(stream.caps, 0), "clock-rate", &clockRate);
+
+            source.stream = stream.index;
+            source.clockRate = clockRate > 0 ? clockRate : 90000;
+            source.capsPtr.reset(gst_caps_copy(stream.caps));
+
+            GCharPtr capsStrPtr(gst_caps_to_string(stream.caps));
+            formats += capsStrPtr.get();
+            formats += ";";
+        }
+    }
+
+    // clients of reconnected source with the same formats just continue receiving
+    if(_pathAdded && formats == _formats)
+        return;
+
+    releaseMedia(true);
+    if(_pathAdded) {
+        _server->removePath(_config.path);
+        _pathAdded = false;
+    }
+
+    _formats = formats;
+    if(formats.empty())
+        return;
+
+    std::string launch = "(";
+    unsigned payloader = 0;
+    for(const Source* source: { &_video, &_audio }) {
+        if(source->stream < 0)
+            continue;
+
+        // relayed RTP is payloaded already
+        launch +=
+            " appsrc name=pay" + std::to_string(payloader++) +
+            " is-live=true format=time do-timestamp=true";
+    }
+    launch += " )";
+
+    if(!_server)
+        _server = RtspServer::Shared(_config.port);
+    _pathAdded =
+        _server->addPlayPath(
+            _config.path,
+            launch,
+            std::bind(&RtspRepublisher::mediaConfigure, this, std::placeholders::_1));
+}
+
+void RtspRepublisher::mediaConfigure(GstRTSPMedia* media)
+{
+    releaseMedia(false);
+
+    GstElementPtr elementPtr(gst_rtsp_media_get_element(media));
+
+    std::lock_guard<std::mutex> lock(_guard);
+
+    unsigned payloader = 0;
+    for(Source* source: { &_video, &_audio }) {
+        if(source->stream < 0)
+            continue;
+
+        GCharPtr namePtr(g_strdup_printf("pay%u", payloader++));
+        GstElement* appSrc = gst_bin_get_by_name(GST_BIN(elementPtr.get()), namePtr.get());
+        if(!appSrc)
+            continue;
+
+        g_object_set(appSrc, "caps", source->capsPtr.get(), nullptr);
+        source->appSrc = appSrc;
+    }
+
+    _media = media;
+    g_object_ref(_media);
+
+    auto unpreparedCallback =
+        (void (*)(GstRTSPMedia*, gpointer))
+        [] (GstRTSPMedia* /*media*/, gpointer userData)
+    {
+        RtspRepublisher* self = static_cast<RtspRepublisher*>(userData);
+        self->releaseMedia(false);
+    };
+    g_signal_connect(media, "unprepared", G_CALLBACK(unpreparedCallback), this);
+}
+
+void RtspRepublisher::releaseMedia(bool unprepare)
+{
+    if(!_media)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_guard);
+        for(Source* source: { &_video, &_audio }) {
+            if(source->appSrc) {
+                gst_object_unref(source->appSrc);
+                source->appSrc = nullptr;
+            }
+        }
+    }
+
+    GstRTSPMedia* media = _media;
+    _media = nullptr;
+
+    g_signal_handlers_disconnect_by_data(media, this);
+    if(unprepare)
+        gst_rtsp_media_unprepare(media);
+    g_object_unref(media);
+}
+
+void RtspRepublisher::onPacket(unsigned stream, bool /*keyFrame*/, const char* data, size_t size)
+{
+    if(size < sizeof(janus_rtp_header))
+        return;
+
+    std::lock_guard<std::mutex> lock(_guard);
+
+    Source* source =
+        static_cast<int>(stream) == _video.stream ? &_video :
+        static_cast<int>(stream) == _audio.stream ? &_audio :
+        nullptr;
+    if(!source || !source->appSrc)
+        return;
+
+    // the only copy, then buffer is referenced by every client's sink
+    GstBuffer* buffer = gst_buffer_new_allocate(nullptr, size, nullptr);
+    GstMapInfo mapInfo;
+    gst_buffer_map(buffer, &mapInfo, GST_MAP_WRITE);
+    memcpy(mapInfo.data, data, size);
+
+    janus_rtp_header* header = reinterpret_cast<janus_rtp_header*>(mapInfo.data);
+    source->rewriter.rewrite(
+        header,
+        ntohs(header->seq_number), ntohl(header->timestamp),
+        source->clockRate);
+
+    gst_buffer_unmap(buffer, &mapInfo);
+
+    gst_app_src_push_buffer(GST_APP_SRC(source->appSrc), buffer);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gst/rtsp-server/rtsp-server.h>
+
+#include "CxxPtr/GstPtr.h"
+
+#include "MediaConfig.h"
+#include "MountPointTap.h"
+#include "RtpRewriter.h"
+
+
+class RtspServer;
+
+// serves relayed RTP (one video and one audio stream) to RTSP clients.
+// All clients share one pipeline, so every packet is copied once into GstBuffer
+// and then sent to all of them by reference.
+// SSRC, sequence numbers and timestamps are kept continuous while source is reconnected.
+class RtspRepublisher : public MountPointTap
+{
+public:
+    RtspRepublisher(const MediaConfig::Republish&);
+    ~RtspRepublisher();
+
+    void mediaPrepared(const std::vector<Stream>&) override;
+    void onPacket(unsigned stream, bool keyFrame, const char* data, size_t size) override;
+
+private:
+    struct Source
+    {
+        int stream = -1;
+        guint32 clockRate = 90000;
+        GstCapsPtr capsPtr;
+        RtpRewriter rewriter;
+        GstElement* appSrc = nullptr; // while there are clients
+    };
+
+    void mediaConfigure(GstRTSPMedia*);
+    // unprepare - disconnect clients
+    void releaseMedia(bool unprepare);
+
+private:
+    const MediaConfig::Republish _config;
+
+    std::shared_ptr<RtspServer> _server; // created on plugin thread
+    bool _pathAdded;
+    std::string _formats; // caps of served streams
+
+    GstRTSPMedia* _media; // shared by all clients
+
+    std::mutex _guard;
+    Source _video;
+    Source _audio;
+};
@@ -0,0 +1,285 @@
+#include "RtspServer.h"
+
+#include <string>
+
+extern "C" {
+#include "janus/debug.h"
+}
+
+#include "CxxPtr/GstPtr.h"
+
+
+namespace {
+
+enum {
+    // published RTP is relayed without depayloading, so jitterbuffer only has to reorder it
+    PUBLISH_LATENCY = 100, // ms
+};
+
+// role of clients without credentials
+const char *const ANONYMOUS_ROLE = "anonymous";
+
+}
+
+std::shared_ptr<RtspServer> RtspServer::Shared(unsigned port)
+{
+    // only plugin thread uses server
+    static std::map<unsigned, std::weak_ptr<RtspServer>> servers;
+
+    std::shared_ptr<RtspServer> server = servers[port].lock();
+    if(!server) {
+        server = std::make_shared<RtspServer>(port);
+        servers[port] = server;
+    }
+
+    return server;
+}
+
+RtspServer::RtspServer(unsigned port) :
+    _port(port),
+    _server(gst_rtsp_server_new()),
+    _auth(gst_rtsp_auth_new()),
+    _mountPoints(gst_rtsp_server_get_mount_points(_server))
+{
+    gst_rtsp_server_set_service(_server, std::to_string(port).c_str());
+
+    // clients without credentials are allowed only on paths having permissions for anonymous role
+    GstRTSPToken* anonymousToken =
+        gst_rtsp_token_new(GST_RTSP_TOKEN_MEDIA_FACTORY_ROLE, G_TYPE_STRING, ANONYMOUS_ROLE, nullptr);
+    gst_rtsp_auth_set_default_token(_auth, anonymousToken);
+    gst_rtsp_token_unref(anonymousToken);
+    gst_rtsp_server_set_auth(_server, _auth);
+
+    auto clientConnectedCallback =
+        (void (*)(GstRTSPServer*, GstRTSPClient*, gpointer))
+        [] (GstRTSPServer* /*server*/, GstRTSPClient* client, gpointer userData)
+    {
+        RtspServer* self = static_cast<RtspServer*>(userData);
+        self->clientConnected(client);
+    };
+    g_signal_connect(_server, "client-connected", G_CALLBACK(clientConnectedCallback), this);
+
+    GError* error = nullptr;
+    _sourcePtr.reset(gst_rtsp_server_create_source(_server, nullptr, &error));
+    GErrorPtr errorPtr(error);
+    if(!_sourcePtr) {
+        JANUS_LOG(LOG_ERR,
+            "Failed to start RTSP server on port %u: %s\n",
+            port, error ? error->message : "");
+        return;
+    }
+
+    g_source_attach(_sourcePtr.get(), g_main_context_get_thread_default());
+
+    JANUS_LOG(LOG_INFO, "RTSP server is listening on port %u\n", port);
+}
+
+RtspServer::~RtspServer()
+{
+    if(_sourcePtr) {
+        g_source_destroy(_sourcePtr.get());
+        _sourcePtr.reset();
+    }
+
+    auto closeClient =
+        [] (GstRTSPServer*, GstRTSPClient*, gpointer) -> GstRTSPFilterResult
+    {
+        return GST_RTSP_FILTER_REMOVE;
+    };
+    g_list_free(gst_rtsp_server_client_filter(_server, closeClient, nullptr));
+
+    g_signal_handlers_disconnect_by_data(_server, this);
+
+    g_object_unref(_mountPoints);
+    g_object_unref(_auth);
+    g_object_unref(_server);
+}
+
+bool RtspServer::addPublishPath(
+    const std::string& path,
+    const std::string& user, const std::string& password,
+    const OnAnnounce& onAnnounce,
+    const OnMedia& onRecord)
+{
+    if(user.empty()) {
+        JANUS_LOG(LOG_ERR, "RTSP server publish path \"%s\" has no credentials\n", path.c_str());
+        return false;
+    }
+
+    const std::string userPassword = user + ":" + password;
+    GCharPtr basicPtr(
+        g_base64_encode(reinterpret_cast<const guchar*>(userPassword.data()), userPassword.size()));
+
+    // paths with the same credentials share role, so credentials of one path don't open another one
+    GCharPtr hashPtr(g_compute_checksum_for_string(G_CHECKSUM_SHA256, basicPtr.get(), -1));
+    const std::string role = std::string("publisher-") + hashPtr.get();
+
+    GstRTSPMediaFactory* factory = gst_rtsp_media_factory_new();
+    gst_rtsp_media_factory_set_transport_mode(factory, GST_RTSP_TRANSPORT_MODE_RECORD);
+    gst_rtsp_media_factory_set_latency(factory, PUBLISH_LATENCY);
+    gst_rtsp_media_factory_add_role(
+        factory, role.c_str(),
+        GST_RTSP_PERM_MEDIA_FACTORY_ACCESS, G_TYPE_BOOLEAN, TRUE,
+        GST_RTSP_PERM_MEDIA_FACTORY_CONSTRUCT, G_TYPE_BOOLEAN, TRUE,
+        nullptr);
+
+    if(!addPath(path, factory, basicPtr.get(), onAnnounce, onRecord))
+        return false;
+
+    GstRTSPToken* token =
+        gst_rtsp_token_new(GST_RTSP_TOKEN_MEDIA_FACTORY_ROLE, G_TYPE_STRING, role.c_str(), nullptr);
+    gst_rtsp_auth_add_basic(_auth, basicPtr.get(), token);
+    gst_rtsp_token_unref(token);
+
+    return true;
+}
+
+bool RtspServer::addPlayPath(
+    const std::string& path,
+    const std::string& launch,
+    const OnMedia& onMedia)
+{
+    // all clients are served by the same pipeline
+    GstRTSPMediaFactory* factory = gst_rtsp_media_factory_new();
+    gst_rtsp_media_factory_set_shared(factory, TRUE);
+    gst_rtsp_media_factory_set_launch(factory, launch.c_str());
+    gst_rtsp_media_factory_add_role(
+        factory, ANONYMOUS_ROLE,
+        GST_RTSP_PERM_MEDIA_FACTORY_ACCESS, G_TYPE_BOOLEAN, TRUE,
+        GST_RTSP_PERM_MEDIA_FACTORY_CONSTRUCT, G_TYPE_BOOLEAN, TRUE,
+        nullptr);
+
+    return addPath(path, factory, std::string(), OnAnnounce(), onMedia);
+}
+
+bool RtspServer::addPath(
+    const std::string& path,
+    GstRTSPMediaFactory* factory,
+    const std::string& basic,
+    const OnAnnounce& onAnnounce,
+    const OnMedia& onMedia)
+{
+    if(!_sourcePtr || _paths.find(path) != _paths.end()) {
+        if(_sourcePtr)
+            JANUS_LOG(LOG_ERR, "RTSP server path \"%s\" is already used\n", path.c_str());
+        g_object_unref(factory);
+        return false;
+    }
+
+    Path& serverPath = _paths[path];
+    serverPath = Path{factory, onAnnounce, onMedia, basic};
+
+    auto mediaConfigureCallback =
+        (void (*)(GstRTSPMediaFactory*, GstRTSPMedia*, gpointer))
+        [] (GstRTSPMediaFactory* /*factory*/, GstRTSPMedia* media, gpointer userData)
+    {
+        const Path* serverPath = static_cast<const Path*>(userData);
+        serverPath->onMedia(media);
+    };
+    // std::map doesn't move its elements
+    g_signal_connect(factory, "media-configure", G_CALLBACK(mediaConfigureCallback), &serverPath);
+
+    gst_rtsp_mount_points_add_factory(_mountPoints, path.c_str(), factory);
+
+    return true;
+}
+
+void RtspServer::removePath(const std::string& path)
+{
+    auto it = _paths.find(path);
+    if(it == _paths.end())
+        return;
+
+    // factory is still referenced by medias of connected clients
+    g_signal_handlers_disconnect_by_data(it->second.factory, &it->second);
+    gst_rtsp_mount_points_remove_factory(_mountPoints, path.c_str());
+
+    const std::string basic = it->second.basic;
+    _paths.erase(it);
+
+    if(basic.empty())
+        return;
+
+    for(const auto& pair: _paths) {
+        if(pair.second.basic == basic)
+            return;
+    }
+    gst_rtsp_auth_remove_basic(_auth, basic.c_str());
+}
+
+void RtspServer::clientConnected(GstRTSPClient* client)
+{
+    auto preAnnounceCallback =
+        (GstRTSPStatusCode (*)(GstRTSPClient*, GstRTSPContext*, gpointer))
+        [] (GstRTSPClient* /*client*/, GstRTSPContext* context, gpointer userData) -> GstRTSPStatusCode
+    {
+        RtspServer* self = static_cast<RtspServer*>(userData);
+        return self->preAnnounce(context);
+    };
+    g_signal_connect(client, "pre-announce-request", G_CALLBACK(preAnnounceCallback), this);
+}
+
+static bool IsAuthorized(const GstRTSPMessage* request, const std::string& basic)
+{
+    gchar* authorization = nullptr;
+    if(GST_RTSP_OK != gst_rtsp_message_get_header(request, GST_RTSP_HDR_AUTHORIZATION, &authorization, 0) ||
+       !authorization)
+    {
+        return false;
+    }
+
+    const char scheme[] = "Basic ";
+    if(0 != g_ascii_strncasecmp(authorization, scheme, sizeof(scheme) - 1))
+        return false;
+
+    const gchar* credentials = authorization + sizeof(scheme) - 1;
+    while(*credentials == ' ')
+        ++credentials;
+
+    return basic == credentials;
+}
+
+// media is not created yet, so it's the last chance to make its pipeline match published SDP
+GstRTSPStatusCode RtspServer::preAnnounce(GstRTSPContext* context)
+{
+    if(!context->uri || !context->uri->abspath)
+        return GST_RTSP_STS_NOT_FOUND;
+
+    auto it = _paths.find(context->uri->abspath);
+    if(it == _paths.end() || !it->second.onAnnounce)
+        return GST_RTSP_STS_NOT_FOUND;
+
+    // ANNOUNCE is authorized by GstRTSPAuth only after this signal,
+    // so publish from unknown client must not touch mount point.
+    // GstRTSPAuth rejects it later, with authentication challenge
+    if(!IsAuthorized(context->request, it->second.basic))
+        return GST_RTSP_STS_OK;
+
+    guint8* body = nullptr;
+    guint bodySize = 0;
+    gst_rtsp_message_get_body(context->request, &body, &bodySize);
+
+    GstSDPMessage* sdp;
+    gst_sdp_message_new(&sdp);
+    GstSDPMessagePtr sdpPtr(sdp);
+    if(!body || GST_SDP_OK != gst_sdp_message_parse_buffer(body, bodySize, sdp)) {
+        JANUS_LOG(LOG_ERR, "Failed to parse SDP published to \"%s\"\n", it->first.c_str());
+        return GST_RTSP_STS_BAD_REQUEST;
+    }
+
+    const GstRTSPStatusCode status = it->second.onAnnounce(sdp);
+    if(GST_RTSP_STS_OK != status)
+        return status;
+
+    std::string launch = "(";
+    for(guint i = 0; i < gst_sdp_message_medias_len(sdp); ++i) {
+        // not linked appsinks must not block preroll
+        launch += " appsink name=depay" + std::to_string(i) + " sync=false async=false";
+    }
+    launch += " )";
+    gst_rtsp_media_factory_set_launch(it->second.factory, launch.c_str());
+
+    JANUS_LOG(LOG_INFO, "Accepted RTSP publish to \"%s\"\n", it->first.c_str());
+
+    return GST_RTSP_STS_OK;
+}
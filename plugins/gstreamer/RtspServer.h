@@ -0,0 +1,68 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <gst/rtsp-server/rtsp-server.h>
+
+#include "CxxPtr/GlibPtr.h"
+
+
+// RTSP server accepting publishes (ANNOUNCE/RECORD) and serving clients (PLAY) on registered paths.
+// Shared by all mount points using the same port, and lives on plugin thread.
+// RTP of every m-line of published SDP goes into appsink named "depay<m-line index>".
+// Publish paths require Basic credentials of their own, play paths are open for everyone
+class RtspServer
+{
+    RtspServer(const RtspServer&) = delete;
+    RtspServer& operator = (const RtspServer&) = delete;
+
+public:
+    // returns GST_RTSP_STS_OK to accept publish
+    typedef std::function<GstRTSPStatusCode (const GstSDPMessage*)> OnAnnounce;
+    // media is created for publisher or (shared) for clients
+    typedef std::function<void (GstRTSPMedia*)> OnMedia;
+
+    static std::shared_ptr<RtspServer> Shared(unsigned port);
+
+    explicit RtspServer(unsigned port);
+    ~RtspServer();
+
+    bool addPublishPath(
+        const std::string& path,
+        const std::string& user, const std::string& password,
+        const OnAnnounce&, const OnMedia&);
+    // launch - gst-rtsp-server launch line, with payloaders named "pay<N>"
+    bool addPlayPath(const std::string& path, const std::string& launch, const OnMedia&);
+    void removePath(const std::string& path);
+
+private:
+    struct Path
+    {
+        GstRTSPMediaFactory* factory; // owned by mount points
+        OnAnnounce onAnnounce; // only for publish paths
+        OnMedia onMedia;
+        std::string basic; // base64 of "user:password", only for publish paths
+    };
+
+    bool addPath(
+        const std::string& path,
+        GstRTSPMediaFactory*,
+        const std::string& basic,
+        const OnAnnounce&, const OnMedia&);
+
+    void clientConnected(GstRTSPClient*);
+    GstRTSPStatusCode preAnnounce(GstRTSPContext*);
+
+private:
+    const unsigned _port;
+
+    GstRTSPServer* _server;
+    GstRTSPAuth* _auth;
+    GstRTSPMountPoints* _mountPoints;
+    GSourcePtr _sourcePtr;
+
+    std::map<std::string, Path> _paths;
+};
@@ -0,0 +1,537 @@
+#include "SegmentRecorder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <thread>
+
+extern "C" {
+#include "janus/debug.h"
+}
+
+#include "CxxPtr/GlibPtr.h"
+
+
+namespace {
+
+enum {
+    DIRECT_IO_ALIGNMENT = 4096,
+    BUFFER_SIZE = 1024 * 1024,
+    BUFFERS_PER_STREAM = 4,
+    PREALLOCATE_SIZE = 16 * 1024 * 1024,
+    RTPDUMP_FILE_HEADER_SIZE = 16,
+    RTPDUMP_PACKET_HEADER_SIZE = 8,
+};
+
+const char RtpDumpMagic[] = "#!rtpplay1.0 0.0.0.0/0\n";
+
+void PutUint16(guint8* data, guint16 value)
+{
+    data[0] = value >> 8;
+    data[1] = value;
+}
+
+void PutUint32(guint8* data, guint32 value)
+{
+    data[0] = value >> 24;
+    data[1] = value >> 16;
+    data[2] = value >> 8;
+    data[3] = value;
+}
+
+}
+
+struct SegmentRecorder::Job
+{
+    SegmentRecorder* recorder = nullptr;
+    unsigned stream = 0;
+    std::string path; // new file to open before writing
+    std::string caps;
+    char* buffer = nullptr;
+    size_t size = 0;
+    bool close = false; // close file after writing
+    bool rotate = false; // delete segments above limit
+    unsigned dropped = 0;
+    std::promise<void>* done = nullptr;
+};
+
+class SegmentWriter
+{
+public:
+    static std::shared_ptr<SegmentWriter> Shared();
+
+    SegmentWriter();
+    ~SegmentWriter();
+
+    void push(SegmentRecorder::Job&&);
+
+private:
+    void run();
+
+private:
+    std::mutex _guard;
+    std::condition_variable _jobAvailable;
+    std::deque<SegmentRecorder::Job> _jobs;
+    bool _stop;
+
+    std::thread _thread;
+};
+
+// one thread serves all recorders, so disk sees sequential batches instead of many small writes
+std::shared_ptr<SegmentWriter> SegmentWriter::Shared()
+{
+    static std::mutex guard;
+    static std::weak_ptr<SegmentWriter> sharedWriter;
+
+    std::lock_guard<std::mutex> lock(guard);
+
+    std::shared_ptr<SegmentWriter> writer = sharedWriter.lock();
+    if(!writer) {
+        writer = std::make_shared<SegmentWriter>();
+        sharedWriter = writer;
+    }
+
+    return writer;
+}
+
+SegmentWriter::SegmentWriter() :
+    _stop(false), _thread(&SegmentWriter::run, this)
+{
+}
+
+SegmentWriter::~SegmentWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(_guard);
+        _stop = true;
+    }
+    _jobAvailable.notify_one();
+
+    _thread.join();
+}
+
+void SegmentWriter::push(SegmentRecorder::Job&& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(_guard);
+        _jobs.emplace_back(std::move(job));
+    }
+    _jobAvailable.notify_one();
+}
+
+void SegmentWriter::run()
+{
+    for(;;) {
+        std::unique_lock<std::mutex> lock(_guard);
+        _jobAvailable.wait(lock, [this] () { return _stop || !_jobs.empty(); });
+        if(_jobs.empty())
+            return;
+
+        SegmentRecorder::Job job = std::move(_jobs.front());
+        _jobs.pop_front();
+        lock.unlock();
+
+        job.recorder->process(job);
+    }
+}
+
+
+SegmentRecorder::SegmentRecorder(const MediaConfig::Record& config) :
+    _config(config), _writer(SegmentWriter::Shared()),
+    _indexStream(-1), _segmentStarted(false), _segmentStart(0), _dropped(0)
+{
+    if(0 != g_mkdir_with_parents(config.path.c_str(), 0755)) {
+        JANUS_LOG(LOG_ERR,
+            "Failed to create recording directory \"%s\": %s\n",
+            config.path.c_str(), g_strerror(errno));
+    }
+}
+
+SegmentRecorder::~SegmentRecorder()
+{
+    std::promise<void> done;
+    {
+        std::lock_guard<std::mutex> lock(_guard);
+
+        finishSegment();
+
+        Job job;
+        job.done = &done;
+        submit(std::move(job));
+    }
+    done.get_future().wait();
+
+    for(char* buffer: _buffers)
+        free(buffer);
+}
+
+void SegmentRecorder::mediaPrepared(const std::vector<Stream>& streams)
+{
+    // segments start from video key frame if there is video at all
+    int indexStream = -1;
+    std::vector<Track> tracks;
+    for(const Stream& stream: streams) {
+        if(stream.video || indexStream < 0)
+            indexStream = stream.index;
+
+        if(stream.index >= tracks.size())
+            tracks.resize(stream.index + 1);
+
+        GCharPtr capsPtr(stream.caps ? gst_caps_to_string(stream.caps) : nullptr);
+        tracks[stream.index].recorded = true;
+        tracks[stream.index].caps = capsPtr ? capsPtr.get() : "";
+    }
+
+    std::lock_guard<std::mutex> lock(_guard);
+
+    // streams could be changed by reconnect, so files of current segment don't match them anymore
+    finishSegment();
+
+    _indexStream = indexStream;
+    _tracks = std::move(tracks);
+
+    // every recorded stream has its own share of buffers
+    while(_buffers.size() < streams.size() * BUFFERS_PER_STREAM) {
+        void* buffer = nullptr;
+        if(0 != posix_memalign(&buffer, DIRECT_IO_ALIGNMENT, BUFFER_SIZE))
+            break;
+
+        _buffers.push_back(static_cast<char*>(buffer));
+        _freeBuffers.push_back(static_cast<char*>(buffer));
+    }
+}
+
+void SegmentRecorder::onPacket(unsigned stream, bool keyFrame, const char* data, size_t size)
+{
+    if(size > G_MAXUINT16 - RTPDUMP_PACKET_HEADER_SIZE)
+        return;
+
+    const gint64 now = g_get_real_time();
+
+    std::lock_guard<std::mutex> lock(_guard);
+
+    const bool segmentEnd =
+        !_segmentStarted ||
+        now - _segmentStart >= gint64(_config.segmentDuration) * G_USEC_PER_SEC;
+    if(segmentEnd && keyFrame && static_cast<int>(stream) == _indexStream) {
+        if(!startSegment(now)) {
+            ++_dropped;
+            return;
+        }
+    }
+
+    if(!_segmentStarted)
+        return; // waiting for key frame
+
+    if(stream >= _tracks.size() || !_tracks[stream].recorded)
+        return;
+
+    const size_t recordSize = RTPDUMP_PACKET_HEADER_SIZE + size;
+    if(!canAppend(_tracks[stream], recordSize)) {
+        ++_dropped;
+        return;
+    }
+
+    guint8 header[RTPDUMP_PACKET_HEADER_SIZE];
+    PutUint16(header, recordSize);
+    PutUint16(header + 2, size);
+    PutUint32(header + 4, (now - _segmentStart) / 1000);
+
+    append(stream, header, sizeof(header));
+    append(stream, data, size);
+}
+
+bool SegmentRecorder::startSegment(gint64 time)
+{
+    finishSegment();
+
+    // every file takes a buffer for its header
+    unsigned recordedCount = 0;
+    for(const Track& track: _tracks) {
+        if(track.recorded)
+            ++recordedCount;
+    }
+    if(_freeBuffers.size() < recordedCount)
+        return false;
+
+    GDateTime* dateTime = g_date_time_new_from_unix_local(time / G_USEC_PER_SEC);
+    GCharPtr startPtr(g_date_time_format(dateTime, "%Y%m%d-%H%M%S"));
+    g_date_time_unref(dateTime);
+
+    guint8 fileHeader[RTPDUMP_FILE_HEADER_SIZE] = {};
+    PutUint32(fileHeader, time / G_USEC_PER_SEC);
+    PutUint32(fileHeader + 4, time % G_USEC_PER_SEC);
+
+    for(unsigned i = 0; i < _tracks.size(); ++i) {
+        if(!_tracks[i].recorded)
+            continue;
+
+        GCharPtr namePtr(g_strdup_printf("%s.%u.rtpdump", startPtr.get(), i));
+
+        Job job;
+        job.stream = i;
+        job.path = GCharPtr(g_build_filename(_config.path.c_str(), namePtr.get(), NULL)).get();
+        job.caps = _tracks[i].caps + "\n";
+        submit(std::move(job));
+
+        append(i, RtpDumpMagic, sizeof(RtpDumpMagic) - 1);
+        append(i, fileHeader, sizeof(fileHeader));
+    }
+
+    if(_config.maxSegments) {
+        Job job;
+        job.rotate = true;
+        submit(std::move(job));
+    }
+
+    _segmentStarted = true;
+    _segmentStart = time;
+
+    return true;
+}
+
+void SegmentRecorder::finishSegment()
+{
+    if(!_segmentStarted)
+        return;
+
+    for(unsigned i = 0; i < _tracks.size(); ++i) {
+        Track& track = _tracks[i];
+        if(!track.recorded)
+            continue;
+
+        Job job;
+        job.stream = i;
+        job.buffer = track.buffer;
+        job.size = track.bufferSize;
+        job.close = true;
+        submit(std::move(job));
+
+        track.buffer = nullptr;
+        track.bufferSize = 0;
+    }
+
+    if(_dropped) {
+        Job job;
+        job.dropped = _dropped;
+        submit(std::move(job));
+    }
+
+    _dropped = 0;
+    _segmentStarted = false;
+}
+
+bool SegmentRecorder::canAppend(const Track& track, size_t size) const
+{
+    const size_t available =
+        (track.buffer ? BUFFER_SIZE - track.bufferSize : 0) + _freeBuffers.size() * BUFFER_SIZE;
+    return size <= available;
+}
+
+// records can span buffers, so every buffer except the last one of file
+// is written completely, as O_DIRECT requires
+void SegmentRecorder::append(unsigned stream, const void* data, size_t size)
+{
+    Track& track = _tracks[stream];
+
+    const char* bytes = static_cast<const char*>(data);
+    while(size) {
+        if(!track.buffer) {
+            track.buffer = _freeBuffers.back();
+            _freeBuffers.pop_back();
+            track.bufferSize = 0;
+        }
+
+        const size_t chunkSize = std::min<size_t>(size, BUFFER_SIZE - track.bufferSize);
+        memcpy(track.buffer + track.bufferSize, bytes, chunkSize);
+        track.bufferSize += chunkSize;
+        bytes += chunkSize;
+        size -= chunkSize;
+
+        if(BUFFER_SIZE == track.bufferSize) {
+            Job job;
+            job.stream = stream;
+            job.buffer = track.buffer;
+            job.size = track.bufferSize;
+            submit(std::move(job));
+
+            track.buffer = nullptr;
+            track.bufferSize = 0;
+        }
+    }
+}
+
+void SegmentRecorder::submit(Job&& job)
+{
+    job.recorder = this;
+    _writer->push(std::move(job));
+}
+
+void SegmentRecorder::process(const Job& job)
+{
+    if(job.stream >= _files.size())
+        _files.resize(job.stream + 1);
+    File& file = _files[job.stream];
+
+    if(!job.path.empty()) {
+        closeFile(&file);
+        openFile(&file, job.path, job.caps);
+    }
+
+    if(job.buffer) {
+        if(file.fd >= 0 && job.size)
+            writeFile(&file, job.buffer, job.size);
+
+        std::lock_guard<std::mutex> lock(_guard);
+        _freeBuffers.push_back(job.buffer);
+    }
+
+    if(job.dropped)
+        JANUS_LOG(LOG_WARN, "Recorder dropped %u packets, disk is too slow\n", job.dropped);
+
+    if(job.close)
+        closeFile(&file);
+
+    if(job.rotate)
+        deleteOldSegments();
+
+    if(job.done)
+        job.done->set_value();
+}
+
+void SegmentRecorder::openFile(File* file, const std::string& path, const std::string& caps)
+{
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+    file->fd = open(path.c_str(), flags | O_DIRECT, 0644);
+    file->direct = file->fd >= 0;
+    if(file->fd < 0 && EINVAL == errno) // O_DIRECT is not supported by file system
+        file->fd = open(path.c_str(), flags, 0644);
+
+    if(file->fd < 0) {
+        JANUS_LOG(LOG_ERR,
+            "Failed to create segment \"%s\": %s\n",
+            path.c_str(), g_strerror(errno));
+        return;
+    }
+
+    file->size = 0;
+    file->allocated = 0;
+    file->cached = 0;
+
+    // stream description required to play segment
+    GCharPtr capsPathPtr(g_strconcat(path.c_str(), ".caps", NULL));
+    g_file_set_contents(capsPathPtr.get(), caps.data(), caps.size(), nullptr);
+}
+
+void SegmentRecorder::writeFile(File* file, const char* data, size_t size)
+{
+    if(file->size + size > file->allocated) {
+        // keeps segment contiguous on disk and saves metadata update on every write
+        if(0 == fallocate(file->fd, FALLOC_FL_KEEP_SIZE, file->allocated, PREALLOCATE_SIZE))
+            file->allocated += PREALLOCATE_SIZE;
+        else
+            file->allocated = G_MAXUINT64;
+    }
+
+    // the last piece of segment is not aligned
+    if(file->direct && size % DIRECT_IO_ALIGNMENT) {
+        fcntl(file->fd, F_SETFL, fcntl(file->fd, F_GETFL) & ~O_DIRECT);
+        file->direct = false;
+    }
+
+    size_t written = 0;
+    while(written < size) {
+        const ssize_t result = pwrite(file->fd, data + written, size - written, file->size + written);
+        if(result < 0 && EINVAL == errno && file->direct) {
+            fcntl(file->fd, F_SETFL, fcntl(file->fd, F_GETFL) & ~O_DIRECT);
+            file->direct = false;
+            continue;
+        } else if(result < 0 && EINTR == errno) {
+            continue;
+        } else if(result < 0) {
+            JANUS_LOG(LOG_ERR, "Failed to write segment: %s\n", g_strerror(errno));
+            break;
+        }
+
+        written += result;
+    }
+
+    if(!file->direct) {
+        // recorded data will not be read soon, so don't let it push out page cache.
+        // Writeback is only started, waiting for it would stall all recorders on one slow disk.
+        // Pages already written back are dropped, the ones still under writeback are dropped next time
+        sync_file_range(file->fd, file->size, written, SYNC_FILE_RANGE_WRITE);
+        posix_fadvise(file->fd, file->cached, file->size - file->cached, POSIX_FADV_DONTNEED);
+        file->cached = file->size;
+    }
+
+    file->size += written;
+}
+
+void SegmentRecorder::closeFile(File* file)
+{
+    if(file->fd < 0)
+        return;
+
+    // releases preallocated space
+    if(file->allocated > file->size && 0 != ftruncate(file->fd, file->size))
+        JANUS_LOG(LOG_WARN, "Failed to truncate segment: %s\n", g_strerror(errno));
+
+    if(!file->direct) {
+        sync_file_range(file->fd, file->cached, file->size - file->cached, SYNC_FILE_RANGE_WRITE);
+        posix_fadvise(file->fd, file->cached, 0, POSIX_FADV_DONTNEED);
+    }
+
+    close(file->fd);
+    file->fd = -1;
+}
+
+// segment is "<start time>." prefix of its files, and start time is sortable
+void SegmentRecorder::deleteOldSegments()
+{
+    GDir* dir = g_dir_open(_config.path.c_str(), 0, nullptr);
+    if(!dir)
+        return;
+
+    std::vector<std::string> segments;
+    while(const gchar* name = g_dir_read_name(dir)) {
+        if(!g_str_has_suffix(name, ".rtpdump"))
+            continue;
+
+        const gchar* dot = strchr(name, '.');
+        segments.emplace_back(name, dot - name + 1);
+    }
+    std::sort(segments.begin(), segments.end());
+    segments.erase(std::unique(segments.begin(), segments.end()), segments.end());
+
+    if(segments.size() <= _config.maxSegments) {
+        g_dir_close(dir);
+        return;
+    }
+    segments.resize(segments.size() - _config.maxSegments);
+
+    g_dir_rewind(dir);
+    while(const gchar* name = g_dir_read_name(dir)) {
+        if(!g_str_has_suffix(name, ".rtpdump") && !g_str_has_suffix(name, ".rtpdump.caps"))
+            continue;
+
+        const gchar* dot = strchr(name, '.');
+        const std::string segment(name, dot - name + 1);
+        if(!std::binary_search(segments.begin(), segments.end(), segment))
+            continue;
+
+        GCharPtr pathPtr(g_build_filename(_config.path.c_str(), name, NULL));
+        if(0 != unlink(pathPtr.get()))
+            JANUS_LOG(LOG_WARN, "Failed to delete segment \"%s\": %s\n", pathPtr.get(), g_strerror(errno));
+    }
+
+    g_dir_close(dir);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "MediaConfig.h"
+#include "MountPointTap.h"
+
+
+class SegmentWriter;
+
+// writes relayed RTP into rolling rtpdump segments, starting every segment from key frame.
+// Every stream gets its own file per segment ("<start time>.<stream index>.rtpdump"),
+// so each file is a regular single stream rtpdump, described by its ".caps" file.
+// Packets are batched into aligned buffers and written with O_DIRECT
+// by thread shared between all recorders. If writing doesn't keep up, packets are dropped.
+// Only the last maxSegments segments are kept in recording directory.
+class SegmentRecorder : public MountPointTap
+{
+public:
+    SegmentRecorder(const MediaConfig::Record&);
+    ~SegmentRecorder();
+
+    void mediaPrepared(const std::vector<Stream>&) override;
+    void onPacket(unsigned stream, bool keyFrame, const char* data, size_t size) override;
+
+private:
+    friend class SegmentWriter;
+    struct Job;
+
+    struct Track
+    {
+        bool recorded = false;
+        std::string caps;
+        char* buffer = nullptr;
+        size_t bufferSize = 0;
+    };
+
+    struct File
+    {
+        int fd = -1;
+        bool direct = false;
+        guint64 size = 0;
+        guint64 allocated = 0;
+        guint64 cached = 0; // data before it is dropped from page cache already
+    };
+
+    bool startSegment(gint64 time);
+    void finishSegment();
+    bool canAppend(const Track&, size_t size) const;
+    void append(unsigned stream, const void* data, size_t size);
+    void submit(Job&&);
+
+    // called from writer thread
+    void process(const Job&);
+    void openFile(File*, const std::string& path, const std::string& caps);
+    void writeFile(File*, const char* data, size_t size);
+    void closeFile(File*);
+    void deleteOldSegments();
+
+private:
+    const MediaConfig::Record _config;
+    const std::shared_ptr<SegmentWriter> _writer;
+
+    std::mutex _guard;
+    std::vector<char*> _buffers;
+    std::vector<char*> _freeBuffers;
+    std::vector<Track> _tracks; // by stream index
+    int _indexStream;
+    bool _segmentStarted;
+    gint64 _segmentStart;
+    unsigned _dropped;
+
+    // accessed only from writer thread, by stream index
+    std::vector<File> _files;
+};
@@ -1,8 +1,26 @@
 #include "Session.h"
 
+#include <string>
+
 #include "CxxPtr/JanssonPtr.h"
 
 
+namespace {
+
+enum {
+    SESSIONS_POOL_CAPACITY = 1024,
+};
+
+}
+
+StoragePool& Session::Pool()
+{
+    // never destroyed, since sessions alive on plugin unload are not destroyed either
+    static StoragePool* pool =
+        new StoragePool("sessions", sizeof(Session), SESSIONS_POOL_CAPACITY);
+    return *pool;
+}
+
 void PushError(
     janus_callbacks* janus,
     janus_plugin* plugin,
@@ -21,3 +39,83 @@ void PushError(
         janusSession, plugin,
         transaction.c_str(), event, nullptr);
 }
+
+void PushResult(
+    janus_callbacks* janus,
+    janus_plugin* plugin,
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    const char* result)
+{
+    JsonPtr eventPtr(json_object());
+    json_t* event = eventPtr.get();
+
+    json_object_set_new(event, "streaming", json_string("event"));
+    json_object_set_new(event, "result", json_string(result));
+
+    janus->push_event(
+        janusSession, plugin,
+        transaction.c_str(), event, nullptr);
+}
+
+void PushOffer(
+    janus_callbacks* janus,
+    janus_plugin* plugin,
+    janus_plugin_session* janusSession,
+    const std::string& transaction)
+{
+    Session* session = GetSession(janusSession);
+
+    GstSDPMessage* outSdp;
+    gst_sdp_message_new(&outSdp);
+    GstSDPMessagePtr outSdpPtr(outSdp);
+
+    const std::string version = std::to_string(++session->sdpVersion);
+
+    gst_sdp_message_set_version(outSdp, "0");
+    gst_sdp_message_set_origin(outSdp,
+        "-", session->sdpSessionId.get(), version.c_str(), "IN", "IP4", "127.0.0.1");
+
+    gst_sdp_message_set_session_name(outSdp, "Session streamed with Janus Gstreamer plugin");
+
+    for(unsigned i = 0; i < session->mediaSections.size(); ++i) {
+        MediaSection& section = session->mediaSections[i];
+
+        // not prepared mount point keeps its m-line as it was
+        if(section.mountPoint) {
+            if(MountPoint::SdpMediaPtr mediaPtr = section.mountPoint->sdpMedia(section.video))
+                section.mediaPtr = std::move(mediaPtr);
+        }
+
+        GstSDPMedia* outMedia;
+        gst_sdp_media_copy(section.mediaPtr.get(), &outMedia);
+        GstSDPMediaPtr outMediaPtr(outMedia);
+
+        if(!section.mountPoint) {
+            gst_sdp_media_set_port_info(outMedia, 0, 1);
+            gst_sdp_media_add_attribute(outMedia, "inactive", nullptr);
+        }
+        gst_sdp_media_add_attribute(outMedia, "mid", std::to_string(i).c_str());
+
+        gst_sdp_message_add_media(outSdp, outMedia);
+    }
+
+    GCharPtr sdpPtr(gst_sdp_message_as_text(outSdp));
+    const gchar* sdp = sdpPtr.get();
+    JANUS_LOG(LOG_VERB, "PushOffer. \n%s\n", sdpPtr.get());
+
+    JsonPtr eventPtr(json_object());
+    json_t* event = eventPtr.get();
+
+    json_object_set_new(event, "streaming", json_string("event"));
+
+    JsonPtr jsepPtr(
+        json_pack("{ssss}",
+            "type", "offer",
+            "sdp", sdp));
+    json_t* jsep = jsepPtr.get();
+
+    janus->push_event(
+        janusSession, plugin,
+        transaction.c_str(), event, jsep);
+}
@@ -1,15 +1,36 @@
 #pragma once
 
+#include <atomic>
+#include <vector>
+
 #include "CxxPtr/GlibPtr.h"
+#include "CxxPtr/GstPtr.h"
 
 #include "MountPoint.h"
+#include "StoragePool.h"
+
 
+// m-line of session's PeerConnection, index never changes while session is watching
+struct MediaSection
+{
+    MountPoint* mountPoint; // nullptr if unsubscribed
+    bool video;
+    MountPoint::SdpMediaPtr mediaPtr; // last offered
+};
 
-struct Session
+// storage of destroyed sessions is reused by newly created ones
+struct Session : public Pooled<Session>
 {
+    static StoragePool& Pool();
+
     MountPoint* watching;
     bool dynamicMountPointWatching;
+    // relayed over the same PeerConnection in addition to watching one
+    std::vector<MountPoint*> subscriptions;
+    std::vector<MediaSection> mediaSections;
     GCharPtr sdpSessionId;
+    unsigned sdpVersion;
+    std::atomic<unsigned> estimatedBitrate; // bit/s, from receiver REMB
 };
 
 inline Session* GetSession(janus_plugin_session* janusSession)
@@ -21,3 +42,19 @@ void PushError(
     janus_plugin_session* janusSession,
     const std::string& transaction,
     const char* errorText);
+
+// {"streaming": "event", "result": result}, acknowledges request which has no other reply
+void PushResult(
+    janus_callbacks* janus,
+    janus_plugin* plugin,
+    janus_plugin_session* janusSession,
+    const std::string& transaction,
+    const char* result);
+
+// offers all media sections of session, mount points can be subscribed and unsubscribed
+// by incremental renegotiation since m-lines are never reordered
+void PushOffer(
+    janus_callbacks* janus,
+    janus_plugin* plugin,
+    janus_plugin_session* janusSession,
+    const std::string& transaction);
@@ -0,0 +1,243 @@
+#include "ShmRing.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <new>
+
+extern "C" {
+#include "janus/debug.h"
+}
+
+#include "RtpReceiver.h"
+
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory ring requires lock free atomics");
+static_assert(sizeof(ShmRingHeader) <= SHM_RING_DATA_OFFSET, "ShmRingHeader is too big");
+static_assert(sizeof(ShmRecordHeader) == SHM_RECORD_ALIGNMENT, "unexpected ShmRecordHeader size");
+
+static guint64 AlignedRecordSize(guint32 packetSize)
+{
+    return
+        (sizeof(ShmRecordHeader) + packetSize + SHM_RECORD_ALIGNMENT - 1) &
+        ~guint64(SHM_RECORD_ALIGNMENT - 1);
+}
+
+ShmRing::ShmRing(const std::string& socketPath, size_t size) :
+    _socketPath(socketPath),
+    _memfd(-1), _doorbell(-1), _listenSocket(-1), _producerSocket(-1), _producerFailed(false),
+    _memory(MAP_FAILED), _memorySize(0), _header(nullptr), _data(nullptr)
+{
+    size &= ~size_t(SHM_RECORD_ALIGNMENT - 1);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if(socketPath.empty() || socketPath.size() >= sizeof(address.sun_path)) {
+        JANUS_LOG(LOG_ERR, "Invalid shared memory ring socket path \"%s\"\n", socketPath.c_str());
+        return;
+    }
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    _memfd = memfd_create("janus-gstreamer-ring", MFD_CLOEXEC);
+    _memorySize = SHM_RING_DATA_OFFSET + size;
+    if(_memfd < 0 || 0 != ftruncate(_memfd, _memorySize)) {
+        JANUS_LOG(LOG_ERR, "Failed to create shared memory ring: %s\n", g_strerror(errno));
+        return;
+    }
+
+    _memory = mmap(nullptr, _memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, _memfd, 0);
+    if(MAP_FAILED == _memory) {
+        JANUS_LOG(LOG_ERR, "Failed to map shared memory ring: %s\n", g_strerror(errno));
+        return;
+    }
+
+    _header = new(_memory) ShmRingHeader();
+    _header->magic = SHM_RING_MAGIC;
+    _header->version = SHM_RING_VERSION;
+    _header->size = size;
+    _data = static_cast<const char*>(_memory) + SHM_RING_DATA_OFFSET;
+
+    _doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(_doorbell < 0) {
+        JANUS_LOG(LOG_ERR, "Failed to create shared memory ring doorbell: %s\n", g_strerror(errno));
+        return;
+    }
+
+    _listenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(socketPath.c_str()); // left by previous run
+    if(_listenSocket < 0 ||
+       0 != bind(_listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ||
+       0 != listen(_listenSocket, 1))
+    {
+        JANUS_LOG(LOG_ERR,
+            "Failed to listen shared memory ring socket \"%s\": %s\n",
+            socketPath.c_str(), g_strerror(errno));
+        if(_listenSocket >= 0)
+            close(_listenSocket);
+        _listenSocket = -1;
+    }
+}
+
+ShmRing::~ShmRing()
+{
+    if(_receiver) {
+        _receiver->remove(_listenSocket);
+        _receiver->remove(_doorbell);
+    }
+
+    if(_producerSocket >= 0)
+        close(_producerSocket);
+    if(_listenSocket >= 0) {
+        close(_listenSocket);
+        unlink(_socketPath.c_str());
+    }
+    if(_doorbell >= 0)
+        close(_doorbell);
+    if(MAP_FAILED != _memory)
+        munmap(_memory, _memorySize);
+    if(_memfd >= 0)
+        close(_memfd);
+}
+
+bool ShmRing::isValid() const
+{
+    return _listenSocket >= 0;
+}
+
+bool ShmRing::start(const OnPacket& onPacket)
+{
+    if(!isValid())
+        return false;
+
+    _onPacket = onPacket;
+    _receiver = RtpReceiver::Shared();
+
+    return
+        _receiver->add(_listenSocket, RtpReceiver::OnReadable(std::bind(&ShmRing::acceptProducer, this))) &&
+        _receiver->add(_doorbell, RtpReceiver::OnReadable(std::bind(&ShmRing::drain, this)));
+}
+
+// new producer replaces previous one and continues from current head
+void ShmRing::acceptProducer()
+{
+    const int producerSocket = accept4(_listenSocket, nullptr, nullptr, SOCK_CLOEXEC);
+    if(producerSocket < 0)
+        return;
+
+    char dummy = 0;
+    iovec iov = { &dummy, sizeof(dummy) };
+
+    union {
+        cmsghdr header;
+        char buffer[CMSG_SPACE(2 * sizeof(int))];
+    } control = {};
+
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    cmsghdr* controlMessage = CMSG_FIRSTHDR(&message);
+    controlMessage->cmsg_level = SOL_SOCKET;
+    controlMessage->cmsg_type = SCM_RIGHTS;
+    controlMessage->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    const int fds[] = { _memfd, _doorbell };
+    memcpy(CMSG_DATA(controlMessage), fds, sizeof(fds));
+
+    if(sendmsg(producerSocket, &message, MSG_NOSIGNAL) < 0) {
+        JANUS_LOG(LOG_ERR, "Failed to pass shared memory ring to producer: %s\n", g_strerror(errno));
+        close(producerSocket);
+        return;
+    }
+
+    JANUS_LOG(LOG_INFO, "Producer connected to \"%s\"\n", _socketPath.c_str());
+
+    // kept open, so producer can detect consumer is gone
+    if(_producerSocket >= 0)
+        close(_producerSocket);
+    _producerSocket = producerSocket;
+    _producerFailed = false;
+}
+
+// head, tail and records are writable by producer, so nothing there can be trusted
+void ShmRing::dropProducer(const char* reason)
+{
+    _header->tail = _header->head.load();
+
+    if(_producerFailed)
+        return;
+
+    JANUS_LOG(LOG_ERR,
+        "Shared memory ring \"%s\" is corrupted (%s), disconnecting producer\n",
+        _socketPath.c_str(), reason);
+
+    _producerFailed = true;
+    if(_producerSocket >= 0) {
+        close(_producerSocket);
+        _producerSocket = -1;
+    }
+}
+
+void ShmRing::drain()
+{
+    guint64 value;
+    if(read(_doorbell, &value, sizeof(value)) < 0 && errno != EAGAIN)
+        JANUS_LOG(LOG_WARN, "Failed to read shared memory ring doorbell: %s\n", g_strerror(errno));
+
+    const guint64 size = _memorySize - SHM_RING_DATA_OFFSET;
+    guint64 tail = _header->tail.load();
+    // only records written before wake up, so busy producer doesn't starve others
+    const guint64 head = _header->head.load();
+    if(_producerFailed) {
+        _header->tail = head;
+        return;
+    }
+    if(head < tail || head - tail > size || tail % SHM_RECORD_ALIGNMENT) {
+        dropProducer("head or tail out of range");
+        return;
+    }
+
+    while(tail < head) {
+        const guint64 offset = tail % size;
+        if(head - tail < sizeof(ShmRecordHeader)) {
+            dropProducer("truncated record header");
+            return;
+        }
+
+        ShmRecordHeader record;
+        memcpy(&record, _data + offset, sizeof(record));
+
+        if(SHM_WRAP_RECORD == record.size) {
+            if(size - offset > head - tail) {
+                dropProducer("wrap past head");
+                return;
+            }
+            tail += size - offset;
+        } else if(AlignedRecordSize(record.size) > size - offset ||
+                  AlignedRecordSize(record.size) > head - tail)
+        {
+            dropProducer("record past head");
+            return;
+        } else {
+            // relayed in place, producer can't overwrite it until tail is moved
+            _onPacket(record.stream, _data + offset + sizeof(record), record.size);
+            tail += AlignedRecordSize(record.size);
+        }
+
+        _header->tail = tail;
+    }
+
+    // producer doesn't ring if it has seen tail behind its previous head
+    if(_header->head.load() != tail) {
+        const guint64 one = 1;
+        if(write(_doorbell, &one, sizeof(one)) < 0)
+            JANUS_LOG(LOG_WARN, "Failed to ring shared memory ring doorbell: %s\n", g_strerror(errno));
+    }
+}
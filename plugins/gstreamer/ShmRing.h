@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <glib.h>
+
+
+class RtpReceiver;
+
+// Ring of RTP packets in shared memory, written by local producer process
+// (single producer, single consumer).
+//
+// Producer connects to unix socket at configured path and gets two descriptors
+// with SCM_RIGHTS: memfd with the ring and eventfd doorbell. Ring starts with
+// ShmRingHeader, data area of ShmRingHeader::size bytes follows it (at
+// SHM_RING_DATA_OFFSET). Every record is ShmRecordHeader followed by RTP packet
+// and padding to SHM_RECORD_ALIGNMENT. If record doesn't fit before the end of data area,
+// header with size = SHM_WRAP_RECORD is written instead, and record starts from data area start.
+//
+// Producer writes record only if it fits into free space (size - (head - tail)),
+// then stores new head and writes 1 into eventfd if tail is equal to previous head
+// (i.e. consumer could fall asleep). Consumer reads records in place and stores tail
+// after them, so producer never overwrites packets being relayed.
+enum {
+    SHM_RING_MAGIC = 0x52534a47, // "GJSR"
+    SHM_RING_VERSION = 1,
+    SHM_RING_DATA_OFFSET = 256,
+    SHM_RECORD_ALIGNMENT = 8,
+};
+
+const guint32 SHM_WRAP_RECORD = G_MAXUINT32;
+
+struct ShmRingHeader
+{
+    guint32 magic;
+    guint32 version;
+    guint64 size; // of data area
+
+    alignas(64) std::atomic<guint64> head; // total bytes written by producer
+    alignas(64) std::atomic<guint64> tail; // total bytes consumed
+};
+
+struct ShmRecordHeader
+{
+    guint32 size; // of RTP packet
+    guint32 stream; // index of m-line in mount point SDP
+};
+
+class ShmRing
+{
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator = (const ShmRing&) = delete;
+
+public:
+    typedef std::function<void (unsigned stream, const char* data, size_t size)> OnPacket;
+
+    ShmRing(const std::string& socketPath, size_t size);
+    ~ShmRing();
+
+    bool isValid() const;
+
+    // onPacket is called from RtpReceiver thread
+    bool start(const OnPacket&);
+
+private:
+    void acceptProducer();
+    void drain();
+    void dropProducer(const char* reason);
+
+private:
+    const std::string _socketPath;
+
+    int _memfd;
+    int _doorbell;
+    int _listenSocket;
+    int _producerSocket;
+    // producer broke the ring, written data is skipped till next producer connects
+    bool _producerFailed;
+
+    void* _memory;
+    size_t _memorySize;
+    ShmRingHeader* _header;
+    const char* _data;
+
+    OnPacket _onPacket;
+    std::shared_ptr<RtpReceiver> _receiver;
+};
@@ -0,0 +1,429 @@
+#include "SrtMedia.h"
+
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include "janus/debug.h"
+}
+
+#include "CxxPtr/GlibPtr.h"
+#include "CxxPtr/GstPtr.h"
+
+#include "Probes.h"
+
+#define ALL_STREAMS_ADDED_MESSAGE "ALL_STREAMS_ADDED"
+
+
+namespace {
+
+enum {
+    H264_PAYLOAD_TYPE = 96,
+    H265_PAYLOAD_TYPE = 97,
+    AAC_PAYLOAD_TYPE = 98,
+};
+
+}
+
+struct SrtMedia::Private
+{
+    SrtMedia *const owner;
+
+    SrtConfig srtConfig;
+
+    GstElementPtr pipelinePtr;
+    GstBusPtr busPtr;
+    guint busWatchId = 0;
+
+    std::mutex streamsGuard;
+    // repayloaders waiting caps to be added as Media streams
+    unsigned waitingStreams = 0;
+    bool noMorePads = false;
+    std::vector<GstCapsPtr> streamsCaps;
+
+    GstSDPMessagePtr sdpPtr;
+
+    void setState(GstState);
+
+    void prepare();
+    void pause();
+    void play();
+    void null();
+
+    void postMessage(const gchar*);
+
+    void demuxPadAdded(GstElement* demux, GstPad*);
+    void demuxNoMorePads(GstElement* demux);
+    void repayloaderCaps(GstPad*, StreamType, GstCaps*);
+    void allStreamsAdded();
+
+    gboolean onBusMessage(GstBus*, GstMessage*);
+};
+
+void SrtMedia::Private::setState(GstState state)
+{
+    GstElement* pipeline = pipelinePtr.get();
+    if(!pipeline) {
+        if(state != GST_STATE_NULL)
+            JANUS_LOG(LOG_ERR, "SrtMedia::Private::setState. Pipeline is not initialized\n");
+        return;
+    }
+
+    PROBE2(state_change_begin, pipeline, state);
+    const GstStateChangeReturn result = gst_element_set_state(pipeline, state);
+    PROBE3(state_change_end, pipeline, state, result);
+
+    switch(result) {
+        case GST_STATE_CHANGE_FAILURE:
+            JANUS_LOG(LOG_ERR, "SrtMedia::Private::setState. gst_element_set_state failed\n");
+            break;
+        case GST_STATE_CHANGE_SUCCESS:
+            break;
+        case GST_STATE_CHANGE_ASYNC:
+            break;
+        case GST_STATE_CHANGE_NO_PREROLL:
+            break;
+    }
+}
+
+void SrtMedia::Private::prepare()
+{
+    GCharPtr pipelineDescPtr(
+        g_strdup_printf(
+            "srtsrc name=srtsrc ! "
+            "queue leaky=downstream max-size-buffers=0 max-size-bytes=0 max-size-time=%" G_GUINT64_FORMAT " ! "
+            "tsdemux name=demux",
+            static_cast<guint64>(srtConfig.buffer) * GST_MSECOND));
+
+    GError* parseError = nullptr;
+    pipelinePtr.reset(gst_parse_launch(pipelineDescPtr.get(), &parseError));
+    GErrorPtr parseErrorPtr(parseError);
+    GstElement* pipeline = pipelinePtr.get();
+    if(parseError) {
+        JANUS_LOG(LOG_ERR,
+            "SrtMedia::Private::prepare. gst_parse_launch failed: %s\n",
+            parseError->message);
+        pipelinePtr.reset();
+        return;
+    }
+
+    GstElementPtr srtsrcPtr(gst_bin_get_by_name(GST_BIN(pipeline), "srtsrc"));
+    g_object_set(srtsrcPtr.get(),
+        "uri", srtConfig.url.c_str(),
+        "latency", static_cast<gint>(srtConfig.latency),
+        nullptr);
+    gst_util_set_object_arg(
+        G_OBJECT(srtsrcPtr.get()),
+        "mode", srtConfig.listener ? "listener" : "caller");
+
+    GstElementPtr demuxPtr(gst_bin_get_by_name(GST_BIN(pipeline), "demux"));
+    GstElement* demux = demuxPtr.get();
+
+    auto demuxPadAddedCallback =
+        (void (*)(GstElement*, GstPad*, gpointer))
+         [] (GstElement* demux, GstPad* pad, gpointer userData)
+    {
+        Private* self = static_cast<Private*>(userData);
+        self->demuxPadAdded(demux, pad);
+    };
+    g_signal_connect(demux, "pad-added", G_CALLBACK(demuxPadAddedCallback), this);
+
+    auto demuxNoMorePadsCallback =
+        (void (*)(GstElement*,  gpointer))
+         [] (GstElement* demux, gpointer userData)
+    {
+        Private* self = static_cast<Private*>(userData);
+        self->demuxNoMorePads(demux);
+    };
+    g_signal_connect(demux, "no-more-pads", G_CALLBACK(demuxNoMorePadsCallback), this);
+
+    auto onBusMessageCallback =
+        (gboolean (*) (GstBus*, GstMessage*, gpointer))
+        [] (GstBus* bus, GstMessage* message, gpointer userData) -> gboolean
+    {
+        Private* self = static_cast<Private*>(userData);
+        return self->onBusMessage(bus, message);
+    };
+
+    busPtr.reset(gst_pipeline_get_bus(GST_PIPELINE(pipeline)));
+    GstBus* bus = busPtr.get();
+    GSourcePtr busSourcePtr(gst_bus_create_watch(bus));
+    busWatchId =
+        gst_bus_add_watch(bus, onBusMessageCallback, this);
+    owner->placeThreads(bus);
+}
+
+void SrtMedia::Private::pause()
+{
+    setState(GST_STATE_PAUSED);
+}
+
+void SrtMedia::Private::play()
+{
+    setState(GST_STATE_PLAYING);
+}
+
+void SrtMedia::Private::null()
+{
+    setState(GST_STATE_NULL);
+}
+
+void SrtMedia::Private::postMessage(const gchar* message)
+{
+    GstStructure* structure = gst_structure_new_empty(message);
+    GstMessage* gstMessage = gst_message_new_application(NULL, structure);
+    gst_bus_post(busPtr.get(), gstMessage);
+}
+
+// elementary stream is only parsed (to put parameter sets before key frames) and payloaded
+static gchar* RepayloaderDescription(const GstCaps* caps, Media::StreamType* streamType)
+{
+    const GstStructure* structure = gst_caps_get_structure(caps, 0);
+    const gchar* name = gst_structure_get_name(structure);
+
+    if(0 == g_strcmp0(name, "video/x-h264")) {
+        *streamType = Media::StreamType::Video;
+        return g_strdup_printf(
+            "h264parse config-interval=-1 ! "
+            "video/x-h264, stream-format=avc, alignment=au ! "
+            "rtph264pay config-interval=-1 pt=%d",
+            H264_PAYLOAD_TYPE);
+    }
+
+    if(0 == g_strcmp0(name, "video/x-h265")) {
+        *streamType = Media::StreamType::Video;
+        return g_strdup_printf(
+            "h265parse config-interval=-1 ! "
+            "video/x-h265, stream-format=hvc1, alignment=au ! "
+            "rtph265pay config-interval=-1 pt=%d",
+            H265_PAYLOAD_TYPE);
+    }
+
+    gint mpegVersion = 0;
+    if(0 == g_strcmp0(name, "audio/mpeg") &&
+       gst_structure_get_int(structure, "mpegversion", &mpegVersion) &&
+       (2 == mpegVersion || 4 == mpegVersion))
+    {
+        *streamType = Media::StreamType::Audio;
+        return g_strdup_printf(
+            "aacparse ! audio/mpeg, stream-format=raw ! "
+            "rtpmp4gpay pt=%d",
+            AAC_PAYLOAD_TYPE);
+    }
+
+    return nullptr;
+}
+
+// runs on streaming thread of demuxer
+void SrtMedia::Private::demuxPadAdded(
+    GstElement* /*demux*/,
+    GstPad* pad)
+{
+    GstCapsPtr capsPtr(gst_pad_get_current_caps(pad));
+    if(!capsPtr)
+        capsPtr.reset(gst_pad_query_caps(pad, nullptr));
+    GstCaps* caps = capsPtr.get();
+    if(!caps || gst_caps_is_empty(caps))
+        return;
+
+    GCharPtr capsStrPtr(gst_caps_to_string(caps));
+
+    StreamType streamType = StreamType::Unknown;
+    GCharPtr descriptionPtr(RepayloaderDescription(caps, &streamType));
+    if(!descriptionPtr) {
+        JANUS_LOG(LOG_WARN, "SrtMedia. Unsupported elementary stream is ignored: %s\n", capsStrPtr.get());
+        return;
+    }
+
+    JANUS_LOG(LOG_VERB, "Elementary stream caps: %s\n", capsStrPtr.get());
+
+    GError* parseError = nullptr;
+    GstElement* repayloader =
+        gst_parse_bin_from_description(descriptionPtr.get(), TRUE, &parseError);
+    GErrorPtr parseErrorPtr(parseError);
+    if(parseError) {
+        JANUS_LOG(LOG_ERR,
+            "SrtMedia::Private::demuxPadAdded. gst_parse_bin_from_description failed: %s\n",
+            parseError->message);
+        if(repayloader)
+            gst_object_unref(repayloader);
+        return;
+    }
+
+    gst_bin_add(GST_BIN(pipelinePtr.get()), repayloader);
+    gst_element_sync_state_with_parent(repayloader);
+
+    // Media stream is added when payloader caps are known,
+    // so transcoding decision is made for actual format
+    struct ProbeData
+    {
+        Private* self;
+        StreamType streamType;
+    };
+    auto repayloaderCapsCallback =
+        (GstPadProbeReturn (*) (GstPad*, GstPadProbeInfo*, gpointer))
+        [] (GstPad* pad, GstPadProbeInfo* info, gpointer userData) -> GstPadProbeReturn
+    {
+        GstEvent* event = GST_PAD_PROBE_INFO_EVENT(info);
+        if(GST_EVENT_CAPS != GST_EVENT_TYPE(event))
+            return GST_PAD_PROBE_OK;
+
+        ProbeData* probeData = static_cast<ProbeData*>(userData);
+
+        GstCaps* caps;
+        gst_event_parse_caps(event, &caps);
+        probeData->self->repayloaderCaps(pad, probeData->streamType, caps);
+
+        return GST_PAD_PROBE_REMOVE;
+    };
+    auto destroyProbeData =
+        [] (gpointer userData)
+    {
+        delete static_cast<ProbeData*>(userData);
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(streamsGuard);
+        ++waitingStreams;
+    }
+
+    GstPadPtr srcPadPtr(gst_element_get_static_pad(repayloader, "src"));
+    gst_pad_add_probe(
+        srcPadPtr.get(),
+        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+        repayloaderCapsCallback,
+        new ProbeData{this, streamType},
+        destroyProbeData);
+
+    GstPadPtr sinkPadPtr(gst_element_get_static_pad(repayloader, "sink"));
+    if(GST_PAD_LINK_OK != gst_pad_link(pad, sinkPadPtr.get()))
+        JANUS_LOG(LOG_ERR, "SrtMedia::Private::demuxPadAdded. Failed to link repayloader\n");
+}
+
+// caps event is not forwarded yet, so it will reach just linked stream sink
+void SrtMedia::Private::repayloaderCaps(GstPad* pad, StreamType streamType, GstCaps* caps)
+{
+    GCharPtr capsStrPtr(gst_caps_to_string(caps));
+    JANUS_LOG(LOG_VERB, "Stream caps: %s\n", capsStrPtr.get());
+
+    GstElement* streamSink = owner->addStream(streamType, caps);
+    if(streamSink) {
+        gst_bin_add(GST_BIN(pipelinePtr.get()), streamSink);
+        gst_element_sync_state_with_parent(streamSink);
+
+        GstPadPtr sinkPadPtr(gst_element_get_static_pad(streamSink, "sink"));
+        gst_pad_link(pad, sinkPadPtr.get());
+    }
+
+    std::lock_guard<std::mutex> lock(streamsGuard);
+    streamsCaps.emplace_back(gst_caps_copy(caps));
+    if(0 == --waitingStreams && noMorePads)
+        postMessage(ALL_STREAMS_ADDED_MESSAGE);
+}
+
+void SrtMedia::Private::demuxNoMorePads(GstElement* /*demux*/)
+{
+    std::lock_guard<std::mutex> lock(streamsGuard);
+    noMorePads = true;
+    if(0 == waitingStreams)
+        postMessage(ALL_STREAMS_ADDED_MESSAGE);
+}
+
+void SrtMedia::Private::allStreamsAdded()
+{
+    GstSDPMessage* outSdp;
+    gst_sdp_message_new(&outSdp);
+    GstSDPMessagePtr outSdpPtr(outSdp);
+
+    {
+        std::lock_guard<std::mutex> lock(streamsGuard);
+        if(streamsCaps.empty()) {
+            JANUS_LOG(LOG_ERR, "SrtMedia. There are no supported streams\n");
+            owner->eos(true);
+            return;
+        }
+
+        for(const GstCapsPtr& capsPtr: streamsCaps) {
+            GstSDPMedia* outMedia;
+            gst_sdp_media_new(&outMedia);
+            GstSDPMediaPtr outMediaPtr(outMedia);
+
+            gst_sdp_media_set_media_from_caps(capsPtr.get(), outMedia);
+
+            gst_sdp_message_add_media(outSdp, outMediaPtr.release());
+        }
+    }
+
+    sdpPtr = std::move(outSdpPtr);
+
+    owner->prepared();
+}
+
+gboolean SrtMedia::Private::onBusMessage(GstBus* bus, GstMessage* msg)
+{
+    switch(GST_MESSAGE_TYPE(msg)) {
+        case GST_MESSAGE_EOS:
+            owner->eos(false);
+            break;
+        case GST_MESSAGE_ERROR: {
+            gchar* debug;
+            GError* error;
+
+            gst_message_parse_error(msg, &error, &debug);
+
+            JANUS_LOG(LOG_ERR, "SrtMedia::Private::onBusMessage. %s\n", error->message);
+
+            g_free(debug);
+            g_error_free(error);
+
+            owner->eos(true);
+
+            break;
+        }
+        case GST_MESSAGE_APPLICATION: {
+            const GstStructure* structure = gst_message_get_structure(msg);
+            const gchar* name = gst_structure_get_name(structure);
+            if(0 == g_strcmp0(name, ALL_STREAMS_ADDED_MESSAGE))
+                allStreamsAdded();
+
+            break;
+        }
+        case GST_MESSAGE_STREAM_STATUS:
+            owner->streamStatus(msg);
+            break;
+        default:
+            break;
+    }
+
+    return TRUE;
+}
+
+
+SrtMedia::SrtMedia(const SrtConfig& srtConfig, const MediaConfig& config) :
+    Media(config),
+    _p(new Private{.owner = this, .srtConfig = srtConfig})
+{
+}
+
+SrtMedia::~SrtMedia()
+{
+    shutdown();
+    _p.reset();
+}
+
+const GstSDPMessage* SrtMedia::sdp() const
+{
+    return _p->sdpPtr.get();
+}
+
+void SrtMedia::doRun()
+{
+    _p->prepare();
+    _p->pause();
+    _p->play();
+}
+
+void SrtMedia::shutdown()
+{
+    _p->null();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Media.h"
+
+
+struct SrtConfig
+{
+    std::string url; // srt://host:port, host is local address to bind in listener mode
+    bool listener = false; // caller otherwise
+    unsigned latency = 125; // ms, SRT receiver latency
+    unsigned buffer = 1000; // ms, MPEG-TS queued before demuxing, older data is dropped
+};
+
+// receives MPEG-TS over SRT, and repayloads H.264, H.265 and AAC
+// to RTP without decoding (transcoding still follows MediaConfig)
+class SrtMedia : public Media
+{
+    SrtMedia(const SrtMedia&) = delete;
+    SrtMedia(SrtMedia&&) = delete;
+    SrtMedia& operator = (const SrtMedia&) = delete;
+
+public:
+    SrtMedia(const SrtConfig&, const MediaConfig&);
+    ~SrtMedia();
+
+    const GstSDPMessage* sdp() const override;
+
+    void shutdown() override;
+
+protected:
+    void doRun() override;
+
+private:
+    struct Private;
+    std::unique_ptr<Private> _p;
+};
@@ -0,0 +1,18 @@
+#include "SrtMountPoint.h"
+
+
+SrtMountPoint::SrtMountPoint(
+    janus_callbacks* janus, janus_plugin* plugin,
+    const SrtConfig& srtConfig,
+    Flags flags,
+    const MediaConfig& mediaConfig,
+    const std::string& description) :
+    MountPoint(janus, plugin, flags, mediaConfig, description),
+    _srtConfig(srtConfig)
+{
+}
+
+std::unique_ptr<Media> SrtMountPoint::createMedia()
+{
+    return std::unique_ptr<Media>(new SrtMedia(_srtConfig, mediaConfig()));
+}
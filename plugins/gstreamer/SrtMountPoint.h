@@ -0,0 +1,22 @@
+#pragma once
+
+#include "MountPoint.h"
+#include "SrtMedia.h"
+
+
+class SrtMountPoint : public MountPoint
+{
+public:
+    SrtMountPoint(
+        janus_callbacks*, janus_plugin*,
+        const SrtConfig&,
+        Flags,
+        const MediaConfig&,
+        const std::string& description);
+
+protected:
+    std::unique_ptr<Media> createMedia() override;
+
+private:
+    const SrtConfig _srtConfig;
+};
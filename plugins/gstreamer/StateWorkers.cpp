@@ -0,0 +1,130 @@
+#include "StateWorkers.h"
+
+#include <chrono>
+
+extern "C" {
+#include "janus/debug.h"
+}
+
+#include "CxxPtr/GstPtr.h"
+
+#include "Probes.h"
+
+
+namespace {
+
+enum {
+    MAX_WORKERS = 64,
+};
+
+}
+
+struct StateWorkers::Transition
+{
+    bool done = false;
+};
+
+struct StateWorkers::Task
+{
+    std::shared_ptr<Sync> syncPtr;
+    TransitionPtr transitionPtr;
+    GstElementPtr elementPtr;
+    GstState state;
+};
+
+std::shared_ptr<StateWorkers> StateWorkers::Shared()
+{
+    static std::mutex guard;
+    static std::weak_ptr<StateWorkers> sharedWorkers;
+
+    std::lock_guard<std::mutex> lock(guard);
+
+    std::shared_ptr<StateWorkers> workers = sharedWorkers.lock();
+    if(!workers) {
+        workers = std::make_shared<StateWorkers>();
+        sharedWorkers = workers;
+    }
+
+    return workers;
+}
+
+StateWorkers::StateWorkers() :
+    _syncPtr(std::make_shared<Sync>()),
+    _pool(g_thread_pool_new(Run, nullptr, MAX_WORKERS, FALSE, nullptr))
+{
+}
+
+StateWorkers::~StateWorkers()
+{
+    // queued tasks are still executed
+    g_thread_pool_free(_pool, FALSE, TRUE);
+}
+
+StateWorkers::TransitionPtr StateWorkers::setState(GstElement* element, GstState state)
+{
+    TransitionPtr transitionPtr = std::make_shared<Transition>();
+
+    gst_object_ref(element);
+    Task* task = new Task{_syncPtr, transitionPtr, GstElementPtr(element), state};
+
+    {
+        std::lock_guard<std::mutex> lock(_syncPtr->guard);
+        ++_syncPtr->pending;
+    }
+
+    g_thread_pool_push(_pool, task, nullptr);
+
+    return transitionPtr;
+}
+
+void StateWorkers::wait(const TransitionPtr& transitionPtr)
+{
+    if(!transitionPtr)
+        return;
+
+    std::unique_lock<std::mutex> lock(_syncPtr->guard);
+    _syncPtr->finished.wait(lock, [&transitionPtr] () { return transitionPtr->done; });
+}
+
+bool StateWorkers::waitAll(gint64 deadline)
+{
+    std::unique_lock<std::mutex> lock(_syncPtr->guard);
+    while(_syncPtr->pending) {
+        const gint64 timeout = deadline - g_get_monotonic_time();
+        if(timeout <= 0 ||
+           std::cv_status::timeout ==
+               _syncPtr->finished.wait_for(lock, std::chrono::microseconds(timeout)))
+        {
+            if(_syncPtr->pending) {
+                JANUS_LOG(LOG_WARN,
+                    "StateWorkers::waitAll. %u state changes are still running\n",
+                    _syncPtr->pending);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void StateWorkers::Run(gpointer data, gpointer /*userData*/)
+{
+    std::unique_ptr<Task> task(static_cast<Task*>(data));
+
+    GstElement* element = task->elementPtr.get();
+    PROBE2(state_change_begin, element, task->state);
+    const GstStateChangeReturn result = gst_element_set_state(element, task->state);
+    PROBE3(state_change_end, element, task->state, result);
+
+    if(GST_STATE_CHANGE_FAILURE == result)
+        JANUS_LOG(LOG_ERR, "StateWorkers::Run. gst_element_set_state failed\n");
+
+    // the last reference of destroyed media could be dropped here
+    task->elementPtr.reset();
+
+    Sync& sync = *task->syncPtr;
+    std::lock_guard<std::mutex> lock(sync.guard);
+    task->transitionPtr->done = true;
+    --sync.pending;
+    sync.finished.notify_all();
+}
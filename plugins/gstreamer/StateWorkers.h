@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#include <gst/gst.h>
+
+
+// bounded pool of threads changing state of media pipelines,
+// so slow transitions (like rtspsrc TEARDOWN) of different media run in parallel
+class StateWorkers
+{
+    StateWorkers(const StateWorkers&) = delete;
+    StateWorkers& operator = (const StateWorkers&) = delete;
+
+public:
+    struct Transition;
+    typedef std::shared_ptr<Transition> TransitionPtr;
+
+    static std::shared_ptr<StateWorkers> Shared();
+
+    StateWorkers();
+    // waits transitions which are still running, so pool threads don't outlive plugin.
+    // Never destroyed if shutdown deadline was missed
+    ~StateWorkers();
+
+    // takes own reference of element until transition is finished
+    TransitionPtr setState(GstElement*, GstState);
+    void wait(const TransitionPtr&);
+    // waits all dispatched transitions, false if deadline (monotonic time) is reached
+    bool waitAll(gint64 deadline);
+
+private:
+    // shared with queued tasks
+    struct Sync
+    {
+        std::mutex guard;
+        std::condition_variable finished;
+        unsigned pending = 0;
+    };
+
+    struct Task;
+
+    static void Run(gpointer task, gpointer userData);
+
+private:
+    std::shared_ptr<Sync> _syncPtr;
+    GThreadPool* _pool;
+};
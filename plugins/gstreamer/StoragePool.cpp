@@ -0,0 +1,117 @@
+#include "StoragePool.h"
+
+#include <new>
+#include <algorithm>
+
+
+namespace {
+
+struct Registry
+{
+    std::mutex guard;
+    std::vector<const StoragePool*> pools;
+};
+
+Registry& GetRegistry()
+{
+    // never destroyed, like pools themselves
+    static Registry* registry = new Registry;
+    return *registry;
+}
+
+}
+
+std::vector<StoragePool::Stats> StoragePool::AllStats()
+{
+    Registry& registry = GetRegistry();
+
+    std::lock_guard<std::mutex> lock(registry.guard);
+
+    std::vector<Stats> stats;
+    stats.reserve(registry.pools.size());
+    for(const StoragePool* pool: registry.pools)
+        stats.push_back(pool->stats());
+
+    return stats;
+}
+
+StoragePool::StoragePool(const char* name, size_t size, unsigned capacity) :
+    _name(name), _size(size), _capacity(capacity)
+{
+    _free.reserve(capacity);
+
+    Registry& registry = GetRegistry();
+
+    std::lock_guard<std::mutex> lock(registry.guard);
+    registry.pools.push_back(this);
+}
+
+StoragePool::~StoragePool()
+{
+    {
+        Registry& registry = GetRegistry();
+
+        std::lock_guard<std::mutex> lock(registry.guard);
+        registry.pools.erase(
+            std::remove(registry.pools.begin(), registry.pools.end(), this),
+            registry.pools.end());
+    }
+
+    for(void* storage: _free)
+        ::operator delete(storage);
+}
+
+void* StoragePool::allocate(size_t size)
+{
+    if(size != _size)
+        return ::operator new(size);
+
+    {
+        std::lock_guard<std::mutex> lock(_guard);
+        ++_used;
+        if(!_free.empty()) {
+            void* storage = _free.back();
+            _free.pop_back();
+            ++_reused;
+            return storage;
+        }
+        ++_allocated;
+    }
+
+    return ::operator new(size);
+}
+
+void StoragePool::release(void* storage, size_t size)
+{
+    if(!storage)
+        return;
+
+    if(size != _size) {
+        ::operator delete(storage);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_guard);
+        --_used;
+        // capacity was reserved, so push_back doesn't allocate
+        if(_free.size() < _capacity) {
+            _free.push_back(storage);
+            return;
+        }
+    }
+
+    ::operator delete(storage);
+}
+
+StoragePool::Stats StoragePool::stats() const
+{
+    std::lock_guard<std::mutex> lock(_guard);
+
+    return Stats{
+        _name,
+        _allocated,
+        _reused,
+        _used,
+        static_cast<unsigned>(_free.size())};
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+
+// keeps storage of destroyed objects of the same size for reuse,
+// so objects created per request don't hit heap in steady state
+class StoragePool
+{
+    StoragePool(const StoragePool&) = delete;
+    StoragePool& operator = (const StoragePool&) = delete;
+
+public:
+    struct Stats
+    {
+        const char* name;
+        unsigned long allocated; // taken from heap
+        unsigned long reused; // taken from pool
+        unsigned used;
+        unsigned free;
+    };
+
+    static std::vector<Stats> AllStats();
+
+    StoragePool(const char* name, size_t size, unsigned capacity);
+    ~StoragePool();
+
+    void* allocate(size_t);
+    void release(void*, size_t);
+
+    Stats stats() const;
+
+private:
+    const char *const _name;
+    const size_t _size;
+    const unsigned _capacity;
+
+    mutable std::mutex _guard;
+    std::vector<void*> _free;
+    unsigned long _allocated = 0;
+    unsigned long _reused = 0;
+    unsigned _used = 0;
+};
+
+// class specific operator new/delete taking storage from T::Pool(),
+// objects of derived classes with different size are allocated as usual
+template<typename T>
+struct Pooled
+{
+    static void* operator new(size_t size)
+        { return T::Pool().allocate(size); }
+    static void operator delete(void* storage, size_t size)
+        { T::Pool().release(storage, size); }
+};
@@ -0,0 +1,190 @@
+#include "UdpForwarder.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+extern "C" {
+#include "janus/debug.h"
+#include "janus/rtp.h"
+}
+
+
+namespace {
+
+enum {
+    MAX_BATCH_PACKETS = 32,
+    BATCH_BUFFER_SIZE = 64 * 1024,
+    AUDIO_PORT_OFFSET = 2, // from video port of destination
+};
+
+}
+
+static bool IsMulticast(const sockaddr_in& address)
+{
+    return IN_MULTICAST(ntohl(address.sin_addr.s_addr));
+}
+
+UdpForwarder::UdpForwarder(const MediaConfig::Forward& config) :
+    _socket(-1), _dropped(0)
+{
+    bool multicast = false;
+    for(const MediaConfig::Forward::Destination& destination: config.destinations) {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        if(1 != inet_pton(AF_INET, destination.host.c_str(), &address.sin_addr)) {
+            JANUS_LOG(LOG_ERR, "Invalid forward destination \"%s\"\n", destination.host.c_str());
+            continue;
+        }
+
+        address.sin_port = htons(destination.port);
+        _video.destinations.push_back(address);
+
+        address.sin_port = htons(destination.port + AUDIO_PORT_OFFSET);
+        _audio.destinations.push_back(address);
+
+        multicast = multicast || IsMulticast(address);
+    }
+
+    if(_video.destinations.empty())
+        return;
+
+    _socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(_socket < 0) {
+        JANUS_LOG(LOG_ERR, "Failed to create forward socket: %s\n", g_strerror(errno));
+        return;
+    }
+
+    if(multicast) {
+        const unsigned char ttl = config.ttl;
+        if(0 != setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)))
+            JANUS_LOG(LOG_WARN, "Failed to set multicast ttl: %s\n", g_strerror(errno));
+    }
+
+    for(Batch* batch: { &_video, &_audio }) {
+        batch->buffer.resize(BATCH_BUFFER_SIZE);
+        batch->packets.reserve(MAX_BATCH_PACKETS);
+        batch->iovecs.resize(MAX_BATCH_PACKETS);
+        batch->messages.resize(MAX_BATCH_PACKETS * batch->destinations.size());
+    }
+}
+
+UdpForwarder::~UdpForwarder()
+{
+    if(_socket >= 0)
+        close(_socket);
+}
+
+bool UdpForwarder::isValid() const
+{
+    return _socket >= 0;
+}
+
+void UdpForwarder::mediaPrepared(const std::vector<Stream>& streams)
+{
+    std::lock_guard<std::mutex> lock(_guard);
+
+    for(Batch* batch: { &_video, &_audio }) {
+        batch->stream = -1;
+        batch->packets.clear();
+        batch->size = 0;
+
+        // reconnected source starts new RTP streams
+        batch->rewriter.switchSource();
+    }
+
+    for(const Stream& stream: streams) {
+        Batch& batch = stream.video ? _video : _audio;
+        if(batch.stream >= 0)
+            continue;
+
+        gint clockRate = 0;
+        if(stream.caps && !gst_caps_is_empty(stream.caps))
+            gst_structure_get_int(gst_caps_get_structure(stream.caps, 0), "clock-rate", &clockRate);
+
+        batch.stream = stream.index;
+        batch.clockRate = clockRate > 0 ? clockRate : 90000;
+    }
+}
+
+void UdpForwarder::onPacket(unsigned stream, bool /*keyFrame*/, const char* data, size_t size)
+{
+    if(size < sizeof(janus_rtp_header))
+        return;
+
+    std::lock_guard<std::mutex> lock(_guard);
+
+    Batch* batchPtr =
+        static_cast<int>(stream) == _video.stream ? &_video :
+        static_cast<int>(stream) == _audio.stream ? &_audio :
+        nullptr;
+    if(!batchPtr)
+        return;
+
+    Batch& batch = *batchPtr;
+
+    if(batch.size + size > batch.buffer.size())
+        flush(batch);
+    if(size > batch.buffer.size())
+        return;
+
+    char* packet = batch.buffer.data() + batch.size;
+    memcpy(packet, data, size);
+
+    janus_rtp_header* header = reinterpret_cast<janus_rtp_header*>(packet);
+    batch.rewriter.rewrite(header, ntohs(header->seq_number), ntohl(header->timestamp), batch.clockRate);
+
+    batch.packets.push_back(size);
+    batch.size += size;
+
+    // the rest of video frame follows immediately, so it's worth to wait for it
+    if(&batch == &_audio || header->markerbit || batch.packets.size() >= MAX_BATCH_PACKETS)
+        flush(batch);
+}
+
+void UdpForwarder::flush(Batch& batch)
+{
+    if(batch.packets.empty())
+        return;
+
+    const size_t destinationsCount = batch.destinations.size();
+    const size_t messagesCount = batch.packets.size() * destinationsCount;
+
+    std::vector<iovec>& iovecs = batch.iovecs;
+    std::vector<mmsghdr>& messages = batch.messages;
+
+    size_t offset = 0;
+    for(size_t p = 0; p < batch.packets.size(); ++p) {
+        iovecs[p].iov_base = batch.buffer.data() + offset;
+        iovecs[p].iov_len = batch.packets[p];
+        offset += batch.packets[p];
+
+        for(size_t d = 0; d < destinationsCount; ++d) {
+            msghdr& message = messages[p * destinationsCount + d].msg_hdr;
+            message.msg_name = &batch.destinations[d];
+            message.msg_namelen = sizeof(sockaddr_in);
+            message.msg_iov = &iovecs[p];
+            message.msg_iovlen = 1;
+        }
+    }
+
+    for(size_t sent = 0; sent < messagesCount; ) {
+        const int result = sendmmsg(_socket, messages.data() + sent, messagesCount - sent, 0);
+        if(result > 0) {
+            sent += result;
+            continue;
+        }
+
+        if(errno == EINTR)
+            continue;
+
+        // socket buffer is full, so forwarding can't keep up anyway
+        if(0 == _dropped++ % 1000)
+            JANUS_LOG(LOG_WARN, "Forwarding RTP failed: %s\n", g_strerror(errno));
+        break;
+    }
+
+    batch.packets.clear();
+    batch.size = 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "MediaConfig.h"
+#include "MountPointTap.h"
+#include "RtpRewriter.h"
+
+
+// forwards relayed RTP to UDP unicast or multicast destinations, sending every packet once
+// to all of them with one sendmmsg. Packets of the same video frame are batched together.
+// SSRC, sequence numbers and timestamps are kept continuous while source is reconnected.
+class UdpForwarder : public MountPointTap
+{
+public:
+    UdpForwarder(const MediaConfig::Forward&);
+    ~UdpForwarder();
+
+    bool isValid() const;
+
+    void mediaPrepared(const std::vector<Stream>&) override;
+    void onPacket(unsigned stream, bool keyFrame, const char* data, size_t size) override;
+
+private:
+    struct Batch
+    {
+        int stream = -1;
+        guint32 clockRate = 90000;
+        std::vector<sockaddr_in> destinations;
+        RtpRewriter rewriter;
+
+        std::vector<char> buffer;
+        std::vector<size_t> packets; // sizes
+        size_t size = 0;
+
+        // preallocated for the largest batch
+        std::vector<iovec> iovecs;
+        std::vector<mmsghdr> messages;
+    };
+
+    void flush(Batch&);
+
+private:
+    int _socket;
+
+    std::mutex _guard;
+    Batch _video;
+    Batch _audio;
+    unsigned _dropped;
+};
@@ -0,0 +1,167 @@
+#include "WebRtcFormat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "CxxPtr/GlibPtr.h"
+
+
+namespace {
+
+enum {
+    H264_NAL_SPS = 7,
+};
+
+enum {
+    H264_PROFILE_BASELINE = 66,
+    H264_PROFILE_MAIN = 77,
+    H264_PROFILE_HIGH = 100,
+};
+
+const char* DefaultH264ProfileLevelId = "42e01f";
+
+}
+
+static bool H264ProfileLevelIdFromSps(
+    const gchar* spropParameterSets,
+    guint8 profileLevelId[3])
+{
+    if(!spropParameterSets)
+        return false;
+
+    const std::string sps(spropParameterSets, strcspn(spropParameterSets, ","));
+
+    gsize size = 0;
+    guchar* nal = g_base64_decode(sps.c_str(), &size);
+
+    const bool valid = nal && size >= 4 && H264_NAL_SPS == (nal[0] & 0x1f);
+    if(valid)
+        memcpy(profileLevelId, nal + 1, 3);
+
+    g_free(nal);
+
+    return valid;
+}
+
+static bool H264ProfileLevelId(
+    const GstStructure* structure,
+    guint8 profileLevelId[3])
+{
+    // some cameras put into SDP profile-level-id not matching actual SPS
+    if(H264ProfileLevelIdFromSps(
+        gst_structure_get_string(structure, "sprop-parameter-sets"),
+        profileLevelId))
+    {
+        return true;
+    }
+
+    const gchar* profileLevelIdStr =
+        gst_structure_get_string(structure, "profile-level-id");
+    if(!profileLevelIdStr || strlen(profileLevelIdStr) != 6)
+        return false;
+
+    return
+        3 == sscanf(
+            profileLevelIdStr, "%2hhx%2hhx%2hhx",
+            &profileLevelId[0], &profileLevelId[1], &profileLevelId[2]);
+}
+
+static bool IsWebRtcH264(const GstStructure* structure)
+{
+    // interleaved mode is not supported by browsers
+    const gchar* packetizationMode =
+        gst_structure_get_string(structure, "packetization-mode");
+    if(packetizationMode && atoi(packetizationMode) > 1)
+        return false;
+
+    guint8 profileLevelId[3];
+    if(!H264ProfileLevelId(structure, profileLevelId))
+        return true;
+
+    switch(profileLevelId[0]) {
+        case H264_PROFILE_BASELINE:
+        case H264_PROFILE_MAIN:
+        case H264_PROFILE_HIGH:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool IsWebRtcCompatible(const GstCaps* caps)
+{
+    if(!caps || gst_caps_is_empty(caps))
+        return true;
+
+    const GstStructure* structure = gst_caps_get_structure(caps, 0);
+
+    const gchar* media = gst_structure_get_string(structure, "media");
+    const gchar* encodingName = gst_structure_get_string(structure, "encoding-name");
+    if(!encodingName)
+        return true;
+
+    if(0 == g_strcmp0(media, "video")) {
+        if(0 == g_ascii_strcasecmp(encodingName, "H264"))
+            return IsWebRtcH264(structure);
+
+        return
+            0 == g_ascii_strcasecmp(encodingName, "VP8") ||
+            0 == g_ascii_strcasecmp(encodingName, "VP9") ||
+            0 == g_ascii_strcasecmp(encodingName, "AV1");
+    } else if(0 == g_strcmp0(media, "audio")) {
+        gint clockRate = 0;
+        gst_structure_get_int(structure, "clock-rate", &clockRate);
+
+        if(0 == g_ascii_strcasecmp(encodingName, "PCMU") ||
+           0 == g_ascii_strcasecmp(encodingName, "PCMA"))
+        {
+            return 8000 == clockRate;
+        }
+
+        return
+            0 == g_ascii_strcasecmp(encodingName, "OPUS") ||
+            0 == g_ascii_strcasecmp(encodingName, "G722");
+    }
+
+    return true;
+}
+
+GstCaps* WebRtcFormatCaps(const GstCaps* caps)
+{
+    GstStructure* structure = gst_structure_copy(gst_caps_get_structure(caps, 0));
+
+    auto formatField =
+        [] (GQuark fieldId, GValue* /*value*/, gpointer /*userData*/) -> gboolean
+    {
+        const gchar* field = g_quark_to_string(fieldId);
+        return
+            !g_str_has_prefix(field, "a-") &&
+            !g_str_has_prefix(field, "x-") &&
+            !g_str_has_prefix(field, "rtcp-fb-");
+    };
+    gst_structure_filter_and_map_in_place(structure, formatField, nullptr);
+
+    if(0 == g_strcmp0(gst_structure_get_string(structure, "encoding-name"), "H264")) {
+        guint8 profileLevelId[3];
+        GCharPtr profileLevelIdPtr(
+            H264ProfileLevelId(structure, profileLevelId) ?
+                g_strdup_printf(
+                    "%02x%02x%02x",
+                    profileLevelId[0], profileLevelId[1], profileLevelId[2]) :
+                g_strdup(DefaultH264ProfileLevelId));
+
+        gst_structure_set(
+            structure,
+            "profile-level-id", G_TYPE_STRING, profileLevelIdPtr.get(),
+            "level-asymmetry-allowed", G_TYPE_STRING, "1",
+            NULL);
+    }
+
+    GstCaps* formatCaps = gst_caps_new_empty();
+    gst_caps_append_structure(formatCaps, structure);
+
+    return formatCaps;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <gst/gst.h>
+
+
+// source RTP stream can be relayed to browsers as is
+bool IsWebRtcCompatible(const GstCaps*);
+
+// caps suitable for gst_sdp_media_set_media_from_caps:
+// source session attributes are dropped, H.264 profile is taken from SPS if available
+GstCaps* WebRtcFormatCaps(const GstCaps*);
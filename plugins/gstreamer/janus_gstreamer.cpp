@@ -8,6 +8,7 @@
 extern "C" {
 #include "janus/plugins/plugin.h"
 #include "janus/debug.h"
+#include "janus/rtcp.h"
 }
 
 #include "CxxPtr/GstPtr.h"
@@ -18,6 +19,7 @@ extern "C" {
 #include "PluginContext.h"
 #include "Request.h"
 #include "PluginMain.h"
+#include "StoragePool.h"
 
 
 namespace
@@ -57,6 +59,7 @@ HandleMessage(
     janus_plugin_session*, char* transaction,
     json_t* message, json_t* jsep);
 static void SetupMedia(janus_plugin_session*);
+static void IncomingRtcp(janus_plugin_session*, janus_plugin_rtcp*);
 static void HangupMedia(janus_plugin_session*);
 static json_t* QuerySession(janus_plugin_session*);
 
@@ -85,7 +88,7 @@ extern "C" janus_plugin* create()
             .handle_admin_message  = nullptr,
             .setup_media           = SetupMedia,
             .incoming_rtp          = nullptr,
-            .incoming_rtcp         = nullptr,
+            .incoming_rtcp         = IncomingRtcp,
             .incoming_data         = nullptr,
             .data_ready            = nullptr,
             .slow_link             = nullptr,
@@ -192,6 +195,53 @@ static janus_plugin_result* InvalidJson(const char* errorText)
             static_cast<janus_plugin_result_type>(INVALID_JSON_ERROR), errorText, nullptr);
 }
 
+static json_t* CpusJson(const std::vector<unsigned>& cpus)
+{
+    json_t* array = json_array();
+    for(unsigned cpu: cpus)
+        json_array_append_new(array, json_integer(cpu));
+
+    return array;
+}
+
+static json_t* PlacementJson(const MediaConfig::Threads& threads)
+{
+    const char* scheduling = "default";
+    switch(threads.scheduling) {
+        case MediaConfig::Threads::Scheduling::Default:
+            break;
+        case MediaConfig::Threads::Scheduling::Fifo:
+            scheduling = "fifo";
+            break;
+        case MediaConfig::Threads::Scheduling::Nice:
+            scheduling = "nice";
+            break;
+    }
+
+    json_t* placement = json_object();
+    json_object_set_new(placement, "cpus", CpusJson(threads.cpus));
+    json_object_set_new(placement, "encoder_cpus", CpusJson(threads.encoderCpus));
+    json_object_set_new(placement, "scheduling", json_string(scheduling));
+    json_object_set_new(placement, "priority", json_integer(threads.priority));
+
+    return placement;
+}
+
+static json_t* AllocationsJson()
+{
+    json_t* allocations = json_object();
+    for(const StoragePool::Stats& stats: StoragePool::AllStats()) {
+        json_t* pool = json_object();
+        json_object_set_new(pool, "allocated", json_integer(stats.allocated));
+        json_object_set_new(pool, "reused", json_integer(stats.reused));
+        json_object_set_new(pool, "used", json_integer(stats.used));
+        json_object_set_new(pool, "free", json_integer(stats.free));
+        json_object_set_new(allocations, stats.name, pool);
+    }
+
+    return allocations;
+}
+
 static struct janus_plugin_result* HandleList()
 {
     PluginContext& context = Context();
@@ -206,6 +256,8 @@ static struct janus_plugin_result* HandleList()
         json_object_set_new(listItem, "id", json_integer(pair.first));
         json_object_set_new(listItem, "description", json_string(pair.second->description().c_str()));
         json_object_set_new(listItem, "type", json_string("live"));
+        json_object_set_new(listItem, "threads", json_integer(pair.second->threadsCount()));
+        json_object_set_new(listItem, "placement", PlacementJson(pair.second->threadsPlacement()));
         json_array_append_new(list, listItemPtr.release());
     }
 
@@ -214,6 +266,7 @@ static struct janus_plugin_result* HandleList()
 
     json_object_set_new(response, "streaming", json_string("list"));
     json_object_set_new(response, "list", listPtr.release());
+    json_object_set_new(response, "allocations", AllocationsJson());
 
     return
         janus_plugin_result_new(
@@ -228,16 +281,17 @@ struct janus_plugin_result* HandleMessage(
 {
     JANUS_LOG(LOG_DBG, ">>>> %s: HandleMessage\n", PluginName);
 
-    {
+    // JANUS_LOG checks log level only after arguments are already serialized
+    if(janus_log_level >= LOG_DBG) {
         char* json = json_dumps(message, JSON_INDENT(4));
         JANUS_LOG(LOG_DBG, "message:\n%s\n", json);
         free(json);
-    }
 
-    if(jsep) {
-        char* json = json_dumps(jsep, JSON_INDENT(4));
-        JANUS_LOG(LOG_DBG, "jsep:\n%s\n", json);
-        free(json);
+        if(jsep) {
+            json = json_dumps(jsep, JSON_INDENT(4));
+            JANUS_LOG(LOG_DBG, "jsep:\n%s\n", json);
+            free(json);
+        }
     }
 
     if(!json_is_object(message))
@@ -278,6 +332,42 @@ struct janus_plugin_result* HandleMessage(
                 JANUS_PLUGIN_OK_WAIT, nullptr, nullptr);
         break;
     }
+    case Request::Configure: {
+        JANUS_LOG(LOG_DBG, "%s: Request::Configure\n", PluginName);
+
+        PostClientMessage(janusSession, transaction, message);
+
+        return
+            janus_plugin_result_new(
+                JANUS_PLUGIN_OK_WAIT, nullptr, nullptr);
+    }
+    case Request::Switch: {
+        JANUS_LOG(LOG_DBG, "%s: Request::Switch\n", PluginName);
+
+        PostClientMessage(janusSession, transaction, message);
+
+        return
+            janus_plugin_result_new(
+                JANUS_PLUGIN_OK_WAIT, nullptr, nullptr);
+    }
+    case Request::Subscribe: {
+        JANUS_LOG(LOG_DBG, "%s: Request::Subscribe\n", PluginName);
+
+        PostClientMessage(janusSession, transaction, message);
+
+        return
+            janus_plugin_result_new(
+                JANUS_PLUGIN_OK_WAIT, nullptr, nullptr);
+    }
+    case Request::Unsubscribe: {
+        JANUS_LOG(LOG_DBG, "%s: Request::Unsubscribe\n", PluginName);
+
+        PostClientMessage(janusSession, transaction, message);
+
+        return
+            janus_plugin_result_new(
+                JANUS_PLUGIN_OK_WAIT, nullptr, nullptr);
+    }
     default:
         return InvalidJson("JSON error: unknown request\n");
     }
@@ -290,6 +380,22 @@ void SetupMedia(janus_plugin_session* /*janusSession*/)
     JANUS_LOG(LOG_DBG, ">>>> %s: SetupMedia\n", PluginName);
 }
 
+static void IncomingRtcp(janus_plugin_session* janusSession, janus_plugin_rtcp* packet)
+{
+    if(!packet->video)
+        return;
+
+    // used for automatic layer selection
+    const guint32 bitrate = janus_rtcp_get_remb(packet->buffer, packet->length);
+    if(!bitrate)
+        return;
+
+    // session could be destroyed on plugin thread meanwhile
+    std::lock_guard<std::mutex> lock(Context().sessionsGuard);
+    if(Session* session = GetSession(janusSession))
+        session->estimatedBitrate = bitrate;
+}
+
 json_t* QuerySession(janus_plugin_session* /*janusSession*/)
 {
     JANUS_LOG(LOG_DBG, ">>>> %s: QuerySession\n", PluginName);